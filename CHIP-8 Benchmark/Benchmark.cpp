@@ -0,0 +1,480 @@
+#include "Batch.h"
+#include "CHIP8.h"
+#include "MappedFile.h"
+#include "Programs.h"
+#include "Scheduler.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Headless benchmark of the CHIP8 core. Runs every program (the built-in microbenchmarks and
+ROMs, plus any ROM files given on the command line) on every engine through a Scheduler, the same
+way the frontend does in turbo mode, and reports instructions/sec, ns/instruction and
+frames/sec. Cycles the core skips as idle (key waits, jumps to self, delay timer polls) aren't
+counted as instructions but reported on their own, as skipped/sec. With --batch the programs also run on that many lanes of a Batch, counting the
+instructions of every lane. With --verify the engines are also checked against each other (and the
+batch lanes against machines seeded like them), with --profile the programs are profiled (see
+Profile.h, needs CHIP8_INSTRUMENTATION).
+*/
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const std::uint64_t SEED = 0xC8C8C8C8; // Same random numbers for every run.
+    const unsigned int WARMUP_FRAMES = 60; // Not measured, lets hot blocks get compiled.
+    const unsigned int CHECK_FRAMES = 16; // Frames between looking at the clock.
+
+    struct Options
+    {
+        unsigned int clock;
+        double seconds; // Minimum time measured per program and engine.
+        std::string format; // table, csv or json.
+        std::string output; // File to write the results to, standard output if empty.
+        std::string filter; // Only programs whose name contains this.
+        std::vector<CHIP8::Engine> engines;
+        unsigned int batch; // Lanes of the batch engine, 0 to not run it.
+        bool verify;
+        unsigned int frames; // Frames run for --verify and --profile.
+        std::string profile; // File to write profiles to, none if empty.
+        CHIP8::Quirks quirks;
+    };
+
+    struct Result
+    {
+        std::string program;
+        std::string kind; // micro, rom or file.
+        std::string engine;
+        unsigned long long instructions; // Executed, without the skipped ones.
+        unsigned long long skipped; // Cycles skipped by idle detection.
+        unsigned long long frames;
+        double seconds;
+    };
+
+    bool parseEngine(const std::string& name, std::vector<CHIP8::Engine>& engines)
+    {
+        if (name == "all")
+        {
+            engines.push_back(CHIP8::ENGINE_INTERPRETER);
+            engines.push_back(CHIP8::ENGINE_PREDECODED);
+            engines.push_back(CHIP8::ENGINE_BLOCKS);
+            if (JIT::available())
+                engines.push_back(CHIP8::ENGINE_JIT);
+            if (Recompiled::count() > 0) // Only the -native build has programs to run.
+                engines.push_back(CHIP8::ENGINE_NATIVE);
+            return true;
+        }
+        CHIP8::Engine engine;
+        if (!CHIP8::parseEngine(name, engine))
+            return false;
+        engines.push_back(engine);
+        return true;
+    }
+
+    Result measure(const Program& program, const char* kind, CHIP8::Engine engine, const Options& options)
+    {
+        CHIP8 core(SEED);
+        core.loadGame(program.data, program.size, options.quirks);
+        core.engine(engine);
+        Scheduler scheduler(core, options.clock);
+        for (unsigned int i = 0; i < WARMUP_FRAMES; ++i)
+            scheduler.runFrame();
+
+        Result result = { program.name, kind, CHIP8::engineName(engine), 0, 0, 0, 0.0 };
+        unsigned long long skipped = core.skippedCycles();
+        Clock::time_point start = Clock::now();
+        Clock::duration minimum = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(options.seconds));
+        Clock::duration elapsed;
+        do
+        {
+            for (unsigned int i = 0; i < CHECK_FRAMES; ++i)
+                result.instructions += scheduler.runFrame();
+            result.frames += CHECK_FRAMES;
+            elapsed = Clock::now() - start;
+        } while (elapsed < minimum);
+        result.seconds = std::chrono::duration<double>(elapsed).count();
+        result.skipped = core.skippedCycles() - skipped;
+        result.instructions -= result.skipped;
+        return result;
+    }
+
+    // The same on options.batch lanes, started from the same machine as the other engines. Returns
+    // false for programs a Batch can't run.
+    bool measureBatch(const Program& program, const char* kind, const Options& options, Result& result)
+    {
+        CHIP8 core(SEED);
+        core.loadGame(program.data, program.size, options.quirks);
+        Batch batch(options.batch, options.clock);
+        if (!batch.start(core, SEED))
+            return false;
+        for (unsigned int i = 0; i < WARMUP_FRAMES; ++i)
+            batch.runFrame();
+
+        Result measured = { program.name, kind, "batch", 0, 0, 0, 0.0 }; // Lanes don't skip.
+        Clock::time_point start = Clock::now();
+        Clock::duration minimum = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(options.seconds));
+        Clock::duration elapsed;
+        do
+        {
+            for (unsigned int i = 0; i < CHECK_FRAMES; ++i)
+                measured.instructions += static_cast<unsigned long long>(batch.runFrame()) * batch.lanes();
+            measured.frames += CHECK_FRAMES;
+            elapsed = Clock::now() - start;
+        } while (elapsed < minimum);
+        measured.seconds = std::chrono::duration<double>(elapsed).count();
+        result = measured;
+        return true;
+    }
+
+    // Runs program for the same number of frames on every engine and compares the machine states
+    // with the first engine's. Returns false on a mismatch.
+    bool verify(const Program& program, const Options& options)
+    {
+        std::vector<unsigned char> expected;
+        for (std::size_t i = 0; i < options.engines.size(); ++i)
+        {
+            CHIP8 core(SEED);
+            core.loadGame(program.data, program.size, options.quirks);
+            core.engine(options.engines[i]);
+            Scheduler scheduler(core, options.clock);
+            for (unsigned int frame = 0; frame < options.frames; ++frame)
+                scheduler.runFrame();
+
+            std::vector<unsigned char> state;
+            core.saveState(state);
+            if (i == 0)
+                expected.swap(state);
+            else if (state != expected)
+            {
+                std::cerr << program.name << ": " << CHIP8::engineName(options.engines[i]) << " differs from "
+                          << CHIP8::engineName(options.engines[0]) << " after " << options.frames
+                          << " frames" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Runs program for the same number of frames on options.batch lanes and compares every lane that
+    // didn't stop with a machine seeded like it. Returns false on a mismatch.
+    bool verifyBatch(const Program& program, const Options& options)
+    {
+        CHIP8 start(SEED);
+        start.loadGame(program.data, program.size, options.quirks);
+        Batch batch(options.batch, options.clock);
+        if (!batch.start(start, SEED))
+            return true;
+        for (unsigned int frame = 0; frame < options.frames; ++frame)
+            batch.runFrame();
+
+        for (unsigned int lane = 0; lane < batch.lanes(); ++lane)
+        {
+            if (batch.stopped(lane))
+                continue;
+            CHIP8 core(SEED + lane);
+            core.loadGame(program.data, program.size, options.quirks);
+            core.engine(CHIP8::ENGINE_INTERPRETER);
+            Scheduler scheduler(core, options.clock);
+            for (unsigned int frame = 0; frame < options.frames; ++frame)
+                scheduler.runFrame();
+
+            std::vector<unsigned char> expected, state;
+            core.saveState(expected);
+            batch.saveState(lane, state);
+            if (state != expected)
+            {
+                std::cerr << program.name << ": batch lane " << lane << " differs from "
+                          << CHIP8::engineName(CHIP8::ENGINE_INTERPRETER) << " after " << options.frames
+                          << " frames" << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    double perSecond(unsigned long long count, double seconds)
+    {
+        return seconds > 0.0 ? count / seconds : 0.0;
+    }
+
+    double nsPerInstruction(const Result& result)
+    {
+        return result.instructions > 0 ? result.seconds * 1e9 / result.instructions : 0.0;
+    }
+
+    std::string jsonString(const std::string& value)
+    {
+        std::string quoted = "\"";
+        for (std::size_t i = 0; i < value.size(); ++i)
+        {
+            if (value[i] == '"' || value[i] == '\\')
+                quoted += '\\';
+            quoted += value[i];
+        }
+        return quoted + "\"";
+    }
+
+    // Runs program for the given number of frames with profiling on and writes its profile, as a
+    // member of a JSON object or as CSV rows starting with the program name.
+    void profile(const Program& program, const Options& options, std::ostream& out, bool first)
+    {
+        CHIP8 core(SEED);
+        core.loadGame(program.data, program.size, options.quirks);
+        core.profiling(true);
+        Scheduler scheduler(core, options.clock);
+        for (unsigned int frame = 0; frame < options.frames; ++frame)
+            scheduler.runFrame();
+
+        std::stringstream snapshot;
+        if (options.format == "csv")
+        {
+            core.profile().writeCSV(snapshot);
+            std::string line;
+            std::getline(snapshot, line); // Header.
+            if (first)
+                out << "program," << line << '\n';
+            while (std::getline(snapshot, line))
+                out << program.name << ',' << line << '\n';
+        }
+        else
+        {
+            core.profile().writeJSON(snapshot);
+            std::string json = snapshot.str();
+            json.erase(json.find_last_not_of('\n') + 1);
+            out << (first ? "{\n" : ",\n") << jsonString(program.name) << ": " << json;
+        }
+    }
+
+    void writeResults(std::ostream& out, const std::vector<Result>& results, const Options& options)
+    {
+        out << std::fixed;
+        if (options.format == "csv")
+        {
+            out << "program,kind,engine,instructions,skipped,frames,seconds,instructions_per_second,"
+                   "ns_per_instruction,skipped_per_second,frames_per_second\n";
+            for (std::size_t i = 0; i < results.size(); ++i)
+            {
+                const Result& r = results[i];
+                out << r.program << ',' << r.kind << ',' << r.engine << ',' << r.instructions << ','
+                    << r.skipped << ',' << r.frames << ',' << std::setprecision(6) << r.seconds << ','
+                    << std::setprecision(0) << perSecond(r.instructions, r.seconds) << ','
+                    << std::setprecision(3) << nsPerInstruction(r) << ',' << std::setprecision(0)
+                    << perSecond(r.skipped, r.seconds) << ',' << std::setprecision(1) << perSecond(r.frames, r.seconds) << '\n';
+            }
+        }
+        else if (options.format == "json")
+        {
+            out << "{\n  \"clock\": " << options.clock << ",\n  \"results\": [";
+            for (std::size_t i = 0; i < results.size(); ++i)
+            {
+                const Result& r = results[i];
+                out << (i == 0 ? "\n" : ",\n")
+                    << "    { \"program\": " << jsonString(r.program) << ", \"kind\": " << jsonString(r.kind)
+                    << ", \"engine\": " << jsonString(r.engine) << ", \"instructions\": " << r.instructions
+                    << ", \"skipped\": " << r.skipped << ", \"frames\": " << r.frames << ", \"seconds\": " << std::setprecision(6) << r.seconds
+                    << ", \"instructions_per_second\": " << std::setprecision(0)
+                    << perSecond(r.instructions, r.seconds) << ", \"ns_per_instruction\": "
+                    << std::setprecision(3) << nsPerInstruction(r) << ", \"skipped_per_second\": "
+                    << std::setprecision(0) << perSecond(r.skipped, r.seconds) << ", \"frames_per_second\": "
+                    << std::setprecision(1) << perSecond(r.frames, r.seconds) << " }";
+            }
+            out << "\n  ]\n}\n";
+        }
+        else
+        {
+            out << std::left << std::setw(12) << "program" << std::setw(6) << "kind" << std::setw(12)
+                << "engine" << std::right << std::setw(16) << "instructions/s" << std::setw(12) << "ns/instr"
+                << std::setw(16) << "skipped/s" << std::setw(14) << "frames/s" << '\n';
+            for (std::size_t i = 0; i < results.size(); ++i)
+            {
+                const Result& r = results[i];
+                out << std::left << std::setw(12) << r.program << std::setw(6) << r.kind << std::setw(12)
+                    << r.engine << std::right << std::setprecision(0) << std::setw(16)
+                    << perSecond(r.instructions, r.seconds) << std::setprecision(3) << std::setw(12)
+                    << nsPerInstruction(r) << std::setprecision(0) << std::setw(16)
+                    << perSecond(r.skipped, r.seconds) << std::setprecision(1) << std::setw(14)
+                    << perSecond(r.frames, r.seconds) << '\n';
+            }
+        }
+    }
+
+    void usage()
+    {
+        std::cout << "Usage: chip8-bench [options] [ROM files]" << std::endl;
+        std::cout << "Options: --clock=N (instructions per second, default 700)" << std::endl;
+        std::cout << "         --time=S (seconds measured per program and engine, default 0.5)" << std::endl;
+        std::cout << "         --engine=NAME (interpreter, predecoded, blocks, jit, native or all, may be repeated, default all)"
+                  << std::endl;
+        std::cout << "         --format=FORMAT (table, csv or json, default table)" << std::endl;
+        std::cout << "         --output=FILE (write the results to FILE instead of standard output)" << std::endl;
+        std::cout << "         --quirks=NAME (cosmac, schip, xochip or default, for all programs)" << std::endl;
+        std::cout << "         --filter=TEXT (only programs with TEXT in their name)" << std::endl;
+        std::cout << "         --batch=N (also run every program on N lanes of a batch)" << std::endl;
+        std::cout << "         --verify (check that the engines agree after --frames frames)" << std::endl;
+        std::cout << "         --profile=FILE (profile every program for --frames frames, written to FILE)"
+                  << std::endl;
+        std::cout << "         --frames=N (frames run for --verify and --profile, default 600)" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { 700, 0.5, "table", "", "", std::vector<CHIP8::Engine>(), 0, false, 600, "",
+                        CHIP8::QUIRKS_DEFAULT };
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 8, "--clock=") == 0)
+            options.clock = std::atoi(argument.c_str() + 8);
+        else if (argument.compare(0, 7, "--time=") == 0)
+            options.seconds = std::atof(argument.c_str() + 7);
+        else if (argument.compare(0, 9, "--engine=") == 0)
+        {
+            if (!parseEngine(argument.substr(9), options.engines))
+            {
+                std::cerr << "Unknown engine " << argument.substr(9) << std::endl;
+                return 2;
+            }
+        }
+        else if (argument.compare(0, 9, "--format=") == 0)
+            options.format = argument.substr(9);
+        else if (argument.compare(0, 9, "--output=") == 0)
+            options.output = argument.substr(9);
+        else if (argument.compare(0, 9, "--quirks=") == 0)
+        {
+            if (!CHIP8::parseQuirks(argument.substr(9), options.quirks))
+            {
+                std::cerr << "Unknown quirk profile " << argument.substr(9) << std::endl;
+                return 2;
+            }
+        }
+        else if (argument.compare(0, 9, "--filter=") == 0)
+            options.filter = argument.substr(9);
+        else if (argument.compare(0, 8, "--batch=") == 0)
+            options.batch = std::atoi(argument.c_str() + 8);
+        else if (argument == "--verify")
+            options.verify = true;
+        else if (argument.compare(0, 9, "--verify=") == 0) // Shorthand for --verify --frames=N.
+        {
+            options.verify = true;
+            options.frames = std::atoi(argument.c_str() + 9);
+        }
+        else if (argument.compare(0, 9, "--frames=") == 0)
+            options.frames = std::atoi(argument.c_str() + 9);
+        else if (argument.compare(0, 10, "--profile=") == 0)
+            options.profile = argument.substr(10);
+        else if (argument == "--help" || argument.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return argument == "--help" ? 0 : 2;
+        }
+        else
+            files.push_back(argument);
+    }
+    if (options.clock < Scheduler::FRAME_RATE)
+    {
+        std::cerr << "The clock has to be at least " << Scheduler::FRAME_RATE << std::endl;
+        return 2;
+    }
+    if (options.engines.empty())
+        parseEngine("all", options.engines);
+    if (!options.profile.empty())
+    {
+        CHIP8 probe;
+        probe.profiling(true);
+        if (!probe.profiling())
+        {
+            std::cerr << "Profiling needs a build with CHIP8_INSTRUMENTATION defined" << std::endl;
+            return 2;
+        }
+    }
+
+    // Everything to run, the built-in programs first.
+    std::vector<Program> programs;
+    std::vector<const char*> kinds;
+    for (std::size_t i = 0; i < MICRO_PROGRAM_COUNT; ++i)
+    {
+        programs.push_back(MICRO_PROGRAMS[i]);
+        kinds.push_back("micro");
+    }
+    for (std::size_t i = 0; i < ROM_PROGRAM_COUNT; ++i)
+    {
+        programs.push_back(ROM_PROGRAMS[i]);
+        kinds.push_back("rom");
+    }
+    std::vector<std::vector<unsigned char> > roms(files.size());
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        MappedFile file;
+        if (!file.open(files[i]))
+        {
+            std::cerr << "Could not read " << files[i] << std::endl;
+            return 2;
+        }
+        roms[i].assign(file.data(), file.data() + file.size());
+        Program program = { files[i].c_str(), files[i].c_str(), roms[i].data(), roms[i].size() };
+        programs.push_back(program);
+        kinds.push_back("file");
+    }
+
+    std::ofstream profiles;
+    if (!options.profile.empty())
+        profiles.open(options.profile);
+
+    std::vector<Result> results;
+    bool agree = true;
+    bool first_profile = true;
+    for (std::size_t i = 0; i < programs.size(); ++i)
+    {
+        if (std::string(programs[i].name).find(options.filter) == std::string::npos)
+            continue;
+        for (std::size_t engine = 0; engine < options.engines.size(); ++engine)
+            results.push_back(measure(programs[i], kinds[i], options.engines[engine], options));
+        Result batch;
+        if (options.batch != 0 && measureBatch(programs[i], kinds[i], options, batch))
+            results.push_back(batch);
+        if (options.verify)
+            agree = verify(programs[i], options) && agree;
+        if (options.verify && options.batch != 0)
+            agree = verifyBatch(programs[i], options) && agree;
+        if (profiles.is_open())
+        {
+            profile(programs[i], options, profiles, first_profile);
+            first_profile = false;
+        }
+    }
+
+    if (profiles.is_open())
+    {
+        if (options.format != "csv")
+            profiles << (first_profile ? "{\n}\n" : "\n}\n");
+        if (!profiles.good())
+        {
+            std::cerr << "Could not write " << options.profile << std::endl;
+            return 2;
+        }
+    }
+
+    if (options.output.empty())
+        writeResults(std::cout, results, options);
+    else
+    {
+        std::ofstream file(options.output);
+        writeResults(file, results, options);
+        if (!file.good())
+        {
+            std::cerr << "Could not write " << options.output << std::endl;
+            return 2;
+        }
+    }
+    return agree ? 0 : 1;
+}
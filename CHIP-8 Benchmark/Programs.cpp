@@ -0,0 +1,172 @@
+#include "Programs.h"
+
+
+namespace
+{
+    // 8XYn arithmetic and logic, all in one loop.
+    const unsigned char ALU[] =
+    {
+        0x60, 0x01, // 200: LD V0, 0x01
+        0x61, 0x03, // 202: LD V1, 0x03
+        0x80, 0x14, // 204: ADD V0, V1
+        0x81, 0x25, // 206: SUB V1, V2
+        0x82, 0x01, // 208: OR V2, V0
+        0x83, 0x12, // 20A: AND V3, V1
+        0x84, 0x03, // 20C: XOR V4, V0
+        0x85, 0x06, // 20E: SHR V5
+        0x86, 0x0E, // 210: SHL V6
+        0x80, 0x17, // 212: SUBN V0, V1
+        0x81, 0x30, // 214: LD V1, V3
+        0x72, 0x01, // 216: ADD V2, 0x01
+        0x12, 0x04  // 218: JP 0x204
+    };
+
+    // DXYN, the font digits drawn across the whole screen.
+    const unsigned char DRAW[] =
+    {
+        0x60, 0x00, // 200: LD V0, 0x00
+        0x61, 0x00, // 202: LD V1, 0x00
+        0x62, 0x00, // 204: LD V2, 0x00
+        0xF2, 0x29, // 206: LD F, V2
+        0xD0, 0x15, // 208: DRW V0, V1, 5
+        0x70, 0x05, // 20A: ADD V0, 0x05
+        0x71, 0x03, // 20C: ADD V1, 0x03
+        0x72, 0x01, // 20E: ADD V2, 0x01
+        0x6F, 0x0F, // 210: LD VF, 0x0F
+        0x82, 0xF2, // 212: AND V2, VF
+        0x12, 0x06  // 214: JP 0x206
+    };
+
+    // FX55, FX65 and FX33 on a buffer that moves through 0x400-0x52F.
+    const unsigned char MEMORY[] =
+    {
+        0x60, 0x00, // 200: LD V0, 0x00
+        0xA4, 0x00, // 202: LD I, 0x400
+        0xF0, 0x1E, // 204: ADD I, V0
+        0xFF, 0x55, // 206: LD [I], VF
+        0xFF, 0x65, // 208: LD VF, [I]
+        0xF3, 0x33, // 20A: LD B, V3
+        0x70, 0x01, // 20C: ADD V0, 0x01
+        0x73, 0x07, // 20E: ADD V3, 0x07
+        0x12, 0x02  // 210: JP 0x202
+    };
+
+    // 3XNN, 4XNN, 5XY0 and 9XY0 skips, jumps, calls and returns.
+    const unsigned char BRANCH[] =
+    {
+        0x60, 0x00, // 200: LD V0, 0x00
+        0x61, 0x00, // 202: LD V1, 0x00
+        0x70, 0x01, // 204: ADD V0, 0x01
+        0x30, 0x80, // 206: SE V0, 0x80
+        0x12, 0x0E, // 208: JP 0x20E
+        0x60, 0x00, // 20A: LD V0, 0x00
+        0x71, 0x01, // 20C: ADD V1, 0x01
+        0x41, 0x00, // 20E: SNE V1, 0x00
+        0x22, 0x20, // 210: CALL 0x220
+        0x50, 0x10, // 212: SE V0, V1
+        0x90, 0x10, // 214: SNE V0, V1
+        0x22, 0x20, // 216: CALL 0x220
+        0x12, 0x04, // 218: JP 0x204
+        0x00, 0x00, // 21A
+        0x00, 0x00, // 21C
+        0x00, 0x00, // 21E
+        0x00, 0xEE  // 220: RET
+    };
+
+    // The usual delay loop: set the delay timer and poll it until it runs out.
+    const unsigned char DELAY[] =
+    {
+        0x60, 0x02, // 200: LD V0, 0x02
+        0xF0, 0x15, // 202: LD DT, V0
+        0xF1, 0x07, // 204: LD V1, DT
+        0x31, 0x00, // 206: SE V1, 0x00
+        0x12, 0x04, // 208: JP 0x204
+        0x72, 0x01, // 20A: ADD V2, 0x01
+        0x12, 0x00  // 20C: JP 0x200
+    };
+
+    // Maze by David Winter (public domain), draws a random maze. Where the original stops on a jump
+    // to itself, which idle detection would skip, this one clears the screen and draws another.
+    const unsigned char MAZE[] =
+    {
+        0xA2, 0x22, 0xC2, 0x01, 0x32, 0x01, 0xA2, 0x1E, 0xD0, 0x14, 0x70, 0x04,
+        0x30, 0x40, 0x12, 0x00, 0x60, 0x00, 0x71, 0x04, 0x31, 0x20, 0x12, 0x00,
+        0x00, 0xE0, 0x61, 0x00, 0x12, 0x00, // 218: CLS, LD V1, 0x00, JP 0x200
+        0x80, 0x40, 0x20, 0x10, 0x20, 0x40, 0x80, 0x10
+    };
+
+    // Draws a counter in decimal once per frame, the way scores are drawn.
+    const unsigned char COUNTER[] =
+    {
+        0x63, 0x00, // 200: LD V3, 0x00
+        0x00, 0xE0, // 202: CLS
+        0xA3, 0x00, // 204: LD I, 0x300
+        0xF3, 0x33, // 206: LD B, V3
+        0xF2, 0x65, // 208: LD V2, [I]
+        0x64, 0x00, // 20A: LD V4, 0x00
+        0x65, 0x00, // 20C: LD V5, 0x00
+        0xF0, 0x29, // 20E: LD F, V0
+        0xD4, 0x55, // 210: DRW V4, V5, 5
+        0x74, 0x05, // 212: ADD V4, 0x05
+        0xF1, 0x29, // 214: LD F, V1
+        0xD4, 0x55, // 216: DRW V4, V5, 5
+        0x74, 0x05, // 218: ADD V4, 0x05
+        0xF2, 0x29, // 21A: LD F, V2
+        0xD4, 0x55, // 21C: DRW V4, V5, 5
+        0x73, 0x01, // 21E: ADD V3, 0x01
+        0x66, 0x01, // 220: LD V6, 0x01
+        0xF6, 0x15, // 222: LD DT, V6
+        0xF6, 0x07, // 224: LD V6, DT
+        0x36, 0x00, // 226: SE V6, 0x00
+        0x12, 0x24, // 228: JP 0x224
+        0x12, 0x02  // 22A: JP 0x202
+    };
+
+    // Random dots bouncing around, mixing CXNN, DXYN, skips and arithmetic every instruction.
+    const unsigned char PARTICLES[] =
+    {
+        0xA2, 0x30, // 200: LD I, 0x230
+        0xC0, 0x3F, // 202: RND V0, 0x3F
+        0xC1, 0x1F, // 204: RND V1, 0x1F
+        0xC2, 0x03, // 206: RND V2, 0x03
+        0x72, 0xFF, // 208: ADD V2, 0xFF
+        0xC3, 0x03, // 20A: RND V3, 0x03
+        0x73, 0xFF, // 20C: ADD V3, 0xFF
+        0xD0, 0x11, // 20E: DRW V0, V1, 1
+        0x80, 0x24, // 210: ADD V0, V2
+        0x81, 0x34, // 212: ADD V1, V3
+        0x64, 0x3F, // 214: LD V4, 0x3F
+        0x80, 0x42, // 216: AND V0, V4
+        0x64, 0x1F, // 218: LD V4, 0x1F
+        0x81, 0x42, // 21A: AND V1, V4
+        0xD0, 0x11, // 21C: DRW V0, V1, 1
+        0x75, 0x01, // 21E: ADD V5, 0x01
+        0x35, 0x00, // 220: SE V5, 0x00
+        0x12, 0x10, // 222: JP 0x210
+        0x12, 0x02, // 224: JP 0x202
+        0x00, 0x00, // 226
+        0x00, 0x00, // 228
+        0x00, 0x00, // 22A
+        0x00, 0x00, // 22C
+        0x00, 0x00, // 22E
+        0x80, 0x00  // 230: sprite, one dot
+    };
+}
+
+const Program MICRO_PROGRAMS[] =
+{
+    { "alu", "8XYn arithmetic and logic", ALU, sizeof(ALU) },
+    { "draw", "DXYN font sprites", DRAW, sizeof(DRAW) },
+    { "memory", "FX55, FX65 and FX33", MEMORY, sizeof(MEMORY) },
+    { "branch", "skips, jumps, calls and returns", BRANCH, sizeof(BRANCH) },
+    { "delay", "delay timer polling", DELAY, sizeof(DELAY) }
+};
+const std::size_t MICRO_PROGRAM_COUNT = sizeof(MICRO_PROGRAMS) / sizeof(MICRO_PROGRAMS[0]);
+
+const Program ROM_PROGRAMS[] =
+{
+    { "maze", "Maze by David Winter", MAZE, sizeof(MAZE) },
+    { "counter", "decimal counter drawn every frame", COUNTER, sizeof(COUNTER) },
+    { "particles", "random dots moving across the screen", PARTICLES, sizeof(PARTICLES) }
+};
+const std::size_t ROM_PROGRAM_COUNT = sizeof(ROM_PROGRAMS) / sizeof(ROM_PROGRAMS[0]);
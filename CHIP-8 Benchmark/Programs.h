@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+
+// A CHIP-8 program built into the benchmark.
+struct Program
+{
+    const char* name;
+    const char* description;
+    const unsigned char* data;
+    std::size_t size;
+};
+
+// Microbenchmarks, each a tight loop over one opcode family.
+extern const Program MICRO_PROGRAMS[];
+extern const std::size_t MICRO_PROGRAM_COUNT;
+
+// Whole programs behaving like games: drawing, random numbers, waiting on the delay timer.
+extern const Program ROM_PROGRAMS[];
+extern const std::size_t ROM_PROGRAM_COUNT;
@@ -0,0 +1,207 @@
+#include "Capture.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Converts a capture written with the frontend's --capture option (see Capture.h) into a sequence
+of PNG files, one per frame, named after the frame's position in the capture. Every image has the
+size of the high resolution screen, low resolution frames are drawn with doubled pixels the way the
+frontend stretches them over the window. The colors are the frontend's.
+*/
+
+namespace
+{
+    const unsigned char PALETTE[4][3] = { { 0, 0, 0 }, { 255, 255, 255 }, { 0xAA, 0xAA, 0xAA }, { 0x55, 0x55, 0x55 } };
+
+    struct Options
+    {
+        std::size_t from;
+        std::size_t count; // 0 for up to the end.
+        unsigned int scale; // Image pixels per high resolution pixel.
+    };
+
+    std::uint32_t crc32(const unsigned char* data, std::size_t size, std::uint32_t crc = 0)
+    {
+        static std::uint32_t table[256];
+        if (table[1] == 0)
+        {
+            for (std::uint32_t i = 0; i < 256; ++i)
+            {
+                std::uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    value = value & 1 ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+                table[i] = value;
+            }
+        }
+        crc = ~crc;
+        for (std::size_t i = 0; i < size; ++i)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void putBig(std::vector<unsigned char>& out, std::uint32_t value)
+    {
+        for (int i = 3; i >= 0; --i)
+            out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+
+    void chunk(std::vector<unsigned char>& png, const char* type, const std::vector<unsigned char>& data)
+    {
+        putBig(png, static_cast<std::uint32_t>(data.size()));
+        std::size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        putBig(png, crc32(&png[start], png.size() - start));
+    }
+
+    // A 2-bit paletted PNG of the frame. The image data is deflated in stored blocks, it is small
+    // enough not to bother compressing.
+    std::vector<unsigned char> encodePNG(const CaptureReader::Frame& frame, unsigned int scale)
+    {
+        CHIP8::FrameView view = frame.view();
+        unsigned int width = 128 * scale;
+        unsigned int height = 64 * scale;
+        unsigned int pixel = view.width == 128 ? scale : 2 * scale; // Image pixels per screen pixel.
+        std::size_t row_size = 1 + (width * 2 + 7) / 8; // With the filter byte.
+
+        std::vector<unsigned char> image(row_size * height, 0); // Filter 0, none.
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            unsigned char* row = &image[y * row_size + 1];
+            unsigned int screen_y = y / pixel;
+            for (unsigned int x = 0; x < width; ++x)
+            {
+                unsigned int screen_x = x / pixel;
+                std::size_t word = screen_y * view.stride + screen_x / 64;
+                unsigned int bit = 63 - screen_x % 64;
+                unsigned int color = (view.planes[0][word] >> bit & 1) | (view.planes[1][word] >> bit & 1) << 1;
+                row[x / 4] |= static_cast<unsigned char>(color << (6 - 2 * (x % 4)));
+            }
+        }
+
+        std::vector<unsigned char> zlib;
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        std::uint32_t a = 1;
+        std::uint32_t b = 0;
+        for (std::size_t i = 0; i < image.size(); ++i)
+        {
+            a = (a + image[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        for (std::size_t start = 0; start < image.size(); start += 65535)
+        {
+            std::size_t length = std::min<std::size_t>(65535, image.size() - start);
+            zlib.push_back(start + length == image.size() ? 1 : 0);
+            zlib.push_back(static_cast<unsigned char>(length));
+            zlib.push_back(static_cast<unsigned char>(length >> 8));
+            zlib.push_back(static_cast<unsigned char>(~length));
+            zlib.push_back(static_cast<unsigned char>(~length >> 8));
+            zlib.insert(zlib.end(), image.begin() + start, image.begin() + start + length);
+        }
+        putBig(zlib, b << 16 | a);
+
+        static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        std::vector<unsigned char> png(SIGNATURE, SIGNATURE + 8);
+        std::vector<unsigned char> header;
+        putBig(header, width);
+        putBig(header, height);
+        header.push_back(2); // Bit depth.
+        header.push_back(3); // Paletted.
+        header.push_back(0); // Deflate.
+        header.push_back(0); // Adaptive filtering.
+        header.push_back(0); // Not interlaced.
+        chunk(png, "IHDR", header);
+        chunk(png, "PLTE", std::vector<unsigned char>(&PALETTE[0][0], &PALETTE[0][0] + sizeof(PALETTE)));
+        chunk(png, "IDAT", zlib);
+        chunk(png, "IEND", std::vector<unsigned char>());
+        return png;
+    }
+
+    void usage()
+    {
+        std::cout << "Usage: chip8-capture [options] CAPTURE [PREFIX]" << std::endl;
+        std::cout << "Writes the frames of CAPTURE to PREFIX000000.png, PREFIX000001.png and so on, PREFIX being"
+                  << std::endl;
+        std::cout << "CAPTURE without its extension and a dash by default." << std::endl;
+        std::cout << "Options: --from=N (first frame, default 0)" << std::endl;
+        std::cout << "         --count=N (number of frames, default up to the end)" << std::endl;
+        std::cout << "         --scale=N (image pixels per high resolution pixel, default 4)" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { 0, 0, 4 };
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 7, "--from=") == 0)
+            options.from = std::strtoul(argument.c_str() + 7, nullptr, 10);
+        else if (argument.compare(0, 8, "--count=") == 0)
+            options.count = std::strtoul(argument.c_str() + 8, nullptr, 10);
+        else if (argument.compare(0, 8, "--scale=") == 0)
+            options.scale = std::atoi(argument.c_str() + 8);
+        else if (argument == "--help" || argument.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return argument == "--help" ? 0 : 2;
+        }
+        else
+            files.push_back(argument);
+    }
+    if (files.empty() || files.size() > 2 || options.scale == 0 || options.scale > 64)
+    {
+        usage();
+        return 2;
+    }
+
+    CaptureReader capture;
+    if (!capture.open(files[0]))
+    {
+        std::cerr << "Could not read " << files[0] << " as a capture" << std::endl;
+        return 2;
+    }
+    std::string prefix = files.size() > 1 ? files[1] : files[0].substr(0, files[0].find_last_of('.')) + "-";
+
+    std::size_t end = capture.size();
+    if (options.count != 0 && options.count < end - std::min(end, options.from))
+        end = options.from + options.count;
+    if (options.from < end && !capture.seek(options.from))
+    {
+        std::cerr << files[0] << " is damaged before frame " << options.from << std::endl;
+        return 1;
+    }
+
+    CaptureReader::Frame frame;
+    std::size_t written = 0;
+    for (std::size_t index = options.from; index < end; ++index)
+    {
+        if (!capture.next(frame))
+        {
+            std::cerr << files[0] << " is damaged at frame " << index << std::endl;
+            return 1;
+        }
+        std::ostringstream name;
+        name << prefix << std::setw(6) << std::setfill('0') << index << ".png";
+        std::vector<unsigned char> png = encodePNG(frame, options.scale);
+        std::ofstream file(name.str(), std::ofstream::binary);
+        file.write(reinterpret_cast<const char*>(png.data()), png.size());
+        if (!file.good())
+        {
+            std::cerr << "Could not write " << name.str() << std::endl;
+            return 2;
+        }
+        ++written;
+    }
+    std::cout << written << " of " << capture.size() << " frames written" << std::endl;
+    return 0;
+}
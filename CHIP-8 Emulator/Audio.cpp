@@ -0,0 +1,59 @@
+#include "Audio.h"
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+    const std::int16_t AMPLITUDE = 4096; // An eighth of full scale, the buzzer is loud enough.
+}
+
+NullAudioSink::NullAudioSink(unsigned int rate): m_rate(rate)
+{
+}
+
+unsigned int NullAudioSink::rate() const
+{
+    return m_rate;
+}
+
+void NullAudioSink::write(const std::int16_t*, std::size_t)
+{
+}
+
+AudioSynth::AudioSynth(void): m_phase(0),
+                              m_remainder(0)
+{
+}
+
+void AudioSynth::frame(const CHIP8& core, AudioSink& sink)
+{
+    // Rates that aren't a multiple of the frame rate carry the fraction over to later frames.
+    m_remainder += sink.rate();
+    unsigned int count = m_remainder / Scheduler::FRAME_RATE;
+    m_remainder %= Scheduler::FRAME_RATE;
+    m_samples.resize(count);
+
+    if (!core.buzzer())
+    {
+        m_phase = 0;
+        std::fill(m_samples.begin(), m_samples.end(), 0);
+    }
+    else
+    {
+        // XO-CHIP plays the pattern at 4000 * 2^((pitch - 64) / 48) bits per second.
+        const unsigned char* pattern = core.audioPattern();
+        double step = 4000.0 * std::pow(2.0, (core.audioPitch() - 64) / 48.0) / sink.rate();
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            unsigned int bit = static_cast<unsigned int>(m_phase) & 127;
+            m_samples[i] = ((pattern[bit >> 3] >> (7 - (bit & 7))) & 1) ? AMPLITUDE : -AMPLITUDE;
+            m_phase += step;
+            if (m_phase >= 128)
+                m_phase -= 128;
+        }
+    }
+    sink.write(m_samples.data(), m_samples.size());
+}
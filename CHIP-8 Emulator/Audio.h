@@ -0,0 +1,45 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Destination of synthesized audio, signed 16-bit mono samples.
+class AudioSink
+{
+public:
+    virtual ~AudioSink(void) {}
+    virtual unsigned int rate() const = 0; // Samples per second.
+    virtual void write(const std::int16_t* samples, std::size_t count) = 0;
+};
+
+// Discards everything, for headless runs and when there is no audio device.
+class NullAudioSink : public AudioSink
+{
+public:
+    explicit NullAudioSink(unsigned int rate = 44100);
+    unsigned int rate() const;
+    void write(const std::int16_t* samples, std::size_t count);
+
+private:
+    unsigned int m_rate;
+};
+
+/* Synthesizes the sound of a CHIP8 core one 60 Hz frame at a time, to be called after each
+emulated frame (see Scheduler::onFrame). While the buzzer sounds, the core's 128-bit audio pattern
+is played in a loop at the core's pitch, which is a square wave for anything but XO-CHIP programs
+that load their own pattern. Otherwise silence is written, so the sink is fed at a steady rate.
+*/
+class AudioSynth
+{
+public:
+    AudioSynth(void);
+
+    void frame(const CHIP8& core, AudioSink& sink);
+
+private:
+    double m_phase; // Position in the pattern, in bits.
+    unsigned int m_remainder; // Samples owed to the next frames, in 1/FRAME_RATE units.
+    std::vector<std::int16_t> m_samples; // One frame of samples, reused.
+};
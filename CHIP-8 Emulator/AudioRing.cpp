@@ -0,0 +1,49 @@
+#include "AudioRing.h"
+
+#include <algorithm>
+
+
+AudioRing::AudioRing(std::size_t capacity): m_head(0),
+                                            m_tail(0)
+{
+    std::size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    m_samples.assign(size, 0);
+    m_mask = size - 1;
+}
+
+std::size_t AudioRing::write(const std::int16_t* samples, std::size_t count)
+{
+    // The indices only grow, their difference is the fill level even once they wrap around.
+    std::size_t head = m_head.load(std::memory_order_relaxed);
+    std::size_t tail = m_tail.load(std::memory_order_acquire);
+    count = std::min(count, m_samples.size() - (head - tail));
+
+    for (std::size_t i = 0; i < count; ++i)
+        m_samples[(head + i) & m_mask] = samples[i];
+    m_head.store(head + count, std::memory_order_release);
+    return count;
+}
+
+std::size_t AudioRing::read(std::int16_t* samples, std::size_t count)
+{
+    std::size_t tail = m_tail.load(std::memory_order_relaxed);
+    std::size_t head = m_head.load(std::memory_order_acquire);
+    count = std::min(count, head - tail);
+
+    for (std::size_t i = 0; i < count; ++i)
+        samples[i] = m_samples[(tail + i) & m_mask];
+    m_tail.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+std::size_t AudioRing::size() const
+{
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+}
+
+std::size_t AudioRing::capacity() const
+{
+    return m_samples.size();
+}
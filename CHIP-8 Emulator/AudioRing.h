@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Lock-free ring of audio samples between exactly one producer thread (the emulation) and one
+consumer thread (the audio callback). Each side only writes its own index, the other one is read
+with acquire ordering, so neither side ever blocks or takes a lock.
+*/
+class AudioRing
+{
+public:
+    explicit AudioRing(std::size_t capacity = 4096); // Rounded up to a power of two.
+
+    // Producer side. Returns the number of samples written, samples that don't fit are dropped.
+    std::size_t write(const std::int16_t* samples, std::size_t count);
+    // Consumer side. Returns the number of samples read, at most count.
+    std::size_t read(std::int16_t* samples, std::size_t count);
+
+    std::size_t size() const; // Samples waiting to be read.
+    std::size_t capacity() const;
+
+private:
+    AudioRing(const AudioRing&); // Not copyable.
+    AudioRing& operator=(const AudioRing&);
+
+    std::vector<std::int16_t> m_samples;
+    std::size_t m_mask; // m_samples.size() - 1.
+    std::atomic<std::size_t> m_head; // Samples written so far, only changed by the producer.
+    std::atomic<std::size_t> m_tail; // Samples read so far, only changed by the consumer.
+};
@@ -0,0 +1,928 @@
+#include "Batch.h"
+#include "Quirks.h"
+#include "SaveStateFormat.h"
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BATCH_SSE2
+#endif
+
+
+namespace
+{
+    const unsigned int MEMORY_SIZE = 0x1000;
+    const unsigned int ROWS = 32; // Low resolution.
+    const unsigned int STRIDE_ALIGNMENT = 32; // Lanes per vector of the widest kernels.
+    const unsigned int REGROUP_INTERVAL = 32; // Cycles between checks for a better group.
+
+    // Byte vectors of VECTOR_LANES lanes, compare results are 0xFF or 0 per lane.
+#if defined(__AVX2__)
+    typedef __m256i Vector;
+    const unsigned int VECTOR_LANES = 32;
+
+    inline Vector load(const unsigned char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    inline void store(unsigned char* p, Vector v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+    inline Vector splat(unsigned char value) { return _mm256_set1_epi8(static_cast<char>(value)); }
+    inline Vector vand(Vector a, Vector b) { return _mm256_and_si256(a, b); }
+    inline Vector vandnot(Vector a, Vector b) { return _mm256_andnot_si256(a, b); } // ~a & b
+    inline Vector vor(Vector a, Vector b) { return _mm256_or_si256(a, b); }
+    inline Vector vxor(Vector a, Vector b) { return _mm256_xor_si256(a, b); }
+    inline Vector add(Vector a, Vector b) { return _mm256_add_epi8(a, b); }
+    inline Vector sub(Vector a, Vector b) { return _mm256_sub_epi8(a, b); }
+    inline Vector minimum(Vector a, Vector b) { return _mm256_min_epu8(a, b); }
+    inline Vector equal(Vector a, Vector b) { return _mm256_cmpeq_epi8(a, b); }
+    inline Vector decrement(Vector a) { return _mm256_subs_epu8(a, splat(1)); } // Stops at 0.
+    inline Vector shiftRight(Vector a, int bits) { return vand(_mm256_srli_epi16(a, bits), splat(0xFF >> bits)); }
+    inline unsigned int lanesSet(Vector mask) { return static_cast<unsigned int>(_mm256_movemask_epi8(mask)); }
+#elif defined(BATCH_SSE2)
+    typedef __m128i Vector;
+    const unsigned int VECTOR_LANES = 16;
+
+    inline Vector load(const unsigned char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    inline void store(unsigned char* p, Vector v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+    inline Vector splat(unsigned char value) { return _mm_set1_epi8(static_cast<char>(value)); }
+    inline Vector vand(Vector a, Vector b) { return _mm_and_si128(a, b); }
+    inline Vector vandnot(Vector a, Vector b) { return _mm_andnot_si128(a, b); } // ~a & b
+    inline Vector vor(Vector a, Vector b) { return _mm_or_si128(a, b); }
+    inline Vector vxor(Vector a, Vector b) { return _mm_xor_si128(a, b); }
+    inline Vector add(Vector a, Vector b) { return _mm_add_epi8(a, b); }
+    inline Vector sub(Vector a, Vector b) { return _mm_sub_epi8(a, b); }
+    inline Vector minimum(Vector a, Vector b) { return _mm_min_epu8(a, b); }
+    inline Vector equal(Vector a, Vector b) { return _mm_cmpeq_epi8(a, b); }
+    inline Vector decrement(Vector a) { return _mm_subs_epu8(a, splat(1)); } // Stops at 0.
+    inline Vector shiftRight(Vector a, int bits) { return vand(_mm_srli_epi16(a, bits), splat(0xFF >> bits)); }
+    inline unsigned int lanesSet(Vector mask) { return static_cast<unsigned int>(_mm_movemask_epi8(mask)); }
+#else
+    // Plain loops for targets without SSE2, which compilers may still vectorize.
+    const unsigned int VECTOR_LANES = 16;
+    struct Vector
+    {
+        unsigned char lane[VECTOR_LANES];
+    };
+
+    template<class Operation>
+    inline Vector map(Vector a, Vector b, Operation operation)
+    {
+        Vector result;
+        for (unsigned int i = 0; i < VECTOR_LANES; ++i)
+            result.lane[i] = static_cast<unsigned char>(operation(a.lane[i], b.lane[i]));
+        return result;
+    }
+
+    inline Vector load(const unsigned char* p) { Vector v; std::copy(p, p + VECTOR_LANES, v.lane); return v; }
+    inline void store(unsigned char* p, Vector v) { std::copy(v.lane, v.lane + VECTOR_LANES, p); }
+    inline Vector splat(unsigned char value) { Vector v; std::fill(v.lane, v.lane + VECTOR_LANES, value); return v; }
+    inline Vector vand(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return x & y; }); }
+    inline Vector vandnot(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return ~x & y; }); }
+    inline Vector vor(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return x | y; }); }
+    inline Vector vxor(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return x ^ y; }); }
+    inline Vector add(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return x + y; }); }
+    inline Vector sub(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return x - y; }); }
+    inline Vector minimum(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return std::min(x, y); }); }
+    inline Vector equal(Vector a, Vector b) { return map(a, b, [](unsigned char x, unsigned char y) { return x == y ? 0xFF : 0; }); }
+    inline Vector decrement(Vector a) { return map(a, a, [](unsigned char x, unsigned char) { return x > 0 ? x - 1 : 0; }); }
+    inline Vector shiftRight(Vector a, int bits) { return map(a, a, [bits](unsigned char x, unsigned char) { return x >> bits; }); }
+    inline unsigned int lanesSet(Vector mask)
+    {
+        unsigned int bits = 0;
+        for (unsigned int i = 0; i < VECTOR_LANES; ++i)
+            bits |= (mask.lane[i] >> 7) << i;
+        return bits;
+    }
+#endif
+
+    // Lanes of a where mask is set, of b elsewhere.
+    inline Vector select(Vector mask, Vector a, Vector b)
+    {
+        return vor(vand(mask, a), vandnot(mask, b));
+    }
+
+    inline Vector shiftLeft(Vector a)
+    {
+        return add(a, a);
+    }
+
+    inline unsigned int count(unsigned int bits)
+    {
+        unsigned int n = 0;
+        for (; bits != 0; bits &= bits - 1)
+            ++n;
+        return n;
+    }
+}
+
+Batch::Batch(unsigned int lanes, unsigned int clock): m_lanes(lanes),
+                                                      m_stride((lanes + STRIDE_ALIGNMENT - 1) / STRIDE_ALIGNMENT * STRIDE_ALIGNMENT),
+                                                      m_clock(clock),
+                                                      m_remainder(0),
+                                                      m_quirks(CHIP8::QUIRKS_DEFAULT),
+                                                      m_V(16 * m_stride),
+                                                      m_I(m_stride),
+                                                      m_pc(m_stride),
+                                                      m_sp(m_stride),
+                                                      m_stack(16 * m_stride),
+                                                      m_delay_timer(m_stride),
+                                                      m_sound_timer(m_stride),
+                                                      m_keys(m_stride),
+                                                      m_draw_flag(m_stride),
+                                                      m_random(lanes),
+                                                      m_memory(lanes * MEMORY_SIZE),
+                                                      m_gfx(lanes * ROWS),
+                                                      m_private(MEMORY_SIZE),
+                                                      m_in_group(m_stride),
+                                                      m_stopped(m_stride, 0xFF),
+                                                      m_taken(m_stride),
+                                                      m_stopped_at(lanes),
+                                                      m_group_pc(0x200),
+                                                      m_group_size(0),
+                                                      m_running(0),
+                                                      m_pitch(64),
+                                                      m_cycles(0),
+                                                      m_lockstep_cycles(0),
+                                                      m_diverged_cycles(0)
+{
+    m_flags.fill(0);
+    m_pattern.fill(0);
+}
+
+bool Batch::start(const CHIP8& core, std::uint64_t seed)
+{
+    if (m_lanes == 0 || core.quirks() == CHIP8::QUIRKS_XOCHIP)
+        return false;
+    std::vector<unsigned char> state;
+    core.saveState(state);
+    CHIP8::Quirks quirks = m_quirks; // loadState() takes states of the batch's profile.
+    m_quirks = core.quirks();
+    if (!loadState(state.data(), state.size()))
+    {
+        m_quirks = quirks;
+        return false;
+    }
+
+    // Lane 0 got the state, copy it to the others.
+    for (unsigned int lane = 1; lane < m_lanes; ++lane)
+    {
+        for (unsigned int i = 0; i < 16; ++i)
+        {
+            m_V[i * m_stride + lane] = m_V[i * m_stride];
+            m_stack[i * m_stride + lane] = m_stack[i * m_stride];
+        }
+        m_I[lane] = m_I[0];
+        m_pc[lane] = m_pc[0];
+        m_sp[lane] = m_sp[0];
+        m_delay_timer[lane] = m_delay_timer[0];
+        m_sound_timer[lane] = m_sound_timer[0];
+        m_keys[lane] = m_keys[0];
+        m_draw_flag[lane] = m_draw_flag[0];
+        std::copy(m_memory.begin(), m_memory.begin() + MEMORY_SIZE, m_memory.begin() + lane * MEMORY_SIZE);
+        std::copy(m_gfx.begin(), m_gfx.begin() + ROWS, m_gfx.begin() + lane * ROWS);
+    }
+    for (unsigned int lane = 0; lane < m_lanes; ++lane)
+        m_random[lane].seed(seed + lane);
+
+    std::fill(m_in_group.begin(), m_in_group.begin() + m_lanes, 0xFF);
+    std::fill(m_stopped.begin(), m_stopped.begin() + m_lanes, 0);
+    std::fill(m_private.begin(), m_private.end(), false);
+    m_group_pc = m_pc[0];
+    m_group_size = m_lanes;
+    m_running = m_lanes;
+    m_remainder = 0;
+    m_lockstep_cycles = 0;
+    m_diverged_cycles = 0;
+    return true;
+}
+
+unsigned int Batch::lanes() const
+{
+    return m_lanes;
+}
+
+unsigned int Batch::clock() const
+{
+    return m_clock;
+}
+
+void Batch::clock(unsigned int clock)
+{
+    m_clock = clock;
+}
+
+unsigned int Batch::runFrame()
+{
+    // Same pacing as Scheduler::runFrame, so lanes match machines run by a Scheduler.
+    m_remainder += m_clock;
+    unsigned int cycles = m_remainder / Scheduler::FRAME_RATE;
+    m_remainder %= Scheduler::FRAME_RATE;
+
+    emulate(cycles);
+    updateTimers();
+    return cycles;
+}
+
+void Batch::emulate(unsigned int cycles)
+{
+    switch (m_quirks)
+    {
+        case CHIP8::QUIRKS_COSMAC: run<CosmacQuirks>(cycles); break;
+        case CHIP8::QUIRKS_SCHIP: run<SchipQuirks>(cycles); break;
+        default: run<DefaultQuirks>(cycles); break;
+    }
+}
+
+void Batch::updateTimers()
+{
+    // Stopped lanes keep the timers they stopped with.
+    for (unsigned int i = 0; i < m_stride; i += VECTOR_LANES)
+    {
+        Vector stopped = load(&m_stopped[i]);
+        Vector delay = load(&m_delay_timer[i]);
+        Vector sound = load(&m_sound_timer[i]);
+        store(&m_delay_timer[i], select(stopped, delay, decrement(delay)));
+        store(&m_sound_timer[i], select(stopped, sound, decrement(sound)));
+    }
+}
+
+void Batch::setKeys(unsigned int lane, unsigned short key, bool state)
+{
+    if (state)
+        m_keys[lane] |= 1 << key;
+    else
+        m_keys[lane] &= ~(1 << key);
+}
+
+bool Batch::stopped(unsigned int lane) const
+{
+    return m_stopped[lane] != 0;
+}
+
+const std::uint64_t* Batch::screen(unsigned int lane) const
+{
+    return &m_gfx[lane * ROWS];
+}
+
+unsigned long long Batch::lockstepCycles() const
+{
+    return m_lockstep_cycles;
+}
+
+unsigned long long Batch::divergedCycles() const
+{
+    return m_diverged_cycles;
+}
+
+template<class Q>
+void Batch::run(unsigned int cycles)
+{
+    for (unsigned int cycle = 0; cycle < cycles; ++cycle, ++m_cycles)
+    {
+        if (m_running == 0)
+        {
+            m_cycles += cycles - cycle;
+            return;
+        }
+        if (m_group_size == 0 || (m_cycles % REGROUP_INTERVAL == 0 && m_group_size * 2 < m_running))
+            regroup();
+
+        // The group's instruction. Lanes that wrote over it have their own, they leave first.
+        bool shared = sharedCode(m_group_pc);
+        unsigned short opcode = 0;
+        if (m_group_size != 0)
+        {
+            unsigned int first = 0;
+            while (m_in_group[first] == 0)
+                ++first;
+            m_pc[first] = m_group_pc;
+            opcode = this->opcode(first);
+            if (!shared)
+            {
+                for (unsigned int lane = first + 1; lane < m_lanes; ++lane)
+                {
+                    if (m_in_group[lane] == 0)
+                        continue;
+                    m_pc[lane] = m_group_pc;
+                    if (this->opcode(lane) != opcode)
+                        leave(lane, m_group_pc);
+                }
+            }
+        }
+
+        // Lanes outside the group step on their own, or join it where it is about to execute
+        // the same instruction.
+        if (m_group_size < m_running)
+        {
+            for (unsigned int lane = 0; lane < m_lanes; ++lane)
+            {
+                if (m_in_group[lane] != 0 || m_stopped[lane] != 0)
+                    continue;
+                if (m_group_size != 0 && m_pc[lane] == m_group_pc && (shared || this->opcode(lane) == opcode))
+                {
+                    m_in_group[lane] = 0xFF;
+                    ++m_group_size;
+                    continue;
+                }
+                stepLane<Q>(lane, this->opcode(lane));
+                ++m_diverged_cycles;
+            }
+        }
+
+        if (m_group_size != 0)
+        {
+            m_lockstep_cycles += m_group_size;
+            stepGroup<Q>(opcode);
+        }
+    }
+}
+
+template<class Q>
+void Batch::stepGroup(unsigned short opcode)
+{
+    unsigned int x = (opcode & 0x0F00) >> 8;
+    unsigned int y = (opcode & 0x00F0) >> 4;
+    unsigned char nn = opcode & 0x00FF;
+    unsigned char* vx = &m_V[x * m_stride];
+    const unsigned char* vy = &m_V[y * m_stride];
+    unsigned char* vf = &m_V[0xF * m_stride];
+
+    // Registers are assigned in the order CHIP8 does, VX or VY may be VF.
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+            m_group_pc = opcode & 0x0FFF;
+            return;
+        case 0x3000:
+            skipGroup([&](unsigned int i) { return equal(load(vx + i), splat(nn)); });
+            return;
+        case 0x4000:
+            skipGroup([&](unsigned int i) { return vxor(equal(load(vx + i), splat(nn)), splat(0xFF)); });
+            return;
+        case 0x5000:
+            if ((opcode & 0x000F) != 0x0)
+                break;
+            skipGroup([&](unsigned int i) { return equal(load(vx + i), load(vy + i)); });
+            return;
+        case 0x6000:
+            assignGroup(vx, [&](unsigned int) { return splat(nn); });
+            m_group_pc += 2;
+            return;
+        case 0x7000:
+            assignGroup(vx, [&](unsigned int i) { return add(load(vx + i), splat(nn)); });
+            m_group_pc += 2;
+            return;
+        case 0x8000:
+        {
+            switch (opcode & 0x000F)
+            {
+                case 0x0: assignGroup(vx, [&](unsigned int i) { return load(vy + i); }); break;
+                case 0x1: assignGroup(vx, [&](unsigned int i) { return vor(load(vx + i), load(vy + i)); }); break;
+                case 0x2: assignGroup(vx, [&](unsigned int i) { return vand(load(vx + i), load(vy + i)); }); break;
+                case 0x3: assignGroup(vx, [&](unsigned int i) { return vxor(load(vx + i), load(vy + i)); }); break;
+                case 0x4:
+                    // Carry when VY > ~VX.
+                    assignGroup(vf, [&](unsigned int i)
+                    {
+                        Vector b = load(vy + i);
+                        return vandnot(equal(minimum(b, vxor(load(vx + i), splat(0xFF))), b), splat(1));
+                    });
+                    assignGroup(vx, [&](unsigned int i) { return add(load(vx + i), load(vy + i)); });
+                    break;
+                case 0x5:
+                    // No borrow when VX >= VY.
+                    assignGroup(vf, [&](unsigned int i)
+                    {
+                        Vector b = load(vy + i);
+                        return vand(equal(minimum(load(vx + i), b), b), splat(1));
+                    });
+                    assignGroup(vx, [&](unsigned int i) { return sub(load(vx + i), load(vy + i)); });
+                    break;
+                case 0x7:
+                    // No borrow when VY >= VX.
+                    assignGroup(vf, [&](unsigned int i)
+                    {
+                        Vector a = load(vx + i);
+                        return vand(equal(minimum(a, load(vy + i)), a), splat(1));
+                    });
+                    assignGroup(vx, [&](unsigned int i) { return sub(load(vy + i), load(vx + i)); });
+                    break;
+                case 0x6:
+                case 0xE:
+                {
+                    bool right = (opcode & 0x000F) == 0x6;
+                    const unsigned char* source = Q::SHIFT_VY ? vy : vx;
+                    for (unsigned int i = 0; i < m_stride; i += VECTOR_LANES)
+                    {
+                        // In place, VF is set before VX is read again for the shift.
+                        Vector group = load(&m_in_group[i]);
+                        Vector value = load(source + i);
+                        Vector out = right ? vand(value, splat(1)) : shiftRight(value, 7);
+                        if (!Q::SHIFT_VY)
+                        {
+                            store(vf + i, select(group, out, load(vf + i)));
+                            value = load(vx + i);
+                        }
+                        Vector shifted = right ? shiftRight(value, 1) : shiftLeft(value);
+                        store(vx + i, select(group, shifted, load(vx + i)));
+                        if (Q::SHIFT_VY)
+                            store(vf + i, select(group, out, load(vf + i)));
+                    }
+                    break;
+                }
+                default:
+                    break; // Unknown, does nothing.
+            }
+            m_group_pc += 2;
+            return;
+        }
+        case 0x9000:
+            if ((opcode & 0x000F) != 0x0)
+                break;
+            skipGroup([&](unsigned int i) { return vxor(equal(load(vx + i), load(vy + i)), splat(0xFF)); });
+            return;
+        case 0xA000:
+            for (unsigned int lane = 0; lane < m_lanes; ++lane)
+            {
+                if (m_in_group[lane] != 0)
+                    m_I[lane] = opcode & 0x0FFF;
+            }
+            m_group_pc += 2;
+            return;
+        case 0xF000:
+        {
+            unsigned char* timer = nullptr;
+            switch (nn)
+            {
+                case 0x07:
+                    assignGroup(vx, [&](unsigned int i) { return load(&m_delay_timer[i]); });
+                    m_group_pc += 2;
+                    return;
+                case 0x15: timer = m_delay_timer.data(); break;
+                case 0x18: timer = m_sound_timer.data(); break;
+            }
+            if (timer == nullptr)
+                break;
+            assignGroup(timer, [&](unsigned int i) { return load(vx + i); });
+            m_group_pc += 2;
+            return;
+        }
+    }
+
+    // Everything else runs lane by lane. The group goes on with its first lane, lanes that went
+    // elsewhere leave.
+    unsigned int first = m_lanes;
+    for (unsigned int lane = 0; lane < m_lanes; ++lane)
+    {
+        if (m_in_group[lane] == 0)
+            continue;
+        m_pc[lane] = m_group_pc;
+        stepLane<Q>(lane, opcode);
+        if (m_in_group[lane] == 0) // Stopped.
+            continue;
+        if (first == m_lanes)
+            first = lane;
+        else if (m_pc[lane] != m_pc[first])
+            leave(lane, m_pc[lane]);
+    }
+    if (first != m_lanes)
+        m_group_pc = m_pc[first];
+}
+
+template<class Condition>
+void Batch::skipGroup(Condition condition)
+{
+    unsigned int skipping = 0;
+    for (unsigned int i = 0; i < m_stride; i += VECTOR_LANES)
+    {
+        Vector taken = vand(condition(i), load(&m_in_group[i]));
+        store(&m_taken[i], taken);
+        skipping += count(lanesSet(taken));
+    }
+
+    // The group goes the way most of its lanes go, the others leave.
+    bool skip = skipping * 2 > m_group_size;
+    unsigned short next = m_group_pc + 2;
+    if (skipping != 0 && skipping != m_group_size)
+    {
+        for (unsigned int lane = 0; lane < m_lanes; ++lane)
+        {
+            if (m_in_group[lane] != 0 && (m_taken[lane] != 0) != skip)
+                leave(lane, m_taken[lane] != 0 ? next + 2 : next);
+        }
+    }
+    m_group_pc = skip ? next + 2 : next;
+}
+
+template<class Value>
+void Batch::assignGroup(unsigned char* target, Value value)
+{
+    for (unsigned int i = 0; i < m_stride; i += VECTOR_LANES)
+        store(target + i, select(load(&m_in_group[i]), value(i), load(target + i)));
+}
+
+template<class Q>
+void Batch::stepLane(unsigned int lane, unsigned short opcode)
+{
+    unsigned int x = (opcode & 0x0F00) >> 8;
+    unsigned int y = (opcode & 0x00F0) >> 4;
+    unsigned int n = opcode & 0x000F;
+    unsigned char nn = opcode & 0x00FF;
+    unsigned short nnn = opcode & 0x0FFF;
+
+    unsigned char* V = &m_V[lane];
+    unsigned char& vx = V[x * m_stride];
+    unsigned char& vy = V[y * m_stride];
+    unsigned char& vf = V[0xF * m_stride];
+    unsigned short& pc = m_pc[lane];
+    unsigned short& I = m_I[lane];
+    unsigned char* memory = &m_memory[lane * MEMORY_SIZE];
+    std::uint64_t* gfx = &m_gfx[lane * ROWS];
+    bool skip = false;
+
+    pc += 2;
+    switch (opcode & 0xF000)
+    {
+        case 0x0000:
+        {
+            if (opcode == 0x00E0)
+            {
+                std::fill(gfx, gfx + ROWS, 0);
+                m_draw_flag[lane] = 1;
+            }
+            else if (opcode == 0x00EE)
+            {
+                pc = m_stack[(m_sp[lane] & 0xF) * m_stride + lane];
+                --m_sp[lane];
+            }
+            else if (opcode == 0x00FD && Q::SCHIP_OPCODES)
+                pc -= 2;
+            else if ((Q::SCHIP_OPCODES && (opcode & 0xFFF0) == 0x00C0) ||
+                     (Q::SCHIP_OPCODES && opcode >= 0x00FB && opcode <= 0x00FF) ||
+                     (Q::XOCHIP_OPCODES && (opcode & 0xFFF0) == 0x00D0))
+            {
+                // Scrolling and resolution switches.
+                pc -= 2;
+                stop(lane);
+            }
+            break; // 0NNN does nothing.
+        }
+        case 0x1000: pc = nnn; break;
+        case 0x2000:
+            ++m_sp[lane];
+            m_stack[(m_sp[lane] & 0xF) * m_stride + lane] = pc;
+            pc = nnn;
+            break;
+        case 0x3000: skip = vx == nn; break;
+        case 0x4000: skip = vx != nn; break;
+        case 0x5000:
+            if (n == 0x0)
+                skip = vx == vy;
+            else if (Q::XOCHIP_OPCODES && (n == 0x2 || n == 0x3))
+            {
+                pc -= 2;
+                stop(lane);
+            }
+            break;
+        case 0x6000: vx = nn; break;
+        case 0x7000: vx += nn; break;
+        case 0x8000:
+        {
+            switch (n)
+            {
+                case 0x0: vx = vy; break;
+                case 0x1: vx |= vy; break;
+                case 0x2: vx &= vy; break;
+                case 0x3: vx ^= vy; break;
+                case 0x4:
+                    vf = vy > 0xFF - vx;
+                    vx += vy;
+                    break;
+                case 0x5:
+                    vf = vx >= vy;
+                    vx -= vy;
+                    break;
+                case 0x7:
+                    vf = vx <= vy;
+                    vx = vy - vx;
+                    break;
+                case 0x6:
+                case 0xE:
+                {
+                    unsigned char value = Q::SHIFT_VY ? vy : vx;
+                    unsigned char out = n == 0x6 ? value & 0x01 : value >> 7;
+                    if (!Q::SHIFT_VY)
+                    {
+                        vf = out;
+                        value = vx; // VX may be VF.
+                    }
+                    vx = n == 0x6 ? value >> 1 : static_cast<unsigned char>(value << 1);
+                    if (Q::SHIFT_VY)
+                        vf = out;
+                    break;
+                }
+            }
+            break;
+        }
+        case 0x9000:
+            if (n == 0x0)
+                skip = vx != vy;
+            break;
+        case 0xA000: I = nnn; break;
+        case 0xB000: pc = nnn + V[(Q::JUMP_VX ? x : 0x0) * m_stride]; break;
+        case 0xC000: vx = m_random[lane].byte() & nn; break;
+        case 0xD000:
+        {
+            if (n == 0 && Q::SCHIP_OPCODES)
+            {
+                // 16x16 sprites.
+                pc -= 2;
+                stop(lane);
+                break;
+            }
+
+            // CHIP8::opDRW for one plane in low resolution.
+            unsigned int x_coordinate = vx & 63;
+            unsigned int y_coordinate = vy & (ROWS - 1);
+            unsigned int visible = n;
+            if (!Q::DRAW_WRAP && visible > ROWS - y_coordinate)
+                visible = ROWS - y_coordinate;
+            bool spill = x_coordinate != 0 && Q::DRAW_WRAP;
+
+            std::uint64_t collision = 0;
+            for (unsigned int row = 0; row < visible; ++row)
+            {
+                std::uint64_t sprite = static_cast<std::uint64_t>(memory[(I + row) & 0xFFF]) << 56;
+                std::uint64_t& screen_row = gfx[(y_coordinate + row) & (ROWS - 1)];
+                std::uint64_t sprite_row = sprite >> x_coordinate;
+                collision |= screen_row & sprite_row;
+                screen_row ^= sprite_row;
+                if (spill)
+                {
+                    std::uint64_t rest = sprite << (64 - x_coordinate);
+                    collision |= screen_row & rest;
+                    screen_row ^= rest;
+                }
+            }
+            vf = collision != 0;
+            m_draw_flag[lane] = 1;
+            break;
+        }
+        case 0xE000:
+        {
+            bool pressed = (m_keys[lane] >> (vx & 0xF)) & 1;
+            if (nn == 0x9E)
+                skip = pressed;
+            else if (nn == 0xA1)
+                skip = !pressed;
+            break;
+        }
+        case 0xF000:
+        {
+            switch (nn)
+            {
+                case 0x07: vx = m_delay_timer[lane]; break;
+                case 0x0A:
+                {
+                    unsigned short keys = m_keys[lane];
+                    if (keys == 0)
+                    {
+                        pc -= 2;
+                        break;
+                    }
+                    unsigned char key = 0;
+                    while (((keys >> key) & 1) == 0)
+                        ++key;
+                    vx = key;
+                    break;
+                }
+                case 0x15: m_delay_timer[lane] = vx; break;
+                case 0x18: m_sound_timer[lane] = vx; break;
+                case 0x1E:
+                    if (Q::ADD_I_CARRY)
+                        vf = I + vx > 0xFFF;
+                    I += vx;
+                    break;
+                case 0x29: I = vx * 5; break;
+                case 0x30:
+                    if (Q::SCHIP_OPCODES)
+                        I = 0x50 + (vx & 0xF) * 10;
+                    break;
+                case 0x33:
+                {
+                    unsigned char value = vx;
+                    for (int i = 0; i < 3; ++i)
+                        written(I + i);
+                    memory[I & 0xFFF] = value / 100;
+                    memory[(I + 1) & 0xFFF] = (value % 100) / 10;
+                    memory[(I + 2) & 0xFFF] = value % 10;
+                    break;
+                }
+                case 0x55:
+                    for (unsigned int i = 0; i <= x; ++i)
+                    {
+                        written(I + i);
+                        memory[(I + i) & 0xFFF] = V[i * m_stride];
+                    }
+                    if (Q::INCREMENT_I)
+                        I += x + 1;
+                    break;
+                case 0x65:
+                    for (unsigned int i = 0; i <= x; ++i)
+                        V[i * m_stride] = memory[(I + i) & 0xFFF];
+                    if (Q::INCREMENT_I)
+                        I += x + 1;
+                    break;
+                case 0x00:
+                case 0x02:
+                    // F000 NNNN and F002.
+                    if (x == 0x0 && Q::XOCHIP_OPCODES)
+                    {
+                        pc -= 2;
+                        stop(lane);
+                    }
+                    break;
+                case 0x01:
+                case 0x3A:
+                case 0x75:
+                case 0x85:
+                    // Planes, audio and the RPL user flags, which lanes share.
+                    if (nn == 0x75 || nn == 0x85 ? Q::SCHIP_OPCODES : Q::XOCHIP_OPCODES)
+                    {
+                        pc -= 2;
+                        stop(lane);
+                    }
+                    break;
+            }
+            break;
+        }
+    }
+    if (skip)
+        pc += 2;
+}
+
+unsigned short Batch::opcode(unsigned int lane) const
+{
+    const unsigned char* memory = &m_memory[lane * MEMORY_SIZE];
+    unsigned short pc = m_pc[lane];
+    return memory[pc & 0xFFF] << 8 | memory[(pc + 1) & 0xFFF];
+}
+
+bool Batch::sharedCode(unsigned short address) const
+{
+    return !m_private[address & 0xFFF] && !m_private[(address + 1) & 0xFFF];
+}
+
+void Batch::written(unsigned short address)
+{
+    m_private[address & 0xFFF] = true;
+}
+
+void Batch::leave(unsigned int lane, unsigned short pc)
+{
+    m_pc[lane] = pc;
+    m_in_group[lane] = 0;
+    --m_group_size;
+}
+
+void Batch::stop(unsigned int lane)
+{
+    if (m_in_group[lane] != 0)
+        leave(lane, m_pc[lane]);
+    m_stopped[lane] = 0xFF;
+    m_stopped_at[lane] = m_cycles;
+    --m_running;
+}
+
+void Batch::regroup()
+{
+    // The most common address among the running lanes.
+    m_addresses.clear();
+    for (unsigned int lane = 0; lane < m_lanes; ++lane)
+    {
+        if (m_stopped[lane] == 0)
+            m_addresses.push_back(m_in_group[lane] != 0 ? m_group_pc : m_pc[lane]);
+    }
+    std::sort(m_addresses.begin(), m_addresses.end());
+    unsigned short best = m_group_pc;
+    unsigned int best_count = m_group_size;
+    for (std::size_t i = 0, j; i < m_addresses.size(); i = j)
+    {
+        for (j = i + 1; j < m_addresses.size() && m_addresses[j] == m_addresses[i]; ++j)
+        {
+        }
+        if (j - i > best_count)
+        {
+            best = m_addresses[i];
+            best_count = static_cast<unsigned int>(j - i);
+        }
+    }
+    if (best_count == m_group_size)
+        return;
+
+    for (unsigned int lane = 0; lane < m_lanes; ++lane)
+    {
+        if (m_stopped[lane] != 0)
+            continue;
+        if (m_in_group[lane] != 0)
+            m_pc[lane] = m_group_pc;
+        m_in_group[lane] = m_pc[lane] == best ? 0xFF : 0;
+    }
+    m_group_pc = best;
+    m_group_size = best_count;
+}
+
+void Batch::saveState(unsigned int lane, std::vector<unsigned char>& state) const
+{
+    using namespace SaveStateFormat;
+
+    // A low resolution machine with plane 0 selected and the rest of the screen blank.
+    const std::size_t memory_size = MEMORY_SIZE;
+    state.clear();
+    state.reserve(STATE_SIZE + memory_size);
+    state.insert(state.end(), MAGIC, MAGIC + 4);
+    put(state, VERSION, 2);
+    put(state, m_quirks, 1);
+    put(state, memory_size, 4);
+    state.insert(state.end(), m_memory.begin() + lane * memory_size, m_memory.begin() + (lane + 1) * memory_size);
+    for (unsigned int i = 0; i < 16; ++i)
+        put(state, m_V[i * m_stride + lane], 1);
+    put(state, m_I[lane], 2);
+    put(state, m_in_group[lane] != 0 ? m_group_pc : m_pc[lane], 2);
+    put(state, m_sp[lane], 2);
+    for (unsigned int i = 0; i < 16; ++i)
+        put(state, m_stack[i * m_stride + lane], 2);
+    put(state, m_delay_timer[lane], 1);
+    put(state, m_sound_timer[lane], 1);
+    put(state, m_keys[lane], 2);
+    put(state, m_draw_flag[lane], 1);
+    put(state, 0, 1); // Low resolution.
+    put(state, 1, 1); // Plane 0.
+    state.insert(state.end(), m_flags.begin(), m_flags.end());
+    state.insert(state.end(), m_pattern.begin(), m_pattern.end());
+    put(state, m_pitch, 1);
+    const std::uint64_t* screen = this->screen(lane);
+    for (unsigned int i = 0; i < SCREEN_WORDS; ++i)
+        put(state, i < 64 && i % 2 == 0 ? screen[i / 2] : 0, 8);
+    put(state, m_random[lane].state(), 8);
+    put(state, m_stopped[lane] != 0 ? m_stopped_at[lane] : m_cycles, 8);
+}
+
+bool Batch::loadState(const unsigned char* state, std::size_t size)
+{
+    using namespace SaveStateFormat;
+
+    // Only states of low resolution machines drawing on plane 0, with 4 KB of memory and the
+    // batch's quirk profile.
+    const std::size_t memory_size = MEMORY_SIZE;
+    if (size != STATE_SIZE + memory_size || std::memcmp(state, MAGIC, 4) != 0)
+        return false;
+    const unsigned char* in = state + 4;
+    if (get(in, 2) != VERSION)
+        return false;
+    std::uint64_t profile = get(in, 1);
+    if (profile > CHIP8::QUIRKS_XOCHIP || profile != static_cast<std::uint64_t>(m_quirks) ||
+        get(in, 4) != memory_size)
+        return false;
+    if (state[memory_size + HIRES_OFFSET] != 0 || state[memory_size + PLANES_OFFSET] != 1)
+        return false;
+    const unsigned char* screen = state + memory_size + SCREEN_OFFSET;
+    for (unsigned int i = 0; i < SCREEN_WORDS; ++i)
+    {
+        if ((i >= 64 || i % 2 != 0) && get(screen, 8) != 0)
+            return false;
+        if (i < 64 && i % 2 == 0)
+            screen += 8;
+    }
+
+    std::copy(in, in + memory_size, m_memory.begin());
+    in += memory_size;
+    for (unsigned int i = 0; i < 16; ++i)
+        m_V[i * m_stride] = static_cast<unsigned char>(get(in, 1));
+    m_I[0] = static_cast<unsigned short>(get(in, 2));
+    m_pc[0] = static_cast<unsigned short>(get(in, 2));
+    m_sp[0] = static_cast<unsigned short>(get(in, 2));
+    for (unsigned int i = 0; i < 16; ++i)
+        m_stack[i * m_stride] = static_cast<unsigned short>(get(in, 2));
+    m_delay_timer[0] = static_cast<unsigned char>(get(in, 1));
+    m_sound_timer[0] = static_cast<unsigned char>(get(in, 1));
+    m_keys[0] = static_cast<unsigned short>(get(in, 2));
+    m_draw_flag[0] = get(in, 1) != 0;
+    in += 2; // High resolution and planes, checked above.
+    std::memcpy(m_flags.data(), in, m_flags.size());
+    in += m_flags.size();
+    std::memcpy(m_pattern.data(), in, m_pattern.size());
+    in += m_pattern.size();
+    m_pitch = static_cast<unsigned char>(get(in, 1));
+    for (unsigned int i = 0; i < SCREEN_WORDS; ++i)
+    {
+        std::uint64_t word = get(in, 8);
+        if (i < 64 && i % 2 == 0)
+            m_gfx[i / 2] = word;
+    }
+    m_random[0].state(get(in, 8));
+    m_cycles = get(in, 8);
+    return true;
+}
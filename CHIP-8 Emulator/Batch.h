@@ -0,0 +1,122 @@
+#pragma once
+#include "CHIP8.h"
+#include "Random.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Runs many instances ("lanes") of one machine in lockstep, for sweeps over random seeds and inputs
+that need aggregate throughput rather than one fast machine.
+
+Lane state is stored as structure of arrays: register VX of every lane is one contiguous array, and
+so are I, the program counters, the timers and the keys. The lanes at the same address form the
+group, which executes each instruction once for all its lanes: decoded once, and for the common
+loads, arithmetic, skips and timer accesses with SIMD kernels (SSE2, or AVX2 when compiled for it)
+over 16 or 32 lanes per operation. A lane leaves the group when its program counter diverges, the
+group follows the majority of a skip, and is stepped on its own until it reaches the group's
+address again. Now and then the most common address becomes the group's if the group got small.
+
+Lanes follow CHIP8 exactly for the CHIP-8 instruction set in low resolution, under any quirk profile
+but XO-CHIP's. A lane that reaches a SUPER-CHIP instruction under the SUPER-CHIP profile stops
+there, see stopped(). Under the other profiles they are 0NNN or unknown instructions, as in CHIP8.
+Every emulated cycle each running lane executes exactly one instruction, like CHIP8::emulate(), so
+lane n of a batch started from a machine seeded with s ends up in the same state as a machine
+seeded with s + n that is given the same input (see saveState()).
+*/
+class Batch
+{
+public:
+    explicit Batch(unsigned int lanes, unsigned int clock = 700);
+
+    // Starts every lane from the state of core, lane n with its random numbers seeded with
+    // seed + n. Returns false, leaving the batch as it was, if the machine is one a batch can't
+    // run: XO-CHIP quirks or high resolution.
+    bool start(const CHIP8& core, std::uint64_t seed);
+
+    unsigned int lanes() const;
+    unsigned int clock() const; // Instructions per second getter.
+    void clock(unsigned int); // Instructions per second setter.
+
+    // Emulates one 60 Hz frame on every lane like Scheduler::runFrame, returns the number of
+    // instructions emulated per lane.
+    unsigned int runFrame();
+    void emulate(unsigned int cycles); // Emulates cycles instructions on every lane.
+    void updateTimers(); // Counts the timers of every lane down.
+
+    void setKeys(unsigned int lane, unsigned short key, bool state); // See CHIP8::setKeys.
+    bool stopped(unsigned int lane) const; // Reached an instruction a batch doesn't run.
+    // Rows 0-31 of the lane's screen, bit 63 of each word is x = 0.
+    const std::uint64_t* screen(unsigned int lane) const;
+
+    // The lane's state in the format of CHIP8::saveState. A stopped lane's state is the one it
+    // stopped in, it can be loaded into a CHIP8 to go on.
+    void saveState(unsigned int lane, std::vector<unsigned char>& state) const;
+
+    // Cycles executed by the group and by lanes stepped on their own, over all lanes.
+    unsigned long long lockstepCycles() const;
+    unsigned long long divergedCycles() const;
+
+private:
+    Batch(const Batch&); // Not copyable.
+    Batch& operator=(const Batch&);
+
+    bool loadState(const unsigned char* state, std::size_t size); // Into lane 0, see SaveStateFormat.h.
+
+    template<class Q> void run(unsigned int cycles);
+    template<class Q> void stepGroup(unsigned short opcode);
+    template<class Q> void stepLane(unsigned int lane, unsigned short opcode);
+    // Skips for the lanes of the group where condition(first lane of a vector) is set.
+    template<class Condition> void skipGroup(Condition condition);
+    // Stores value(first lane of a vector) into target for the lanes of the group.
+    template<class Value> void assignGroup(unsigned char* target, Value value);
+    unsigned short opcode(unsigned int lane) const; // Opcode at the lane's program counter.
+    bool sharedCode(unsigned short address) const; // Whether every lane has the same opcode there.
+    void written(unsigned short address); // A lane wrote to memory at address.
+    void leave(unsigned int lane, unsigned short pc); // Takes a lane out of the group.
+    void stop(unsigned int lane);
+    void regroup(); // Moves the group to the most common address.
+
+    unsigned int m_lanes;
+    unsigned int m_stride; // Lanes rounded up to a multiple of the SIMD width, the padding never runs.
+    unsigned int m_clock;
+    unsigned int m_remainder; // Instructions owed to the next frames, in 1/FRAME_RATE units.
+    CHIP8::Quirks m_quirks;
+
+    // Structure of arrays, m_stride entries per register (and stack level).
+    std::vector<unsigned char> m_V; // VX of lane n at X * m_stride + n.
+    std::vector<unsigned short> m_I;
+    std::vector<unsigned short> m_pc; // Only up to date for lanes outside the group.
+    std::vector<unsigned short> m_sp;
+    std::vector<unsigned short> m_stack; // Level L of lane n at L * m_stride + n.
+    std::vector<unsigned char> m_delay_timer;
+    std::vector<unsigned char> m_sound_timer;
+    std::vector<unsigned short> m_keys;
+    std::vector<unsigned char> m_draw_flag;
+    std::vector<Random> m_random;
+
+    // Per lane blocks.
+    std::vector<unsigned char> m_memory; // 4 KB per lane.
+    std::vector<std::uint64_t> m_gfx; // 32 rows per lane.
+    std::vector<bool> m_private; // Addresses written to since start(), the lanes may differ there.
+
+    // The group.
+    std::vector<unsigned char> m_in_group; // 0xFF for lanes in the group, 0 otherwise.
+    std::vector<unsigned char> m_stopped; // 0xFF for stopped lanes, 0 otherwise.
+    std::vector<unsigned char> m_taken; // Lanes of the group taking a skip, like m_in_group.
+    std::vector<unsigned short> m_addresses; // Scratch for regroup().
+    std::vector<unsigned long long> m_stopped_at; // m_cycles when a lane stopped.
+    unsigned short m_group_pc; // Address of the group.
+    unsigned int m_group_size;
+    unsigned int m_running; // Lanes that haven't stopped.
+
+    // Left alone by lanes, taken from the machine the batch was started from.
+    std::array<unsigned char, 16> m_flags;
+    std::array<unsigned char, 16> m_pattern;
+    unsigned char m_pitch;
+
+    unsigned long long m_cycles; // Cycles emulated by every running lane, from the start state on.
+    unsigned long long m_lockstep_cycles;
+    unsigned long long m_diverged_cycles;
+};
@@ -1,27 +1,157 @@
 #include "CHIP8.h"
+#include "MappedFile.h"
 
+#include <algorithm>
 #include <assert.h>
-#include <fstream>
-#include <iostream>
 #include <random>
 
 
-CHIP8::CHIP8(void): m_distribution(0, 0xFF),
-                    m_opcode(0),
-                    m_I(0),
-                    m_pc(0x200), // Program/Game ROM starts at address 0x200.
-                    m_delay_timer(0),
-                    m_sound_timer(0),
-                    m_sp(0),
-                    m_draw_flag(true) // Initial draw for clearing purposes
+template<class Q>
+const CHIP8::Handler* CHIP8::handlers()
 {
+    // Must list the handlers in the same order as CHIP8::Op.
+    static const Handler all[OP_COUNT] =
+    {
+        &CHIP8::opDecode,
+        &CHIP8::opSYS, &CHIP8::opCLS, &CHIP8::opRET, &CHIP8::opJP, &CHIP8::opCALL,
+        &CHIP8::opSEByte<Q>, &CHIP8::opSNEByte<Q>, &CHIP8::opSEReg<Q>, &CHIP8::opLDByte, &CHIP8::opADDByte,
+        &CHIP8::opLDReg, &CHIP8::opOR, &CHIP8::opAND, &CHIP8::opXOR, &CHIP8::opADDReg, &CHIP8::opSUB,
+        &CHIP8::opSHR<Q>, &CHIP8::opSUBN, &CHIP8::opSHL<Q>,
+        &CHIP8::opSNEReg<Q>, &CHIP8::opLDI, &CHIP8::opJPV0<Q>, &CHIP8::opRND, &CHIP8::opDRW<Q>,
+        &CHIP8::opSKP<Q>, &CHIP8::opSKNP<Q>,
+        &CHIP8::opLDVxDT, &CHIP8::opLDVxK, &CHIP8::opLDDTVx, &CHIP8::opLDSTVx, &CHIP8::opADDIVx<Q>,
+        &CHIP8::opLDFVx,
+        &CHIP8::opLDBVx, &CHIP8::opLDMemVx<Q>, &CHIP8::opLDVxMem<Q>,
+        &CHIP8::opSCD, &CHIP8::opSCR, &CHIP8::opSCL, &CHIP8::opEXIT, &CHIP8::opLOW, &CHIP8::opHIGH,
+        &CHIP8::opLDHFVx, &CHIP8::opLDRVx, &CHIP8::opLDVxR,
+        &CHIP8::opSCU, &CHIP8::opSAVERange, &CHIP8::opLOADRange, &CHIP8::opLDILong, &CHIP8::opPLANE,
+        &CHIP8::opAUDIO, &CHIP8::opPITCH,
+        &CHIP8::opUnknown,
+        &CHIP8::opLDADDByte, &CHIP8::opLDIDRW<Q>, &CHIP8::opPollDT
+    };
+
+    // The extensions Q doesn't have run as what they are in plain CHIP-8.
+    static const struct Table
+    {
+        Handler handlers[OP_COUNT];
+
+        Table(void)
+        {
+            for (unsigned int op = 0; op < OP_COUNT; ++op)
+                handlers[op] = all[profileOp<Q>(op)];
+        }
+    } table;
+    return table.handlers;
+}
+
+template<class Q>
+unsigned char CHIP8::profileOp(unsigned char op)
+{
+    switch (op)
+    {
+        case OP_SCD:
+        case OP_SCR:
+        case OP_SCL:
+        case OP_EXIT:
+        case OP_LOW:
+        case OP_HIGH:
+            return Q::SCHIP_OPCODES ? op : static_cast<unsigned char>(OP_SYS);
+        case OP_LD_HF_VX:
+        case OP_LD_R_VX:
+        case OP_LD_VX_R:
+            return Q::SCHIP_OPCODES ? op : static_cast<unsigned char>(OP_UNKNOWN);
+        case OP_SCU:
+            return Q::XOCHIP_OPCODES ? op : static_cast<unsigned char>(OP_SYS);
+        case OP_SAVE_RANGE:
+        case OP_LOAD_RANGE:
+        case OP_LD_I_LONG:
+        case OP_PLANE:
+        case OP_AUDIO:
+        case OP_PITCH:
+            return Q::XOCHIP_OPCODES ? op : static_cast<unsigned char>(OP_UNKNOWN);
+        default:
+            return op;
+    }
+}
+
+template<class Q>
+const JIT::Routine* CHIP8::callOuts()
+{
+    // Only instructions that complete at once and leave m_pc alone (see JIT.h).
+    static const struct Table
+    {
+        JIT::Routine routines[OP_COUNT];
+
+        Table(void)
+        {
+            std::fill(routines, routines + OP_COUNT, nullptr);
+            // Not FX07, delay timer polls go back to the caller to be skipped over.
+            routines[OP_CLS] = &CHIP8::callOut<&CHIP8::opCLS>;
+            routines[OP_SHR] = &CHIP8::callOut<&CHIP8::opSHR<Q> >;
+            routines[OP_SUBN] = &CHIP8::callOut<&CHIP8::opSUBN>;
+            routines[OP_SHL] = &CHIP8::callOut<&CHIP8::opSHL<Q> >;
+            routines[OP_LD_DT_VX] = &CHIP8::callOut<&CHIP8::opLDDTVx>;
+            routines[OP_LD_ST_VX] = &CHIP8::callOut<&CHIP8::opLDSTVx>;
+            routines[OP_DRW] = &CHIP8::callOut<&CHIP8::opDRW<Q> >;
+            routines[OP_ADD_I_VX] = &CHIP8::callOut<&CHIP8::opADDIVx<Q> >;
+            routines[OP_LD_VX_MEM] = &CHIP8::callOut<&CHIP8::opLDVxMem<Q> >;
+        }
+    } table;
+    return table.routines;
+}
+
+template<CHIP8::Handler H>
+void CHIP8::callOut(void* core, const void* instruction)
+{
+    (static_cast<CHIP8*>(core)->*H)(*static_cast<const Instruction*>(instruction));
+}
+
+const char* const CHIP8::ENGINE_NAMES[] = { "interpreter", "predecoded", "blocks", "jit", "native" };
+const char* const CHIP8::QUIRKS_NAMES[] = { "default", "cosmac", "schip", "xochip" };
+
+CHIP8::CHIP8(void)
+{
+    std::random_device rd;
+    initialize(static_cast<std::uint64_t>(rd()) << 32 | rd());
+}
+
+CHIP8::CHIP8(std::uint64_t seed)
+{
+    initialize(seed);
+}
+
+void CHIP8::initialize(std::uint64_t seed)
+{
+    m_I = 0;
+    m_pc = 0x200; // Program/Game ROM starts at address 0x200.
+    m_delay_timer = 0;
+    m_sound_timer = 0;
+    m_sp = 0;
+    m_dirty_rows = ~0ull;
+    m_hires = false;
+    m_planes = 0x1;
+    m_pitch = 64;
+    m_draw_flag = true; // Initial draw for clearing purposes
+    m_cycles = 0;
+    m_skipped_cycles = 0;
+    m_keys = 0;
+    m_quirks = QUIRKS_DEFAULT; // Compared with by quirks().
+    m_unsupported = 0;
+    m_last_unsupported = 0;
+    quirks(QUIRKS_DEFAULT);
+    m_flush_blocks = false;
+    m_recompiled = nullptr;
+    m_profiling = false;
+    engine(ENGINE_PREDECODED);
+
     // Note that many of the "initializations" can also be done implicitly but due to lack of
     // testing doing it explicitly is favored.
     m_V.fill(0);
-    m_gfx.fill(false);
+    m_gfx.fill(0);
     m_stack.fill(0);
-    m_key.fill(false);
-    m_memory.fill(0);
+    std::fill(m_memory.begin(), m_memory.end(), 0);
+    m_flags.fill(0);
+    m_pattern.fill(0xF0); // A 500 Hz square wave at the initial pitch, until F002 loads another.
 
     // Prepare to enter the fontset into memory.
     std::array<unsigned char, 80> fontset =
@@ -44,13 +174,35 @@ CHIP8::CHIP8(void): m_distribution(0, 0xFF),
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
-    // Enter the fontset into memory.
+    // SUPER-CHIP font, 8x10 pixels. Only 0-9 came with SUPER-CHIP, A-F are XO-CHIP's.
+    std::array<unsigned char, 160> big_fontset =
+    {
+        0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+        0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+        0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+        0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+        0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+        0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+        0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+        0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+
+    // Enter the fontsets into memory.
     for (int i = 0; i < 80; ++i)
         m_memory.at(i) = fontset.at(i);
+    for (int i = 0; i < 160; ++i)
+        m_memory.at(0x50 + i) = big_fontset.at(i);
 
     // Start randomization engine.
-    std::random_device rd;
-    m_mersenne_twister.seed(rd());
+    m_random.seed(seed);
 }
 
 
@@ -58,50 +210,486 @@ CHIP8::~CHIP8(void)
 {
 }
 
-void CHIP8::loadGame(std::string file_name)
+CHIP8::LoadResult CHIP8::loadGame(const std::string& file_name, Quirks quirks)
+{
+    MappedFile file;
+    if (!file.open(file_name))
+        return LOAD_UNREADABLE;
+    return loadGame(file.data(), file.size(), quirks);
+}
+
+CHIP8::LoadResult CHIP8::loadGame(const unsigned char* program, std::size_t size, Quirks quirks)
+{
+    if (size == 0)
+        return LOAD_EMPTY;
+    if (size > programCapacity(quirks))
+        return LOAD_TOO_LARGE;
+
+    this->quirks(quirks);
+    std::copy(program, program + size, m_memory.begin() + 0x200);
+
+    // The program region changed, drop everything decoded so far.
+    Instruction undecoded = {};
+    undecoded.op = OP_DECODE;
+    std::fill(m_decoded.begin(), m_decoded.end(), undecoded);
+    flushBlocks();
+    m_recompiled = Recompiled::find(program, size, quirks);
+    std::fill(m_native_cold.begin(), m_native_cold.end(), false);
+    return LOAD_OK;
+}
+
+std::size_t CHIP8::programCapacity(Quirks quirks)
+{
+    unsigned int memory_size = (quirks == QUIRKS_XOCHIP ? XochipQuirks::ADDRESS_MASK : DefaultQuirks::ADDRESS_MASK) + 1u;
+    return memory_size - 0x200;
+}
+
+bool CHIP8::parseQuirks(const std::string& name, Quirks& quirks)
+{
+    for (int i = QUIRKS_DEFAULT; i <= QUIRKS_XOCHIP; ++i)
+    {
+        if (name == QUIRKS_NAMES[i])
+        {
+            quirks = static_cast<Quirks>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CHIP8::parseEngine(const std::string& name, Engine& engine)
+{
+    for (int i = ENGINE_INTERPRETER; i <= ENGINE_NATIVE; ++i)
+    {
+        if (name == ENGINE_NAMES[i])
+        {
+            engine = static_cast<Engine>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+CHIP8::Quirks CHIP8::quirksForFile(const std::string& file_name)
 {
-    std::ifstream file(file_name, std::ifstream::binary);
-    int i = 0x200;
-    while (file.good())
+    if (file_name.size() < 4)
+        return QUIRKS_DEFAULT;
+    std::string extension = file_name.substr(file_name.size() - 4);
+    for (std::size_t i = 0; i < extension.size(); ++i)
     {
-        m_memory.at(i) = file.get();
-        ++i;
+        if (extension[i] >= 'A' && extension[i] <= 'Z')
+            extension[i] += 'a' - 'A';
     }
-    file.close();
+    if (extension == ".sc8")
+        return QUIRKS_SCHIP;
+    if (extension == ".xo8")
+        return QUIRKS_XOCHIP;
+    return QUIRKS_DEFAULT;
+}
+
+const char* CHIP8::quirksName(Quirks quirks)
+{
+    return quirks >= QUIRKS_DEFAULT && quirks <= QUIRKS_XOCHIP ? QUIRKS_NAMES[quirks] : "unknown";
+}
+
+const char* CHIP8::engineName(Engine engine)
+{
+    return engine >= ENGINE_INTERPRETER && engine <= ENGINE_NATIVE ? ENGINE_NAMES[engine] : "unknown";
 }
 
 void CHIP8::emulateCycle()
 {
-    // Read next opcode.
-    m_opcode = m_memory.at(m_pc) << 8 | m_memory.at(m_pc+1);
+#ifdef CHIP8_INSTRUMENTATION
+    if (m_profiling)
+        stepProfiled();
+    else
+#endif
+        step();
+    ++m_cycles;
+}
+
+unsigned int CHIP8::emulateBlock()
+{
+    // Covers the longest block, and bounds a chain of JIT compiled blocks that might never leave.
+    const unsigned int MAX_DISPATCH = 0xFFFF;
+
+#ifdef CHIP8_INSTRUMENTATION
+    if (m_profiling)
+    {
+        ++m_cycles;
+        return stepProfiled();
+    }
+#endif
+
+    unsigned int executed = 0;
+    if (m_engine >= ENGINE_BLOCKS)
+        executed = runBlock(MAX_DISPATCH);
+    if (executed == 0)
+        executed = step();
+    m_cycles += executed;
+    return executed;
+}
+
+unsigned int CHIP8::emulate(unsigned int cycles)
+{
+#ifdef CHIP8_INSTRUMENTATION
+    if (m_profiling)
+    {
+        for (unsigned int i = 0; i < cycles; ++i)
+            stepProfiled();
+        m_cycles += cycles;
+        return cycles;
+    }
+#endif
+
+    unsigned int executed = skipIdle(cycles);
+    while (executed < cycles)
+    {
+        unsigned short address = m_pc;
+        unsigned int block = 0;
+        if (m_engine == ENGINE_NATIVE && m_recompiled != nullptr && m_recompiled->quirks == m_quirks)
+            block = runRecompiled(cycles - executed);
+        else if (m_engine >= ENGINE_BLOCKS)
+            block = runBlock(cycles - executed);
+        if (block == 0) // Next block doesn't fit in what's left, finish instruction by instruction.
+            block = step();
+        executed += block;
+
+        // Key waits, jumps to self and (as one block) delay timer polls come back where they
+        // started.
+        if (m_pc == address && executed < cycles)
+            executed += skipIdle(cycles - executed);
+    }
+    m_cycles += executed;
+    return executed;
+}
+
+CHIP8::Idle CHIP8::idle() const
+{
+    unsigned short opcode = word(m_pc);
+    if ((opcode & 0xF0FF) == 0xF00A)
+        return m_keys != 0 ? IDLE_NONE : IDLE_KEY;
+    if ((opcode == 0x00FD && m_handlers[OP_EXIT] == &CHIP8::opEXIT) ||
+        (m_pc < 0x1000 && opcode == (0x1000 | m_pc)))
+        return IDLE_HALTED;
+
+    unsigned short start;
+    unsigned char x;
+    if (m_delay_timer > 0 && pollLoop(start, x))
+    {
+        // The 3X00 only loops with VX still holding a timer value above 0.
+        if (m_pc != start + 2 || m_V[x] != 0)
+            return IDLE_TIMER;
+    }
+    return IDLE_NONE;
+}
+
+unsigned int CHIP8::idleTicks() const
+{
+    return idle() == IDLE_TIMER ? m_delay_timer : 0;
+}
+
+unsigned long long CHIP8::unsupported() const
+{
+    return m_unsupported;
+}
+
+unsigned short CHIP8::lastUnsupported() const
+{
+    return m_last_unsupported;
+}
+
+unsigned short CHIP8::word(unsigned short address) const
+{
+    return m_memory[address & m_memory_mask] << 8 | m_memory[(address + 1) & m_memory_mask];
+}
+
+bool CHIP8::pollLoop(unsigned short& start, unsigned char& x) const
+{
+    // m_pc may be at any of the three instructions.
+    for (unsigned short offset = 0; offset <= 4; offset += 2)
+    {
+        start = m_pc - offset;
+        unsigned short opcode = word(start);
+        x = (opcode & 0x0F00) >> 8;
+        if (start < 0x1000 && (opcode & 0xF0FF) == 0xF007 && word(start + 2) == (0x3000 | x << 8) &&
+            word(start + 4) == (0x1000 | start))
+            return true;
+    }
+    return false;
+}
+
+unsigned int CHIP8::skipIdle(unsigned int cycles)
+{
+    switch (idle())
+    {
+        case IDLE_KEY:
+        case IDLE_HALTED:
+            // Every retry leaves the machine as it was.
+            m_skipped_cycles += cycles;
+            return cycles;
+
+        case IDLE_TIMER:
+        {
+            // The delay timer only changes between calls, so the loop goes around with VX set to
+            // it. Leave m_pc where executing the cycles one by one would have.
+            unsigned short start;
+            unsigned char x;
+            pollLoop(start, x);
+            unsigned int position = (m_pc - start) / 2;
+            if (cycles > (3 - position) % 3) // Reaches the FX07.
+                m_V[x] = m_delay_timer;
+            m_pc = start + 2 * ((position + cycles) % 3);
+            m_skipped_cycles += cycles;
+            return cycles;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+CHIP8::Engine CHIP8::engine() const
+{
+    return m_engine;
+}
+
+void CHIP8::engine(Engine engine)
+{
+    // Without a usable JIT on this host, blocks run interpreted.
+    if (engine == ENGINE_JIT && !JIT::available())
+        engine = ENGINE_BLOCKS;
+    m_engine = engine;
+
+    const std::size_t PROGRAM_WORDS = (0x1000 - 0x200) / 2;
+    if (engine == ENGINE_INTERPRETER)
+        std::vector<Instruction>().swap(m_decoded);
+    else if (m_decoded.empty())
+    {
+        Instruction undecoded = {};
+        undecoded.op = OP_DECODE;
+        m_decoded.assign(PROGRAM_WORDS, undecoded);
+    }
+
+    if (engine < ENGINE_BLOCKS)
+    {
+        flushBlocks();
+        std::vector<Block>().swap(m_blocks);
+        std::vector<Instruction>().swap(m_block_code);
+        std::vector<unsigned short>().swap(m_block_index);
+        std::vector<bool>().swap(m_block_memory);
+    }
+    else if (m_block_index.empty())
+    {
+        m_block_index.assign(PROGRAM_WORDS, 0);
+        m_block_memory.assign(0x1000, false);
+    }
+
+    if (engine != ENGINE_NATIVE)
+        std::vector<bool>().swap(m_native_cold);
+    else if (m_native_cold.empty())
+        m_native_cold.assign(0x1000, false);
+}
+
+std::size_t CHIP8::footprint() const
+{
+    return sizeof(*this) + m_memory.capacity() + m_decoded.capacity() * sizeof(Instruction) +
+           m_blocks.capacity() * sizeof(Block) + m_block_code.capacity() * sizeof(Instruction) +
+           m_block_index.capacity() * sizeof(unsigned short) + m_block_memory.capacity() / 8 +
+           m_native_cold.capacity() / 8 +
+           m_jit.allocated() + m_profile.allocated();
+}
+
+unsigned int CHIP8::step()
+{
+    // Fetch the next instruction, it is only decoded the first time its address is executed.
+    const Instruction& instruction = fetch(m_pc);
     m_pc += 2;
 
-    // Decode opcode.
-    bool success = decodeOpcode();
+    // Execute it.
+    (this->*m_handlers[instruction.op])(instruction);
+    return 1;
+}
+
+unsigned int CHIP8::stepProfiled()
+{
+    static_assert(OP_UNKNOWN - OP_SYS == Profile::CLASS_UNKNOWN, "Profile::Class must follow CHIP8::Op");
+
+    // Classified as the profile runs it, so an extension opcode it lacks counts as SYS or UNKNOWN.
+    unsigned short address = m_pc;
+    Instruction instruction = decodeOpcode(word(address), m_quirks);
+    Profile::Class type = static_cast<Profile::Class>(instruction.op - OP_SYS);
+    unsigned char x = instruction.x;
+    step();
 
-    if (!success)
-        return;
+    m_profile.instruction(address, type);
+    if (type == Profile::CLASS_LD_VX_K && m_pc == address) // Still waiting for a key.
+        m_profile.keyWait();
+    else if (type == Profile::CLASS_LD_VX_DT)
+        m_profile.timerRead(address, m_V[x]);
+    return 1;
+}
 
-    // Update timers.
+void CHIP8::updateTimers()
+{
     if (m_delay_timer > 0)
         --m_delay_timer;
     if (m_sound_timer > 0)
-    {
-        if (m_sound_timer == 1)
-            std::cout << "BEEP!" << "\7" << std::endl;
         --m_sound_timer;
+}
+
+void CHIP8::seed(std::uint64_t seed)
+{
+    m_random.seed(seed);
+}
+
+unsigned long long CHIP8::cycles() const
+{
+    return m_cycles;
+}
+
+unsigned long long CHIP8::skippedCycles() const
+{
+    return m_skipped_cycles;
+}
+
+const Recompiled* CHIP8::recompiled() const
+{
+    return m_recompiled;
+}
+
+void CHIP8::recompiled(const Recompiled* recompiled)
+{
+    m_recompiled = recompiled;
+    std::fill(m_native_cold.begin(), m_native_cold.end(), false);
+}
+
+CHIP8::Quirks CHIP8::quirks() const
+{
+    return m_quirks;
+}
+
+void CHIP8::quirks(Quirks quirks)
+{
+    Quirks previous = m_quirks;
+    m_quirks = quirks;
+    switch (quirks)
+    {
+        case QUIRKS_COSMAC:
+            m_handlers = handlers<CosmacQuirks>();
+            m_call_outs = callOuts<CosmacQuirks>();
+            m_memory_mask = CosmacQuirks::ADDRESS_MASK;
+            break;
+        case QUIRKS_SCHIP:
+            m_handlers = handlers<SchipQuirks>();
+            m_call_outs = callOuts<SchipQuirks>();
+            m_memory_mask = SchipQuirks::ADDRESS_MASK;
+            break;
+        case QUIRKS_XOCHIP:
+            m_handlers = handlers<XochipQuirks>();
+            m_call_outs = callOuts<XochipQuirks>();
+            m_memory_mask = XochipQuirks::ADDRESS_MASK;
+            break;
+        default:
+            m_quirks = QUIRKS_DEFAULT;
+            m_handlers = handlers<DefaultQuirks>();
+            m_call_outs = callOuts<DefaultQuirks>();
+            m_memory_mask = DefaultQuirks::ADDRESS_MASK;
+            break;
+    }
+
+    // Decoded instructions are the same under every profile, blocks aren't: XO-CHIP skips step
+    // over F000 NNNN, so the JIT leaves them out, and compiled code calls the profile's handlers.
+    if (m_quirks != previous)
+        flushBlocks();
+
+    // Only as much memory as the profile can address, shrinking drops what is past the end.
+    if (m_memory.size() != m_memory_mask + 1u)
+    {
+        m_memory.resize(m_memory_mask + 1u);
+        m_memory.shrink_to_fit();
     }
 }
 
+bool CHIP8::profiling() const
+{
+    return m_profiling;
+}
+
+void CHIP8::profiling(bool profiling)
+{
+#ifdef CHIP8_INSTRUMENTATION
+    m_profiling = profiling;
+#else
+    (void)profiling;
+#endif
+}
+
+const Profile& CHIP8::profile() const
+{
+    return m_profile;
+}
+
+void CHIP8::clearProfile()
+{
+    m_profile.clear();
+}
+
 void CHIP8::setKeys(unsigned short key, bool state)
 {
     assert(key >= 0 && key <= 15);
-    m_key.at(key) = state;
+    if (state)
+        m_keys |= 1 << key;
+    else
+        m_keys &= ~(1 << key);
+}
+
+CHIP8::FrameView CHIP8::gfx() const
+{
+    FrameView view =
+    {
+        { &m_gfx[0], &m_gfx[PLANE_SIZE] }, SCREEN_STRIDE, m_hires ? 128u : 64u, m_hires ? 64u : 32u
+    };
+    return view;
+}
+
+CHIP8::Registers CHIP8::registers() const
+{
+    Registers registers;
+    std::copy(m_V.begin(), m_V.end(), registers.V);
+    std::copy(m_stack.begin(), m_stack.end(), registers.stack);
+    registers.I = m_I;
+    registers.pc = m_pc;
+    registers.sp = m_sp;
+    registers.keys = m_keys;
+    registers.delay_timer = m_delay_timer;
+    registers.sound_timer = m_sound_timer;
+    return registers;
+}
+
+std::uint64_t CHIP8::dirtyRows() const
+{
+    return m_dirty_rows;
+}
+
+void CHIP8::clearDirtyRows()
+{
+    m_dirty_rows = 0;
+}
+
+bool CHIP8::buzzer() const
+{
+    return m_sound_timer > 0;
+}
+
+const unsigned char* CHIP8::audioPattern() const
+{
+    return m_pattern.data();
 }
 
-std::array<bool, 2048> CHIP8::gfx() const
+unsigned char CHIP8::audioPitch() const
 {
-    return m_gfx;
+    return m_pitch;
 }
 
 bool CHIP8::draw_flag() const
@@ -114,422 +702,1192 @@ void CHIP8::draw_flag(bool draw_flag)
     m_draw_flag = draw_flag;
 }
 
-bool CHIP8::decodeOpcode()
+const CHIP8::Instruction& CHIP8::fetch(unsigned short address)
 {
-    switch (m_opcode & 0xF000) // Bitwise AND with 0xF000 means we only read the first hexadecimal value.
+    // Only even addresses of the program region are cached, anything else (odd jump targets, code
+    // in the interpreter area) is decoded every time.
+    unsigned int index = (address - 0x200u) >> 1; // Out of range below 0x200 as well.
+    if ((address & 1) == 0 && index < m_decoded.size())
     {
-        case 0x0000:
-        {
-            switch (m_opcode) // implicit &0x0FFF, we only care about the last three values.
-            {
-                // Clears the screen.
-                case 0x00E0: // CLS
-                {
-                    m_gfx.fill(0);
-                    m_draw_flag = true;
-                    break;
-                }
-                // Returns from a subroutine.
-                case 0x00EE: // RET
-                {
-                    m_pc = m_stack.at(m_sp);
-                    --m_sp;
-                    break;
-                }
-                // case 0x0NNN:
-                // Calls RCA 1802 program at address NNN.
-                default:
-                {
-                    std::cout << "Opcode 0x0NNN not implemented." << std::endl;
-                    break;
-                }
-            }
-            break;
-        }
-        // case 0x1NNN
-        // Jumps to address NNN.
-        case 0x1000: // JP addr
-        {
-            m_pc = m_opcode & 0x0FFF;
-            break;
-        }
-        // case 0x2NNN
-        // Calls subroutine at NNN.
-        case 0x2000: // CALL addr
-        {
-            ++m_sp;
-            m_stack.at(m_sp) = m_pc;
-            m_pc = m_opcode & 0x0FFF;
+        Instruction& cached = m_decoded[index];
+        if (cached.op == OP_DECODE)
+            cached = decodeOpcode(m_memory[address] << 8 | m_memory[address + 1]);
+        return cached;
+    }
+
+    m_scratch = decodeOpcode(word(address));
+    return m_scratch;
+}
+
+void CHIP8::invalidate(unsigned short address)
+{
+    // Each byte of the program region belongs to exactly one cached (even aligned) instruction.
+    unsigned int index = (address - 0x200u) >> 1;
+    if (index < m_decoded.size())
+        m_decoded[index].op = OP_DECODE;
+    if (address < m_block_memory.size() && m_block_memory[address])
+        m_flush_blocks = true;
+}
+
+unsigned int CHIP8::runBlock(unsigned int cycles)
+{
+    if (m_flush_blocks) // Written to by an instruction stepped outside of a block.
+        flushBlocks();
+
+    // Most blocks are a few instructions long, so go on to the next one here rather than through
+    // emulate() again. Native code gets control back after one block.
+    unsigned int executed = 0;
+    bool chain = m_engine != ENGINE_NATIVE;
+    bool step_short = m_engine != ENGINE_JIT; // Compiled, short blocks chain on to the next block.
+    do
+    {
+        unsigned int slot = (m_pc - 0x200u) >> 1; // Out of range below 0x200 as well.
+        if (slot >= m_block_index.size() || (m_pc & 1) != 0)
             break;
-        }
-        // case 0x3XNN
-        // Skips the next instruction if VX equals NN.
-        case 0x3000: // SE Vx, byte
+        unsigned short index = m_block_index[slot];
+        if (index == 0)
         {
-            if (m_V.at((m_opcode & 0x0F00) >> 8) == (m_opcode & 0x00FF))
-                m_pc+=2;
-            break;
+            if (!translateBlock(m_pc))
+                break;
+            index = m_block_index[slot];
         }
-        // case 0x4XNN
-        // Skips the next instruction if VX doesn't equal NN.
-        case 0x4000: // SNE Vx, byte
+        unsigned short address = m_pc;
+        if ((index & SHORT_BLOCK) != 0)
         {
-            if (m_V.at((m_opcode & 0x0F00) >> 8) != (m_opcode & 0x00FF))
-                m_pc+=2;
-            break;
+            if (step_short)
+            {
+                // step(), knowing the address is in range.
+                Instruction& instruction = m_decoded[slot];
+                if (instruction.op == OP_DECODE)
+                    instruction = decodeOpcode(m_memory[address] << 8 | m_memory[address + 1]);
+                m_pc += 2;
+                (this->*m_handlers[instruction.op])(instruction);
+                ++executed;
+                if (m_flush_blocks || m_pc == address)
+                    break;
+                continue;
+            }
+            index &= ~SHORT_BLOCK;
         }
-        case 0x5000:
+
+        const Block& block = m_blocks[index - 1];
+        const Instruction* code = &m_block_code[block.first];
+        unsigned int first = 0;
+        if (m_engine == ENGINE_JIT)
         {
-            switch (m_opcode & 0x000F)
+            unsigned int compiled = runNative(index - 1, cycles - executed);
+            executed += compiled;
+            first = m_jit.length(index - 1);
+            // Chained into other blocks rather than stopping at the end of the compiled prefix.
+            if (compiled > 0 && m_pc != address + first * 2)
             {
-                // case 0x5XY0
-                // Skips the next instruction if VX equals VY.
-                case 0x0000: // SE, Sx, Vy
-                {
-                    if (m_V.at((m_opcode & 0x0F00) >> 8) == m_V.at((m_opcode & 0x00F0) >> 4))
-                        m_pc+=2;
-                    break;
-                }
-                default:
-                {
-                    std::cout << "Opcode " << m_opcode << " (decimal) not recognized." << std::endl;
+                if (m_flush_blocks || m_pc == address)
                     break;
-                }
+                continue;
             }
-            break;
+            if (compiled == 0)
+                first = 0;
         }
-        // case 0x6XNN
-        // Sets VX to NN.
-        case 0x6000: // LD Vx, byte
+
+        // Interpret what's left after the compiled prefix.
+        unsigned int i = first;
+        for (; i < block.entries; i += code[i].length)
         {
-            m_V.at((m_opcode & 0x0F00) >> 8) = m_opcode & 0x00FF;
-            break;
+            const Instruction& instruction = code[i];
+            if (instruction.length > cycles - executed)
+                break;
+
+            m_pc += instruction.length * 2;
+            unsigned int completed = (this->*m_handlers[instruction.op])(instruction);
+            if (completed == 0) // Waiting for a key, counts as a cycle.
+                completed = 1;
+            executed += completed;
+
+            if (m_flush_blocks) // The block wrote to translated code, stop before running stale code.
+                break;
         }
-        // case 0x7XNN
-        // Adds NN to VX.
-        case 0x7000: // ADD Vx, byte
-        {
-            m_V.at((m_opcode & 0x0F00) >> 8) += m_opcode & 0x00FF;
+
+        // Stop where the rest doesn't fit, and where the block came back to its start for
+        // emulate() to check whether the machine is idle.
+        if (i < block.entries || m_flush_blocks || m_pc == address)
             break;
-        }
-        case 0x8000:
-        {
-            switch (m_opcode & 0x000F)
-            {
-                // case 0x8XY0
-                // Sets VX to the value of VY.
-                case 0x0000: // LD Vx, Vy
-                {
-                    m_V.at((m_opcode & 0x0F00) >> 8) = m_V.at((m_opcode & 0x00F0) >> 4);
-                    break;
-                }
-                // case 0x8XY1
-                // Sets VX to VX or VY.
-                case 0x0001: // OR Vx, Vy
-                {
-                    m_V.at((m_opcode & 0x0F00) >> 8) |= m_V.at((m_opcode & 0x00F0) >> 4);
-                    break;
-                }
-                // case 0x8XY2
-                // Sets VX to VX bitwise AND VY.
-                case 0x0002: // AND Vx, Vy
-                {
-                    m_V.at((m_opcode & 0x0F00) >> 8) &= m_V.at((m_opcode & 0x00F0) >> 4);
-                    break;
-                }
-                // case 0x8XY3
-                // Sets VX to VX xor VY.
-                case 0x0003: // XOR Vx, Vy
-                {
-                    m_V.at((m_opcode & 0x0F00) >> 8) ^= m_V.at((m_opcode & 0x00F0) >> 4);
-                    break;
-                }
-                // case 0x8XY4
-                // Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
-                case 0x0004: // ADD Vx, Vy
-                {
-                    if (m_V.at((m_opcode & 0x00F0) >> 4) > (0xFF - m_V.at((m_opcode & 0x0F00) >> 8)))
-                        m_V.at(0xF) = 1; // There is a carry.
-                    else
-                        m_V.at(0xF) = 0; // There is no carry.
-                    m_V.at((m_opcode & 0x0F00) >> 8) += m_V.at((m_opcode & 0x00F0) >> 4);
-                    break;
-                }
-                // case 0x8XY5
-                // VY is subtracted from VX. VF is set to 0 when there's a borrow and 1 when there isn't.
-                case 0x0005: // SUB Vx, Vy
-                {
-                    if (m_V.at((m_opcode & 0x0F00) >> 8) < m_V.at((m_opcode & 0x00F0) >> 4))
-                        m_V.at(0xF) = 0; // There is a borrow.
-                    else
-                        m_V.at(0xF) = 1; // There is no borrow.
-                    m_V.at((m_opcode & 0x0F00) >> 8) -= m_V.at((m_opcode & 0x00F0) >> 4);
-                    break;
-                }
-                // case 0x8XY6
-                // Shifts VX right by one. VF is set to the value of the least significant bit of VX before
-                // the shift.
-                case 0x0006: // SHR Vx {, Vy}
-                {
-                    m_V.at(0xF) = m_V.at((m_opcode & 0x0F00) >> 8) & 0x01;
-                    m_V.at((m_opcode & 0x0F00) >> 8) >>= 1;
-                    break;
-                }
-                // case 0x8XY7
-                // Sets VX to VY minus VX. VF is set to 0 when there's a borrow and 1 when there isn't.
-                case 0x0007: // SUBN Vx, Vy
-                {
-                    if (m_V.at((m_opcode & 0x0F00) >> 8) > m_V.at((m_opcode & 0x00F0) >> 4))
-                        m_V.at(0xF) = 0; // There is a borrow.
-                    else
-                        m_V.at(0xF) = 1; // There is no borrow.
-                    m_V.at((m_opcode & 0x0F00) >> 8) = m_V.at((m_opcode & 0x00F0) >> 4) - m_V.at((m_opcode & 0x0F00) >> 8);
-                    break;
-                }
-                // case 0x8XYE
-                // Shifts VX left by one. VF is set to the value of the most significant bit of VX before
-                // the shift.
-                case 0x000E: // SHL Vx {, Vy}
-                {
-                    m_V.at(0xF) = m_V.at((m_opcode & 0x0F00) >> 8) >> 7;
-                    m_V.at((m_opcode & 0x0F00) >> 8) <<= 1;
-                    break;
-                }
-                default:
-                {
-                    std::cout << "Opcode " << m_opcode << " (decimal) not recognized." << std::endl;
-                    break;
-                }
-            }
+    } while (chain && executed < cycles);
+
+    if (m_flush_blocks)
+        flushBlocks();
+    return executed;
+}
+
+unsigned int CHIP8::runNative(unsigned int index, unsigned int cycles)
+{
+    const unsigned short JIT_THRESHOLD = 8; // Runs before a block is compiled.
+
+    Block& block = m_blocks[index];
+    JIT::Function function = m_jit.function(index);
+    if (function == nullptr)
+    {
+        if (m_jit.compiled(index) || ++block.heat < JIT_THRESHOLD)
+            return 0;
+
+        // Call-outs get the instruction decoded on its own, not the superinstruction it may start.
+        std::vector<unsigned short> opcodes(block.entries);
+        std::vector<Instruction> singles(block.entries);
+        std::vector<JIT::CallOut> call_outs(block.entries);
+        for (unsigned int i = 0; i < block.entries; ++i)
+        {
+            opcodes[i] = m_block_code[block.first + i].opcode;
+            singles[i] = decodeOpcode(opcodes[i]);
+            JIT::CallOut call_out = { m_call_outs[singles[i].op], &singles[i], sizeof(Instruction) };
+            call_outs[i] = call_out;
+        }
+
+        // Compiled skips always step over one word, leave skips that might land on F000 NNNN to
+        // the interpreter.
+        unsigned int count = block.entries;
+        unsigned char last = m_block_code[block.first + count - 1].op;
+        if (m_quirks == QUIRKS_XOCHIP && (last == OP_SE_BYTE || last == OP_SNE_BYTE ||
+            last == OP_SE_REG || last == OP_SNE_REG))
+            --count;
+        if (count == 0 || m_jit.compile(index, m_pc, opcodes.data(), call_outs.data(), count) == 0)
+            return 0;
+        function = m_jit.function(index);
+    }
+
+    if (m_jit.length(index) > cycles)
+        return 0;
+
+#ifdef CHIP8_JIT_VERIFY
+    std::array<unsigned char, 16> V = m_V;
+    unsigned short I = m_I;
+    unsigned short pc = m_pc;
+    std::array<std::uint64_t, 2 * PLANE_SIZE> gfx = m_gfx; // Call-outs draw.
+#endif
+
+    unsigned int budget = cycles;
+    m_pc = function(m_V.data(), &m_I, this, &budget);
+    unsigned int executed = cycles - budget;
+
+#ifdef CHIP8_JIT_VERIFY
+    // Run as many instructions through the interpreter from the same state and compare the results.
+    // The compiled instructions neither write memory nor read the timers or the keys.
+    std::swap(V, m_V);
+    std::swap(I, m_I);
+    std::swap(pc, m_pc);
+    std::swap(gfx, m_gfx);
+    for (unsigned int i = 0; i < executed; ++i)
+    {
+        Instruction single = decodeOpcode(word(m_pc));
+        m_pc += 2;
+        (this->*m_handlers[single.op])(single);
+    }
+    assert(V == m_V && I == m_I && pc == m_pc && gfx == m_gfx);
+#endif
+    return executed;
+}
+
+unsigned int CHIP8::runRecompiled(unsigned int cycles)
+{
+    // Entering the native code costs a copy of the registers both ways. Where it only runs a few
+    // instructions before stopping again, leave the address to the block engine from then on.
+    const unsigned int MIN_NATIVE_RUN = 8;
+
+    unsigned short address = m_pc;
+    bool cold = address < m_native_cold.size() && m_native_cold[address];
+    unsigned int executed = 0;
+    if (!cold)
+    {
+        Recompiled::State state;
+        std::copy(m_V.begin(), m_V.end(), state.V);
+        std::copy(m_stack.begin(), m_stack.end(), state.stack);
+        state.I = m_I;
+        state.pc = m_pc;
+        state.sp = m_sp;
+        state.keys = m_keys;
+        state.delay_timer = m_delay_timer;
+        state.sound_timer = m_sound_timer;
+        state.memory = m_memory.data();
+
+        executed = m_recompiled->function(state, cycles);
+
+        std::copy(state.V, state.V + 16, m_V.begin());
+        std::copy(state.stack, state.stack + 16, m_stack.begin());
+        m_I = state.I;
+        m_pc = state.pc;
+        m_sp = state.sp;
+        m_delay_timer = state.delay_timer;
+        m_sound_timer = state.sound_timer;
+        if (executed < cycles && executed < MIN_NATIVE_RUN && address < m_native_cold.size())
+            m_native_cold[address] = true;
+    }
+
+    // Stopped at an instruction the native code leaves to the interpreter, interpret the block
+    // from there.
+    if (executed < cycles)
+    {
+        unsigned int block = runBlock(cycles - executed);
+        executed += block != 0 ? block : step();
+    }
+    return executed;
+}
+
+bool CHIP8::translateBlock(unsigned short address)
+{
+    const unsigned int MAX_BLOCK_ENTRIES = 64;
+
+    Block block;
+    block.first = m_block_code.size();
+    block.entries = 0;
+    block.heat = 0;
+
+    unsigned short start = address;
+    while (address < 0x1000 - 1 && block.entries < MAX_BLOCK_ENTRIES)
+    {
+        Instruction instruction = decodeOpcode(m_memory[address] << 8 | m_memory[address + 1]);
+        m_block_code.push_back(instruction);
+        ++block.entries;
+        address += 2;
+        if (endsBlock(instruction.op))
             break;
+    }
+    if (block.entries == 0)
+        return false;
+
+    // Fuse common instruction sequences into superinstructions. The covered entries stay in
+    // place for the superinstruction to read.
+    Instruction* code = &m_block_code[block.first];
+    for (unsigned int i = 0; i + 1 < block.entries; i += code[i].length)
+    {
+        if (code[i].op == OP_LD_BYTE && code[i + 1].op == OP_ADD_BYTE)
+        {
+            code[i].op = OP_LD_ADD_BYTE;
+            code[i].length = 2;
         }
-        case 0x9000:
+        else if (code[i].op == OP_LD_I && code[i + 1].op == OP_DRW)
         {
-            switch (m_opcode & 0x000F)
+            code[i].op = OP_LD_I_DRW;
+            code[i].length = 2;
+        }
+    }
+
+    // A delay timer polling loop is a block of its own since the skip in it ends the block. Pull
+    // the jump back into the block to run a whole iteration per dispatch.
+    if (block.entries == 2 && code[0].op == OP_LD_VX_DT && code[1].op == OP_SE_BYTE &&
+        code[1].x == code[0].x && code[1].nn == 0 && address < 0x1000 - 1 &&
+        (m_memory[address] << 8 | m_memory[address + 1]) == (0x1000 | start))
+    {
+        m_block_code.push_back(decodeOpcode(0x1000 | start));
+        code = &m_block_code[block.first];
+        code[0].op = OP_POLL_DT;
+        code[0].length = 3;
+        ++block.entries;
+        address += 2;
+    }
+
+    for (unsigned short covered = start; covered < address; ++covered)
+        m_block_memory[covered] = true;
+
+    // Looking up a block costs more than stepping one or two plain instructions.
+    const unsigned int MIN_BLOCK_ENTRIES = 3;
+    unsigned short index = m_blocks.size() + 1;
+    if (block.entries < MIN_BLOCK_ENTRIES && code[0].length == 1)
+        index |= SHORT_BLOCK;
+
+    m_blocks.push_back(block);
+    m_block_index[(start - 0x200) >> 1] = index;
+    return true;
+}
+
+bool CHIP8::endsBlock(unsigned char op)
+{
+    switch (op)
+    {
+        case OP_RET:
+        case OP_JP:
+        case OP_CALL:
+        case OP_JP_V0:
+        case OP_SE_BYTE:
+        case OP_SNE_BYTE:
+        case OP_SE_REG:
+        case OP_SNE_REG:
+        case OP_SKP:
+        case OP_SKNP:
+        case OP_LD_VX_K:
+        case OP_EXIT:
+        case OP_LD_I_LONG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void CHIP8::flushBlocks()
+{
+    m_blocks.clear();
+    m_block_code.clear();
+    std::fill(m_block_index.begin(), m_block_index.end(), 0);
+    std::fill(m_block_memory.begin(), m_block_memory.end(), false);
+    m_flush_blocks = false;
+    m_jit.reset();
+}
+
+CHIP8::Instruction CHIP8::decodeOpcode(unsigned short opcode, Quirks quirks)
+{
+    Instruction instruction = decodeOpcode(opcode);
+    switch (quirks)
+    {
+        case QUIRKS_COSMAC: instruction.op = profileOp<CosmacQuirks>(instruction.op); break;
+        case QUIRKS_SCHIP: instruction.op = profileOp<SchipQuirks>(instruction.op); break;
+        case QUIRKS_XOCHIP: instruction.op = profileOp<XochipQuirks>(instruction.op); break;
+        default: instruction.op = profileOp<DefaultQuirks>(instruction.op); break;
+    }
+    return instruction;
+}
+
+CHIP8::Instruction CHIP8::decodeOpcode(unsigned short opcode)
+{
+    Instruction instruction;
+    instruction.opcode = opcode;
+    instruction.nnn = opcode & 0x0FFF;
+    instruction.x = (opcode & 0x0F00) >> 8;
+    instruction.y = (opcode & 0x00F0) >> 4;
+    instruction.n = opcode & 0x000F;
+    instruction.nn = opcode & 0x00FF;
+    instruction.length = 1;
+    instruction.op = OP_UNKNOWN;
+
+    switch (opcode & 0xF000) // Bitwise AND with 0xF000 means we only read the first hexadecimal value.
+    {
+        case 0x0000:
+        {
+            switch (opcode) // implicit &0x0FFF, we only care about the last three values.
             {
-                // case 0x9XY0
-                // Skips the next instruction if VX doesn't equal VY.
-                case 0x0000: // SNE Vx, Vy
-                {
-                    if (m_V.at((m_opcode & 0x0F00) >> 8) != m_V.at((m_opcode & 0x00F0) >> 4))
-                        m_pc+=2;
-                    break;
-                }
+                case 0x00E0: instruction.op = OP_CLS; break;
+                case 0x00EE: instruction.op = OP_RET; break;
+                case 0x00FB: instruction.op = OP_SCR; break;
+                case 0x00FC: instruction.op = OP_SCL; break;
+                case 0x00FD: instruction.op = OP_EXIT; break;
+                case 0x00FE: instruction.op = OP_LOW; break;
+                case 0x00FF: instruction.op = OP_HIGH; break;
                 default:
-                {
-                    std::cout << "Opcode " << m_opcode << " (decimal) not recognized." << std::endl;
+                    if ((opcode & 0xFFF0) == 0x00C0)
+                        instruction.op = OP_SCD;
+                    else if ((opcode & 0xFFF0) == 0x00D0)
+                        instruction.op = OP_SCU;
+                    else
+                        instruction.op = OP_SYS;
                     break;
-                }
             }
             break;
         }
-        // case 0xANNN
-        // Sets I to the address NNN.
-        case 0xA000: // LD I, addr
+        case 0x1000: instruction.op = OP_JP; break;
+        case 0x2000: instruction.op = OP_CALL; break;
+        case 0x3000: instruction.op = OP_SE_BYTE; break;
+        case 0x4000: instruction.op = OP_SNE_BYTE; break;
+        case 0x5000:
         {
-            m_I = m_opcode & 0x0FFF;
+            switch (instruction.n)
+            {
+                case 0x0: instruction.op = OP_SE_REG; break;
+                case 0x2: instruction.op = OP_SAVE_RANGE; break;
+                case 0x3: instruction.op = OP_LOAD_RANGE; break;
+            }
             break;
         }
-        // case 0xBNNN
-        // Jumps to the address NNN plus V0.
-        case 0xB000: // JP V0, addr
+        case 0x6000: instruction.op = OP_LD_BYTE; break;
+        case 0x7000: instruction.op = OP_ADD_BYTE; break;
+        case 0x8000:
         {
-            m_pc = (m_opcode & 0x0FFF) + m_V.at(0x0);
+            switch (instruction.n)
+            {
+                case 0x0: instruction.op = OP_LD_REG; break;
+                case 0x1: instruction.op = OP_OR; break;
+                case 0x2: instruction.op = OP_AND; break;
+                case 0x3: instruction.op = OP_XOR; break;
+                case 0x4: instruction.op = OP_ADD_REG; break;
+                case 0x5: instruction.op = OP_SUB; break;
+                case 0x6: instruction.op = OP_SHR; break;
+                case 0x7: instruction.op = OP_SUBN; break;
+                case 0xE: instruction.op = OP_SHL; break;
+            }
             break;
         }
-        // case 0xCXNN
-        // Sets VX to a random number by generating a "random" number between 0x00 and 0xFF and then using bitwise AND with NN as mask.
-        case 0xC000: // RND Vx, byte
+        case 0x9000:
         {
-            int random_number = m_distribution(m_mersenne_twister);
-            random_number &= (m_opcode & 0x00FF); // Bitwise AND with NN.
-            m_V.at((m_opcode & 0x0F00) >> 8) = random_number;
+            if (instruction.n == 0x0)
+                instruction.op = OP_SNE_REG;
             break;
         }
-        // case 0xDXYN
-        // Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N
-        // pixels. Each row of 8 pixels is read as bit-coded (with the most significant bit of each
-        // byte displayed on the left) starting from memory location I; I value doesn't change
-        // after the exectution of this instruction. VF is set to 1 if any screen pixels are
-        // flipped from set to unset when the sprite is drawn, and to 0 if that doesn't happen.
-        case 0xD000: // DRW Vx, Vy, nibble
+        case 0xA000: instruction.op = OP_LD_I; break;
+        case 0xB000: instruction.op = OP_JP_V0; break;
+        case 0xC000: instruction.op = OP_RND; break;
+        case 0xD000: instruction.op = OP_DRW; break;
+        case 0xE000:
         {
-            unsigned short x_coordinate; // X-coordinate.
-            unsigned short y_coordinate; // Y-coordinate.
-            int rows; // Number of rows to draw.
-
-            // Set coordinates and wrap as needed.
-            x_coordinate = m_V.at((m_opcode & 0x0F00) >> 8) % 64;
-            y_coordinate = m_V.at((m_opcode & 0x00F0) >> 4) % 32;
-            rows = m_opcode & 0x000F;
-
-            assert(x_coordinate < 64 && x_coordinate >= 0);
-            assert(y_coordinate < 32 && y_coordinate >= 0);
-
-            m_V.at(0xF) = 0; // Collision flag.
-
-            for (int y = 0; y < rows; ++y) // Number of rows to draw.
+            switch (instruction.nn)
             {
-                unsigned char pixel_byte = m_memory.at(m_I+y);
-                for (int x = 0; x < 8; ++x) // 8 pixels width.
-                {
-                    int coordinate = x_coordinate + x + ((y_coordinate + y) * 64);
-                    if (coordinate >= 2048)
-                        break;
-                    if((pixel_byte & (0x80 >> x)) != 0)
-					{
-						if(m_gfx.at(coordinate) == true)
-							m_V.at(0xF) = 1;                                    
-						m_gfx.at(coordinate) ^= true;
-					}
-                }
+                case 0x9E: instruction.op = OP_SKP; break;
+                case 0xA1: instruction.op = OP_SKNP; break;
             }
-            
-            m_draw_flag = true;
             break;
         }
-        case 0xE000:
+        case 0xF000:
         {
-            switch (m_opcode & 0x00FF)
+            switch (instruction.nn)
             {
-                // case 0xEX9E
-                // Skips the next instruction if the key stored in VX is pressed.
-                case 0x009E: // SKP, Vx
-                {
-                    if (m_key.at(m_V.at((m_opcode & 0x0F00) >> 8)))
-                        m_pc += 2;
-                    break;
-                }
-                // case 0xEXA1
-                // Skips the next instruction if the key stored in VX isn't pressed.
-                case 0x00A1: //SKNP Vx
-                {
-                    if (!m_key.at(m_V.at((m_opcode & 0x0F00) >> 8)))
-                        m_pc += 2;
+                case 0x07: instruction.op = OP_LD_VX_DT; break;
+                case 0x0A: instruction.op = OP_LD_VX_K; break;
+                case 0x15: instruction.op = OP_LD_DT_VX; break;
+                case 0x18: instruction.op = OP_LD_ST_VX; break;
+                case 0x1E: instruction.op = OP_ADD_I_VX; break;
+                case 0x29: instruction.op = OP_LD_F_VX; break;
+                case 0x33: instruction.op = OP_LD_B_VX; break;
+                case 0x55: instruction.op = OP_LD_MEM_VX; break;
+                case 0x65: instruction.op = OP_LD_VX_MEM; break;
+                case 0x30: instruction.op = OP_LD_HF_VX; break;
+                case 0x75: instruction.op = OP_LD_R_VX; break;
+                case 0x85: instruction.op = OP_LD_VX_R; break;
+                case 0x01: instruction.op = OP_PLANE; break;
+                case 0x3A: instruction.op = OP_PITCH; break;
+                case 0x00:
+                    if (instruction.x == 0x0)
+                        instruction.op = OP_LD_I_LONG;
                     break;
-                }
-                default:
-                {
-                    std::cout << "Opcode " << m_opcode << " (decimal) not recognized." << std::endl;
+                case 0x02:
+                    if (instruction.x == 0x0)
+                        instruction.op = OP_AUDIO;
                     break;
-                }
             }
             break;
         }
-        case 0xF000:
+    }
+    return instruction;
+}
+
+// Skips are one word, or two with Q::LONG_SKIP when they land on F000 NNNN.
+template<class Q>
+void CHIP8::skip()
+{
+    if (Q::LONG_SKIP && m_memory[m_pc & m_memory_mask] == 0xF0 &&
+        m_memory[(m_pc + 1) & m_memory_mask] == 0x00)
+        m_pc += 4;
+    else
+        m_pc += 2;
+}
+
+void CHIP8::clearScreen()
+{
+    m_gfx.fill(0);
+    m_dirty_rows = ~0ull;
+    m_draw_flag = true;
+}
+
+// Placeholder handler of not yet decoded cache entries, never reached through fetch().
+unsigned int CHIP8::opDecode(const Instruction& instruction)
+{
+    Instruction decoded = decodeOpcode(instruction.opcode);
+    return (this->*m_handlers[decoded.op])(decoded);
+}
+
+// case 0x0NNN
+// Calls RCA 1802 program at address NNN.
+unsigned int CHIP8::opSYS(const Instruction&)
+{
+    ++m_unsupported; // Not implemented.
+    m_last_unsupported = m_pc - 2;
+    return 1;
+}
+
+// case 0x00E0
+// Clears the selected planes.
+unsigned int CHIP8::opCLS(const Instruction&)
+{
+    for (unsigned int plane = 0; plane < 2; ++plane)
+    {
+        if ((m_planes & (1 << plane)) == 0)
+            continue;
+
+        // Only rows with pixels set change.
+        std::uint64_t* row = &m_gfx[plane * PLANE_SIZE];
+        for (unsigned int y = 0; y < 64; ++y, row += SCREEN_STRIDE)
         {
-            switch (m_opcode & 0x00FF)
+            if ((row[0] | row[1]) != 0)
             {
-                // case 0xFX07
-                // Sets VX to the value of the delay timer.
-                case 0x0007: // LD Vx, DT
-                {
-                    m_V.at((m_opcode & 0x0F00) >> 8) = m_delay_timer;
-                    break;
-                }
-                // case 0xFX0A
-                // A key press is awaited, and then stored in VX.
-                case 0x000A: // LD Vx, K
-                {
-                    bool key_pressed = false;
-                    for (int i = 0; i <= 0xF; ++i)
-                    {
-                        if (m_key.at(i))
-                        {
-                            m_V.at((m_opcode & 0x0F00) >> 8) = i;
-                            key_pressed = true;
-                            break;
-                        }
-                    }
-                    if (!key_pressed)
-                    {
-                        m_pc -= 2;
-                        return false;
-                    }
-                    break;
-                }
-                // case 0xFX15
-                // Sets the delay timer to VX.
-                case 0x0015: // LD DT, Vx
-                {
-                    m_delay_timer = m_V.at((m_opcode & 0x0F00) >> 8);
-                    break;
-                }
-                // case 0xFX18
-                // Sets the sound timer to VX.
-                case 0x0018: // LD ST, Vx
-                {
-                    m_sound_timer = m_V.at((m_opcode & 0x0F00) >> 8);
-                    break;
-                }
-                // case 0xFX1E
-                // Adds VX to I. If range is overflown (> 0xFFF) set VF to 1, else set to 0.
-                case 0x001E: // ADD I, Vx
-                {
-                    // TODO: Verify how overflow is handled.
-                    if (m_I + m_V.at((m_opcode & 0x0F00) >> 8) > 0xFFF)
-                        m_V.at(0xF) = 1; // Overflow.
-                    else
-                        m_V.at(0xF) = 0; // No overflow.
+                m_dirty_rows |= 1ull << y;
+                row[0] = 0;
+                row[1] = 0;
+            }
+        }
+    }
+    m_draw_flag = true;
+    return 1;
+}
 
-                    m_I += m_V.at((m_opcode & 0x0F00) >> 8);
-                    break;
-                }
-                // case 0xFX29
-                // Sets I to the location of the sprite for the character in VX. Characters 0-F (in 
-                // hexadecimal) are represented by a 4x5 font.
-                case 0x0029: // LD F, Vx
-                {
-                    // Stored font starts at memory location 0*5 for 0x0, then the next character 0x1 is 5 steps away, ie 1*5, next is at 2*5, and so on.
-                    m_I = m_V.at((m_opcode & 0x0F00) >> 8) * 5;
-                    break;
-                }
-                // case 0xFX33
-                // Stores the binary-coded decimal representation of VX, with the most significant of three
-                // digits at the address in I, the middle digit at I plus 1, and the least significant digit at
-                // I plus 2. (In other words, take the decimal representation of VX, place the hundreds digit
-                // in memory at location in I, the ten digit location I+1, and the ones digit at location I+2.)
-                case 0x0033: // LD B, Vx
-                {
-                    m_memory.at(m_I) = (m_V.at((m_opcode & 0x0F00) >> 8) % 1000) / 100 ; // Hundreds.
-                    m_memory.at(m_I+1) = (m_V.at((m_opcode & 0x0F00) >> 8) % 100) / 10; // Tens.
-                    m_memory.at(m_I+2) = m_V.at((m_opcode & 0x0F00) >> 8) % 10; // Ones.
-                    break;
-                }
-                // case 0xFX55
-                // Stores V0 to VX in memory starting at address I. Set I to I+X+1.
-                case 0x0055: // LD [I], Vx
-                {
-                    int end = (m_opcode & 0x0F00) >> 8;
-                    for (int i = 0; i <= end; ++i)
-                        m_memory.at(m_I+i) = m_V.at(i);
-
-                    m_I += end + 1;
-                    break;
-                }
-                // case 0xFX65
-                // Fills V0 to VX with values from memory starting at address I. Set I to I+X+1.
-                case 0x0065: // LD Vx, [I]
-                {
-                    int end = (m_opcode & 0x0F00) >> 8;
-                    for (int i = 0; i <= end; ++i)
-                        m_V.at(i) = m_memory.at(m_I+i);
-                    m_I += end + 1;
-                    break;
-                }
-                default:
-                {
-                    std::cout << "Opcode " << m_opcode << " (decimal) not recognized." << std::endl;
-                    break;
-                }
+// case 0x00EE
+// Returns from a subroutine.
+unsigned int CHIP8::opRET(const Instruction&)
+{
+    m_pc = m_stack[m_sp & 0xF];
+    --m_sp;
+    return 1;
+}
+
+// case 0x1NNN
+// Jumps to address NNN.
+unsigned int CHIP8::opJP(const Instruction& instruction)
+{
+    m_pc = instruction.nnn;
+    return 1;
+}
+
+// case 0x2NNN
+// Calls subroutine at NNN.
+unsigned int CHIP8::opCALL(const Instruction& instruction)
+{
+    ++m_sp;
+    m_stack[m_sp & 0xF] = m_pc;
+    m_pc = instruction.nnn;
+    return 1;
+}
+
+// case 0x3XNN
+// Skips the next instruction if VX equals NN.
+template<class Q>
+unsigned int CHIP8::opSEByte(const Instruction& instruction)
+{
+    if (m_V[instruction.x] == instruction.nn)
+        skip<Q>();
+    return 1;
+}
+
+// case 0x4XNN
+// Skips the next instruction if VX doesn't equal NN.
+template<class Q>
+unsigned int CHIP8::opSNEByte(const Instruction& instruction)
+{
+    if (m_V[instruction.x] != instruction.nn)
+        skip<Q>();
+    return 1;
+}
+
+// case 0x5XY0
+// Skips the next instruction if VX equals VY.
+template<class Q>
+unsigned int CHIP8::opSEReg(const Instruction& instruction)
+{
+    if (m_V[instruction.x] == m_V[instruction.y])
+        skip<Q>();
+    return 1;
+}
+
+// case 0x6XNN
+// Sets VX to NN.
+unsigned int CHIP8::opLDByte(const Instruction& instruction)
+{
+    m_V[instruction.x] = instruction.nn;
+    return 1;
+}
+
+// case 0x7XNN
+// Adds NN to VX.
+unsigned int CHIP8::opADDByte(const Instruction& instruction)
+{
+    m_V[instruction.x] += instruction.nn;
+    return 1;
+}
+
+// case 0x8XY0
+// Sets VX to the value of VY.
+unsigned int CHIP8::opLDReg(const Instruction& instruction)
+{
+    m_V[instruction.x] = m_V[instruction.y];
+    return 1;
+}
+
+// case 0x8XY1
+// Sets VX to VX or VY.
+unsigned int CHIP8::opOR(const Instruction& instruction)
+{
+    m_V[instruction.x] |= m_V[instruction.y];
+    return 1;
+}
+
+// case 0x8XY2
+// Sets VX to VX bitwise AND VY.
+unsigned int CHIP8::opAND(const Instruction& instruction)
+{
+    m_V[instruction.x] &= m_V[instruction.y];
+    return 1;
+}
+
+// case 0x8XY3
+// Sets VX to VX xor VY.
+unsigned int CHIP8::opXOR(const Instruction& instruction)
+{
+    m_V[instruction.x] ^= m_V[instruction.y];
+    return 1;
+}
+
+// case 0x8XY4
+// Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
+unsigned int CHIP8::opADDReg(const Instruction& instruction)
+{
+    if (m_V[instruction.y] > (0xFF - m_V[instruction.x]))
+        m_V[0xF] = 1; // There is a carry.
+    else
+        m_V[0xF] = 0; // There is no carry.
+    m_V[instruction.x] += m_V[instruction.y];
+    return 1;
+}
+
+// case 0x8XY5
+// VY is subtracted from VX. VF is set to 0 when there's a borrow and 1 when there isn't.
+unsigned int CHIP8::opSUB(const Instruction& instruction)
+{
+    if (m_V[instruction.x] < m_V[instruction.y])
+        m_V[0xF] = 0; // There is a borrow.
+    else
+        m_V[0xF] = 1; // There is no borrow.
+    m_V[instruction.x] -= m_V[instruction.y];
+    return 1;
+}
+
+// case 0x8XY6
+// Shifts VX right by one. VF is set to the value of the least significant bit of VX before
+// the shift. With Q::SHIFT_VY, sets VX to VY shifted right by one and VF to the bit shifted out.
+template<class Q>
+unsigned int CHIP8::opSHR(const Instruction& instruction)
+{
+    if (Q::SHIFT_VY)
+    {
+        unsigned char value = m_V[instruction.y];
+        m_V[instruction.x] = value >> 1;
+        m_V[0xF] = value & 0x01;
+    }
+    else
+    {
+        m_V[0xF] = m_V[instruction.x] & 0x01;
+        m_V[instruction.x] >>= 1;
+    }
+    return 1;
+}
+
+// case 0x8XY7
+// Sets VX to VY minus VX. VF is set to 0 when there's a borrow and 1 when there isn't.
+unsigned int CHIP8::opSUBN(const Instruction& instruction)
+{
+    if (m_V[instruction.x] > m_V[instruction.y])
+        m_V[0xF] = 0; // There is a borrow.
+    else
+        m_V[0xF] = 1; // There is no borrow.
+    m_V[instruction.x] = m_V[instruction.y] - m_V[instruction.x];
+    return 1;
+}
+
+// case 0x8XYE
+// Shifts VX left by one. VF is set to the value of the most significant bit of VX before
+// the shift. With Q::SHIFT_VY, sets VX to VY shifted left by one and VF to the bit shifted out.
+template<class Q>
+unsigned int CHIP8::opSHL(const Instruction& instruction)
+{
+    if (Q::SHIFT_VY)
+    {
+        unsigned char value = m_V[instruction.y];
+        m_V[instruction.x] = value << 1;
+        m_V[0xF] = value >> 7;
+    }
+    else
+    {
+        m_V[0xF] = m_V[instruction.x] >> 7;
+        m_V[instruction.x] <<= 1;
+    }
+    return 1;
+}
+
+// case 0x9XY0
+// Skips the next instruction if VX doesn't equal VY.
+template<class Q>
+unsigned int CHIP8::opSNEReg(const Instruction& instruction)
+{
+    if (m_V[instruction.x] != m_V[instruction.y])
+        skip<Q>();
+    return 1;
+}
+
+// case 0xANNN
+// Sets I to the address NNN.
+unsigned int CHIP8::opLDI(const Instruction& instruction)
+{
+    m_I = instruction.nnn;
+    return 1;
+}
+
+// case 0xBNNN
+// Jumps to the address NNN plus V0. With Q::JUMP_VX, jumps to the address XNN plus VX.
+template<class Q>
+unsigned int CHIP8::opJPV0(const Instruction& instruction)
+{
+    m_pc = instruction.nnn + m_V[Q::JUMP_VX ? instruction.x : 0x0];
+    return 1;
+}
+
+// case 0xCXNN
+// Sets VX to a random number by generating a "random" number between 0x00 and 0xFF and then using bitwise AND with NN as mask.
+unsigned int CHIP8::opRND(const Instruction& instruction)
+{
+    int random_number = m_random.byte();
+    random_number &= instruction.nn; // Bitwise AND with NN.
+    m_V[instruction.x] = random_number;
+    return 1;
+}
+
+// case 0xDXYN
+// Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N
+// pixels. Each row of 8 pixels is read as bit-coded (with the most significant bit of each
+// byte displayed on the left) starting from memory location I; I value doesn't change
+// after the exectution of this instruction. VF is set to 1 if any screen pixels are
+// flipped from set to unset when the sprite is drawn, and to 0 if that doesn't happen.
+// DXY0 draws a 16x16 sprite, two bytes per row. With both planes selected, the sprite for
+// plane 1 follows the one for plane 0.
+// Sprites are clipped at the screen edges, or wrap around with Q::DRAW_WRAP.
+template<class Q>
+unsigned int CHIP8::opDRW(const Instruction& instruction)
+{
+    unsigned int width = m_hires ? 128 : 64;
+    unsigned int height = m_hires ? 64 : 32;
+    // DXY0 draws a 16x16 sprite with the SUPER-CHIP instructions, otherwise nothing.
+    bool large = instruction.n == 0 && Q::SCHIP_OPCODES;
+    unsigned int rows = large ? 16 : instruction.n; // Number of rows in the sprite.
+    unsigned int bytes = large ? 2 : 1; // Bytes per row of the sprite.
+
+    // Set coordinates and wrap as needed.
+    unsigned int x_coordinate = m_V[instruction.x] & (width - 1);
+    unsigned int y_coordinate = m_V[instruction.y] & (height - 1);
+
+    // Rows past the bottom of the screen are clipped, unless they wrap around to the top.
+    unsigned int visible = rows;
+    if (!Q::DRAW_WRAP && visible > height - y_coordinate)
+        visible = height - y_coordinate;
+
+    // A sprite row lands in the word holding x and spills into the next one, which is past the
+    // right edge at the end of a row: clipped, or the first word of the row with Q::DRAW_WRAP.
+    unsigned int word = x_coordinate >> 6;
+    unsigned int shift = x_coordinate & 63;
+    bool spill = shift != 0 && (Q::DRAW_WRAP || word + 1 < width / 64);
+    unsigned int next = word + 1 < width / 64 ? word + 1 : 0;
+
+    // Kept in locals, the stores to the screen could alias the members.
+    std::uint64_t collision = 0;
+    std::uint64_t dirty = 0;
+    unsigned short address = m_I;
+    unsigned short mask = m_memory_mask;
+    std::uint64_t* gfx = m_gfx.data();
+    for (unsigned int planes = m_planes; planes != 0; planes >>= 1, gfx += PLANE_SIZE)
+    {
+        if ((planes & 1) == 0)
+            continue;
+
+        for (unsigned int y = 0; y < visible; ++y) // Number of rows to draw.
+        {
+            // Line the sprite row up with the screen row.
+            std::uint64_t sprite;
+            if (bytes == 1)
+                sprite = static_cast<std::uint64_t>(m_memory[(address + y) & mask]) << 56;
+            else
+                sprite = static_cast<std::uint64_t>(m_memory[(address + y * 2) & mask] << 8 |
+                                                    m_memory[(address + y * 2 + 1) & mask]) << 48;
+
+            unsigned int row = (y_coordinate + y) & (height - 1);
+            std::uint64_t* screen_row = &gfx[row * SCREEN_STRIDE];
+            std::uint64_t sprite_row = sprite >> shift;
+            collision |= screen_row[word] & sprite_row;
+            screen_row[word] ^= sprite_row;
+            if (spill)
+            {
+                std::uint64_t rest = sprite << (64 - shift);
+                collision |= screen_row[next] & rest;
+                screen_row[next] ^= rest;
+                sprite_row |= rest;
             }
-            break;
+            if (sprite_row != 0)
+                dirty |= 1ull << row;
         }
-        default:
+        address += rows * bytes;
+    }
+    m_dirty_rows |= dirty;
+    m_V[0xF] = collision != 0; // Collision flag.
+
+    m_draw_flag = true;
+    return 1;
+}
+
+// case 0xEX9E
+// Skips the next instruction if the key stored in VX is pressed.
+template<class Q>
+unsigned int CHIP8::opSKP(const Instruction& instruction)
+{
+    if ((m_keys >> (m_V[instruction.x] & 0xF)) & 1)
+        skip<Q>();
+    return 1;
+}
+
+// case 0xEXA1
+// Skips the next instruction if the key stored in VX isn't pressed.
+template<class Q>
+unsigned int CHIP8::opSKNP(const Instruction& instruction)
+{
+    if (((m_keys >> (m_V[instruction.x] & 0xF)) & 1) == 0)
+        skip<Q>();
+    return 1;
+}
+
+// case 0xFX07
+// Sets VX to the value of the delay timer.
+unsigned int CHIP8::opLDVxDT(const Instruction& instruction)
+{
+    m_V[instruction.x] = m_delay_timer;
+    return 1;
+}
+
+// case 0xFX0A
+// A key press is awaited, and then stored in VX.
+unsigned int CHIP8::opLDVxK(const Instruction& instruction)
+{
+    for (int i = 0; i <= 0xF; ++i)
+    {
+        if ((m_keys >> i) & 1)
         {
-            std::cout << "Opcode " << m_opcode << " (decimal) not recognized." << std::endl;
-            break;
+            m_V[instruction.x] = i;
+            return 1;
         }
     }
-    return true;
-}
\ No newline at end of file
+    m_pc -= 2;
+    return 0;
+}
+
+// case 0xFX15
+// Sets the delay timer to VX.
+unsigned int CHIP8::opLDDTVx(const Instruction& instruction)
+{
+    m_delay_timer = m_V[instruction.x];
+    return 1;
+}
+
+// case 0xFX18
+// Sets the sound timer to VX.
+unsigned int CHIP8::opLDSTVx(const Instruction& instruction)
+{
+    m_sound_timer = m_V[instruction.x];
+    return 1;
+}
+
+// case 0xFX1E
+// Adds VX to I. With Q::ADD_I_CARRY, VF is set to 1 if range is overflown (> 0xFFF), else to 0.
+template<class Q>
+unsigned int CHIP8::opADDIVx(const Instruction& instruction)
+{
+    if (Q::ADD_I_CARRY)
+    {
+        if (m_I + m_V[instruction.x] > 0xFFF)
+            m_V[0xF] = 1; // Overflow.
+        else
+            m_V[0xF] = 0; // No overflow.
+    }
+
+    m_I += m_V[instruction.x];
+    return 1;
+}
+
+// case 0xFX29
+// Sets I to the location of the sprite for the character in VX. Characters 0-F (in
+// hexadecimal) are represented by a 4x5 font.
+unsigned int CHIP8::opLDFVx(const Instruction& instruction)
+{
+    // Stored font starts at memory location 0*5 for 0x0, then the next character 0x1 is 5 steps away, ie 1*5, next is at 2*5, and so on.
+    m_I = m_V[instruction.x] * 5;
+    return 1;
+}
+
+// case 0xFX33
+// Stores the binary-coded decimal representation of VX, with the most significant of three
+// digits at the address in I, the middle digit at I plus 1, and the least significant digit at
+// I plus 2. (In other words, take the decimal representation of VX, place the hundreds digit
+// in memory at location in I, the ten digit location I+1, and the ones digit at location I+2.)
+unsigned int CHIP8::opLDBVx(const Instruction& instruction)
+{
+    unsigned char value = m_V[instruction.x];
+    for (int i = 0; i < 3; ++i)
+        invalidate((m_I + i) & m_memory_mask);
+
+    m_memory[m_I & m_memory_mask] = (value % 1000) / 100; // Hundreds.
+    m_memory[(m_I + 1) & m_memory_mask] = (value % 100) / 10; // Tens.
+    m_memory[(m_I + 2) & m_memory_mask] = value % 10; // Ones.
+    return 1;
+}
+
+// case 0xFX55
+// Stores V0 to VX in memory starting at address I. With Q::INCREMENT_I, sets I to I+X+1.
+template<class Q>
+unsigned int CHIP8::opLDMemVx(const Instruction& instruction)
+{
+    int end = instruction.x;
+    for (int i = 0; i <= end; ++i)
+    {
+        invalidate((m_I + i) & m_memory_mask);
+        m_memory[(m_I + i) & m_memory_mask] = m_V[i];
+    }
+
+    if (Q::INCREMENT_I)
+        m_I += end + 1;
+    return 1;
+}
+
+// case 0xFX65
+// Fills V0 to VX with values from memory starting at address I. With Q::INCREMENT_I, sets I to
+// I+X+1.
+template<class Q>
+unsigned int CHIP8::opLDVxMem(const Instruction& instruction)
+{
+    int end = instruction.x;
+    for (int i = 0; i <= end; ++i)
+        m_V[i] = m_memory[(m_I + i) & m_memory_mask];
+    if (Q::INCREMENT_I)
+        m_I += end + 1;
+    return 1;
+}
+
+// case 0x00CN
+// Scrolls the selected planes down by N rows.
+unsigned int CHIP8::opSCD(const Instruction& instruction)
+{
+    unsigned int height = m_hires ? 64 : 32;
+    unsigned int rows = instruction.n;
+    for (unsigned int plane = 0; plane < 2; ++plane)
+    {
+        if ((m_planes & (1 << plane)) == 0)
+            continue;
+        std::uint64_t* gfx = &m_gfx[plane * PLANE_SIZE];
+        std::copy_backward(gfx, gfx + (height - rows) * SCREEN_STRIDE, gfx + height * SCREEN_STRIDE);
+        std::fill(gfx, gfx + rows * SCREEN_STRIDE, 0);
+    }
+    m_dirty_rows |= ~0ull >> (64 - height);
+    m_draw_flag = true;
+    return 1;
+}
+
+// case 0x00FB
+// Scrolls the selected planes right by 4 pixels.
+unsigned int CHIP8::opSCR(const Instruction&)
+{
+    for (unsigned int plane = 0; plane < 2; ++plane)
+    {
+        if ((m_planes & (1 << plane)) == 0)
+            continue;
+        std::uint64_t* row = &m_gfx[plane * PLANE_SIZE];
+        for (unsigned int y = 0; y < 64; ++y, row += SCREEN_STRIDE)
+        {
+            // In low resolution, the pixels shifted out of the first word leave the screen.
+            if (m_hires)
+                row[1] = row[1] >> 4 | row[0] << 60;
+            row[0] >>= 4;
+        }
+    }
+    m_dirty_rows |= ~0ull >> (m_hires ? 0 : 32);
+    m_draw_flag = true;
+    return 1;
+}
+
+// case 0x00FC
+// Scrolls the selected planes left by 4 pixels.
+unsigned int CHIP8::opSCL(const Instruction&)
+{
+    for (unsigned int plane = 0; plane < 2; ++plane)
+    {
+        if ((m_planes & (1 << plane)) == 0)
+            continue;
+        std::uint64_t* row = &m_gfx[plane * PLANE_SIZE];
+        for (unsigned int y = 0; y < 64; ++y, row += SCREEN_STRIDE)
+        {
+            // The second word is 0 in low resolution.
+            row[0] = row[0] << 4 | row[1] >> 60;
+            row[1] <<= 4;
+        }
+    }
+    m_dirty_rows |= ~0ull >> (m_hires ? 0 : 32);
+    m_draw_flag = true;
+    return 1;
+}
+
+// case 0x00FD
+// Exits the interpreter, which here means stopping at this instruction for good.
+unsigned int CHIP8::opEXIT(const Instruction&)
+{
+    m_pc -= 2;
+    return 1;
+}
+
+// case 0x00FE
+// Switches to 64 x 32 low resolution and clears the screen.
+unsigned int CHIP8::opLOW(const Instruction&)
+{
+    m_hires = false;
+    clearScreen();
+    return 1;
+}
+
+// case 0x00FF
+// Switches to 128 x 64 high resolution and clears the screen.
+unsigned int CHIP8::opHIGH(const Instruction&)
+{
+    m_hires = true;
+    clearScreen();
+    return 1;
+}
+
+// case 0xFX30
+// Sets I to the location of the sprite for the character in VX in the 8x10 font.
+unsigned int CHIP8::opLDHFVx(const Instruction& instruction)
+{
+    m_I = 0x50 + (m_V[instruction.x] & 0xF) * 10;
+    return 1;
+}
+
+// case 0xFX75
+// Stores V0 to VX in the RPL user flags.
+unsigned int CHIP8::opLDRVx(const Instruction& instruction)
+{
+    std::copy(m_V.begin(), m_V.begin() + instruction.x + 1, m_flags.begin());
+    return 1;
+}
+
+// case 0xFX85
+// Fills V0 to VX with the RPL user flags.
+unsigned int CHIP8::opLDVxR(const Instruction& instruction)
+{
+    std::copy(m_flags.begin(), m_flags.begin() + instruction.x + 1, m_V.begin());
+    return 1;
+}
+
+// case 0x00DN
+// Scrolls the selected planes up by N rows.
+unsigned int CHIP8::opSCU(const Instruction& instruction)
+{
+    unsigned int height = m_hires ? 64 : 32;
+    unsigned int rows = instruction.n;
+    for (unsigned int plane = 0; plane < 2; ++plane)
+    {
+        if ((m_planes & (1 << plane)) == 0)
+            continue;
+        std::uint64_t* gfx = &m_gfx[plane * PLANE_SIZE];
+        std::copy(gfx + rows * SCREEN_STRIDE, gfx + height * SCREEN_STRIDE, gfx);
+        std::fill(gfx + (height - rows) * SCREEN_STRIDE, gfx + height * SCREEN_STRIDE, 0);
+    }
+    m_dirty_rows |= ~0ull >> (64 - height);
+    m_draw_flag = true;
+    return 1;
+}
+
+// case 0x5XY2
+// Stores VX to VY in memory starting at address I, in descending order if X is above Y. I
+// doesn't change.
+unsigned int CHIP8::opSAVERange(const Instruction& instruction)
+{
+    int step = instruction.x <= instruction.y ? 1 : -1;
+    unsigned short address = m_I;
+    for (int i = instruction.x; ; i += step, ++address)
+    {
+        invalidate(address & m_memory_mask);
+        m_memory[address & m_memory_mask] = m_V[i];
+        if (i == instruction.y)
+            break;
+    }
+    return 1;
+}
+
+// case 0x5XY3
+// Fills VX to VY with values from memory starting at address I, in descending order if X is
+// above Y. I doesn't change.
+unsigned int CHIP8::opLOADRange(const Instruction& instruction)
+{
+    int step = instruction.x <= instruction.y ? 1 : -1;
+    unsigned short address = m_I;
+    for (int i = instruction.x; ; i += step, ++address)
+    {
+        m_V[i] = m_memory[address & m_memory_mask];
+        if (i == instruction.y)
+            break;
+    }
+    return 1;
+}
+
+// case 0xF000, 0xNNNN
+// Sets I to the 16-bit address NNNN in the word following the instruction.
+unsigned int CHIP8::opLDILong(const Instruction&)
+{
+    m_I = m_memory[m_pc & m_memory_mask] << 8 | m_memory[(m_pc + 1) & m_memory_mask];
+    m_pc += 2;
+    return 1;
+}
+
+// case 0xFN01
+// Selects the planes drawn to, scrolled and cleared, bit n of N for plane n.
+unsigned int CHIP8::opPLANE(const Instruction& instruction)
+{
+    m_planes = instruction.x & 0x3;
+    return 1;
+}
+
+// case 0xF002
+// Loads the 16 byte audio pattern from memory starting at address I.
+unsigned int CHIP8::opAUDIO(const Instruction&)
+{
+    for (int i = 0; i < 16; ++i)
+        m_pattern[i] = m_memory[(m_I + i) & m_memory_mask];
+    return 1;
+}
+
+// case 0xFX3A
+// Sets the audio pitch to VX.
+unsigned int CHIP8::opPITCH(const Instruction& instruction)
+{
+    m_pitch = m_V[instruction.x];
+    return 1;
+}
+
+unsigned int CHIP8::opUnknown(const Instruction&)
+{
+    ++m_unsupported;
+    m_last_unsupported = m_pc - 2;
+    return 1;
+}
+
+// Superinstruction 0x6XNN, 0x7XNN
+// Sets VX to NN, then adds NN to VX.
+unsigned int CHIP8::opLDADDByte(const Instruction& instruction)
+{
+    const Instruction& add = (&instruction)[1];
+    m_V[instruction.x] = instruction.nn;
+    m_V[add.x] += add.nn;
+    return 2;
+}
+
+// Superinstruction 0xANNN, 0xDXYN
+// Sets I to the address NNN, then draws the sprite at I.
+template<class Q>
+unsigned int CHIP8::opLDIDRW(const Instruction& instruction)
+{
+    m_I = instruction.nnn;
+    return 1 + opDRW<Q>((&instruction)[1]);
+}
+
+// Superinstruction 0xFX07, 0x3X00, 0x1NNN
+// One iteration of a loop waiting for the delay timer: sets VX to the delay timer and skips
+// the jump back to the start when it has reached 0.
+unsigned int CHIP8::opPollDT(const Instruction& instruction)
+{
+    m_V[instruction.x] = m_delay_timer;
+    if (m_V[instruction.x] == 0)
+        return 2; // The jump was skipped, m_pc already points past it.
+
+    m_pc = (&instruction)[2].nnn;
+    return 3;
+}
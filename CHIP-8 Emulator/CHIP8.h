@@ -1,14 +1,152 @@
 #pragma once
+#include "JIT.h"
+#include "Profile.h"
+#include "Quirks.h"
+#include "Random.h"
+#include "Recompiled.h"
+
 #include <array>
-#include <random>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 class CHIP8
 {
 public:
-    CHIP8(void);
+    // Execution engines, see engine(Engine).
+    enum Engine
+    {
+        ENGINE_INTERPRETER, // Decodes each instruction as it is executed, keeps no caches.
+        ENGINE_PREDECODED, // One predecoded instruction per dispatch.
+        // Cached basic blocks with fused superinstructions, chained from one to the next. Blocks
+        // of one or two plain instructions are stepped like ENGINE_PREDECODED.
+        ENGINE_BLOCKS,
+        ENGINE_JIT, // ENGINE_BLOCKS with hot blocks recompiled to native code, see JIT.h.
+        // The program recompiled ahead of time, see Recompiled.h. ENGINE_BLOCKS for programs
+        // without one, and in emulateBlock().
+        ENGINE_NATIVE
+    };
+    static const char* const ENGINE_NAMES[ENGINE_NATIVE + 1]; // Command line names, by Engine.
+
+    // Quirk profiles, see Quirks.h.
+    enum Quirks
+    {
+        QUIRKS_DEFAULT, // DefaultQuirks
+        QUIRKS_COSMAC, // CosmacQuirks
+        QUIRKS_SCHIP, // SchipQuirks
+        QUIRKS_XOCHIP // XochipQuirks
+    };
+    static const char* const QUIRKS_NAMES[QUIRKS_XOCHIP + 1]; // Command line names, by Quirks.
+
+    // Outcome of loadGame. A program that can't be loaded leaves the machine as it was.
+    enum LoadResult
+    {
+        LOAD_OK,
+        LOAD_UNREADABLE, // The file couldn't be opened or read.
+        LOAD_EMPTY, // Nothing to load.
+        LOAD_TOO_LARGE // Doesn't fit in memory from 0x200 on, see programCapacity().
+    };
+
+    // What the program is blocked on, see idle(). Emulating a blocked program only adds to
+    // cycles() until the reason goes away.
+    enum Idle
+    {
+        IDLE_NONE, // Running.
+        IDLE_KEY, // FX0A waiting for a key press.
+        IDLE_TIMER, // FX07, 3X00, 1NNN loop polling the delay timer until it runs out.
+        IDLE_HALTED // Jumping to itself or exited with 00FD, only changing the machine wakes it.
+    };
+
+    // Non-owning view of the screen, planes stay valid for the lifetime of the CHIP8 instance.
+    // Row y of a plane starts at word y * stride, each word holds 64 pixels with bit 63 the
+    // leftmost. The color of a pixel is its plane 0 bit plus twice its plane 1 bit, only XO-CHIP
+    // programs draw to plane 1.
+    struct FrameView
+    {
+        const std::uint64_t* planes[2];
+        unsigned int stride; // Words per row.
+        unsigned int width; // Pixels per row, 64 in low resolution and 128 in high resolution.
+        unsigned int height; // Number of rows, 32 or 64.
+    };
+
+    // Copy of the CPU registers, see registers().
+    struct Registers
+    {
+        unsigned char V[16];
+        unsigned short stack[16];
+        unsigned short I;
+        unsigned short pc;
+        unsigned short sp;
+        unsigned short keys; // Bit n is set while key n is pressed.
+        unsigned char delay_timer;
+        unsigned char sound_timer;
+    };
+
+    CHIP8(void); // Seeded from std::random_device.
+    explicit CHIP8(std::uint64_t seed); // Deterministic, the same seed gives the same CXNN results.
     ~CHIP8(void);
-    void loadGame(std::string);
-    void emulateCycle();
+    // The file is memory-mapped (see MappedFile) rather than read through a stream.
+    LoadResult loadGame(const std::string& file_name, Quirks quirks = QUIRKS_DEFAULT);
+    // Program already in memory. Both overloads pick up the recompiled program of the ROM if one
+    // was linked in.
+    LoadResult loadGame(const unsigned char* program, std::size_t size, Quirks quirks = QUIRKS_DEFAULT);
+    static std::size_t programCapacity(Quirks quirks); // Largest program for the profile, in bytes.
+    // Profiles and engines by their QUIRKS_NAMES and ENGINE_NAMES, false for an unknown name.
+    static bool parseQuirks(const std::string& name, Quirks& quirks);
+    static bool parseEngine(const std::string& name, Engine& engine);
+    // Profile of a ROM by its file's extension, in any case: .sc8 is SUPER-CHIP, .xo8 XO-CHIP and
+    // anything else the default.
+    static Quirks quirksForFile(const std::string& file_name);
+    static const char* quirksName(Quirks quirks);
+    static const char* engineName(Engine engine);
+    void emulateCycle(); // Emulates exactly one instruction.
+    void updateTimers(); // Counts the timers down, to be called at 60 Hz.
+    // Emulates one dispatch of the engine, returns instructions emulated. Under ENGINE_BLOCKS and
+    // ENGINE_JIT that can be a chain of blocks.
+    unsigned int emulateBlock();
+    unsigned int emulate(unsigned int cycles); // Emulates exactly cycles instructions.
+    void seed(std::uint64_t seed); // Reseeds the random number generator.
+    unsigned long long cycles() const; // Instructions emulated so far, including FX0A waits.
+    // Of cycles(), those idle detection accounted for without executing them. Not saved in states.
+    unsigned long long skippedCycles() const;
+    // Whether the program is blocked at the current instruction. emulate() skips over the cycles
+    // of a blocked program at once instead of executing them. The block engines notice it as soon
+    // as the program starts waiting, the predecoded engine only at the start of each call.
+    Idle idle() const;
+    unsigned int idleTicks() const; // Timer ticks until an IDLE_TIMER program wakes up, 0 otherwise.
+    // 0NNN and unknown instructions executed so far, which do nothing. Counted rather than
+    // reported as they run, for the frontend to report.
+    unsigned long long unsupported() const;
+    unsigned short lastUnsupported() const; // Address of the last one.
+
+    Engine engine() const; // Engine getter.
+    // Engine setter. Allocates the caches the engine needs and frees the ones it doesn't,
+    // ENGINE_INTERPRETER makes for the smallest instances.
+    void engine(Engine);
+    // Bytes used by this instance, its caches and the JIT's code buffer included.
+    std::size_t footprint() const;
+    Quirks quirks() const; // Quirk profile getter.
+    void quirks(Quirks); // Quirk profile setter, also set by loadGame.
+    // Program run by ENGINE_NATIVE, set by loadGame. Only used while the quirk profile is the one
+    // it was compiled for.
+    const Recompiled* recompiled() const;
+    void recompiled(const Recompiled*);
+
+    // Instrumentation, see Profile.h. Only collected when compiled with CHIP8_INSTRUMENTATION,
+    // otherwise profiling stays off. While profiling, instructions are stepped one at a time
+    // whatever the engine, so every one of them is seen.
+    bool profiling() const; // Profiling getter.
+    void profiling(bool); // Profiling setter, keeps what was collected so far.
+    const Profile& profile() const;
+    void clearProfile();
+
+    // Save states hold the whole machine, see SaveStateFormat.h for the format. Loading returns false
+    // and leaves the machine untouched if the state is malformed or of another quirk profile.
+    void saveState(std::vector<unsigned char>& state) const;
+    bool loadState(const unsigned char* state, std::size_t size);
+    bool saveState(const std::string& file_name) const;
+    bool loadState(const std::string& file_name); // The file is memory-mapped where possible.
 
     
     /* Keys are 0x0 to 0xF represented as 0 to 15. State is 0 released, 1 pressed.
@@ -20,22 +158,170 @@ public:
     */
     void setKeys(unsigned short key, bool state);
 
-    std::array<bool, 2048> gfx() const;
+    FrameView gfx() const; // Screen view, see FrameView.
+    Registers registers() const; // For observers, the registers can only be changed by loadState.
+    // Rows changed since the last clearDirtyRows(), bit n is set for row n.
+    std::uint64_t dirtyRows() const;
+    void clearDirtyRows();
     bool draw_flag() const; // Draw flag getter.
     void draw_flag(bool); // Draw flag setter.
 
+    // Sound, see Audio.h. The buzzer sounds while the sound timer is running, playing the audio
+    // pattern at the audio pitch.
+    bool buzzer() const;
+    const unsigned char* audioPattern() const; // 16 bytes, 128 one-bit samples, MSB first.
+    unsigned char audioPitch() const;
+
 private:
-    bool decodeOpcode();
+    friend class Recompiler; // Reuses decodeOpcode.
 
-    unsigned short m_opcode; // Opcode
+    void initialize(std::uint64_t seed);
+
+    // Handler index of a predecoded instruction, one per opcode (see the mnemonic on each handler).
+    enum Op
+    {
+        OP_DECODE, // Cache entry that hasn't been decoded yet.
+        OP_SYS, OP_CLS, OP_RET, OP_JP, OP_CALL,
+        OP_SE_BYTE, OP_SNE_BYTE, OP_SE_REG, OP_LD_BYTE, OP_ADD_BYTE,
+        OP_LD_REG, OP_OR, OP_AND, OP_XOR, OP_ADD_REG, OP_SUB, OP_SHR, OP_SUBN, OP_SHL,
+        OP_SNE_REG, OP_LD_I, OP_JP_V0, OP_RND, OP_DRW, OP_SKP, OP_SKNP,
+        OP_LD_VX_DT, OP_LD_VX_K, OP_LD_DT_VX, OP_LD_ST_VX, OP_ADD_I_VX, OP_LD_F_VX,
+        OP_LD_B_VX, OP_LD_MEM_VX, OP_LD_VX_MEM,
+        // SUPER-CHIP.
+        OP_SCD, OP_SCR, OP_SCL, OP_EXIT, OP_LOW, OP_HIGH, OP_LD_HF_VX, OP_LD_R_VX, OP_LD_VX_R,
+        // XO-CHIP.
+        OP_SCU, OP_SAVE_RANGE, OP_LOAD_RANGE, OP_LD_I_LONG, OP_PLANE, OP_AUDIO, OP_PITCH,
+        OP_UNKNOWN,
+        // Superinstructions fused from the instructions following them in a block.
+        OP_LD_ADD_BYTE, // 6XNN, 7XNN
+        OP_LD_I_DRW, // ANNN, DXYN
+        OP_POLL_DT, // FX07, 3X00, 1NNN jumping back to the FX07
+        OP_COUNT
+    };
+
+    // An opcode decoded once into its handler and operands, so executing it again doesn't have to
+    // mask and shift the raw opcode.
+    struct Instruction
+    {
+        unsigned short opcode; // Raw opcode, kept for diagnostics.
+        unsigned short nnn; // 0x0NNN, address.
+        unsigned char op; // Handler index, see Op.
+        unsigned char x; // 0x0X00, register.
+        unsigned char y; // 0x00Y0, register.
+        unsigned char n; // 0x000N, nibble.
+        unsigned char nn; // 0x00NN, byte.
+        unsigned char length; // Number of instructions covered, more than one for superinstructions.
+    };
+
+    // A straight run of instructions ending in a jump, call, return, skip, key wait, exit or long
+    // load. The instructions are stored in m_block_code, one entry per instruction, and a
+    // superinstruction reads the entries it covers directly after its own.
+    struct Block
+    {
+        unsigned int first; // Index of the first entry in m_block_code.
+        unsigned short entries; // Number of entries (and instructions) in the block.
+        unsigned short heat; // Times run before being handed to the JIT.
+    };
+
+    // Returns the number of instructions completed, 0 when the instruction has to be retried.
+    typedef unsigned int (CHIP8::*Handler)(const Instruction&);
+    // Handler table of quirk profile Q, indexed by Op.
+    template<class Q> static const Handler* handlers();
+
+    static Instruction decodeOpcode(unsigned short opcode);
+    // decodeOpcode with the instructions of extensions quirks doesn't have as OP_SYS or OP_UNKNOWN.
+    static Instruction decodeOpcode(unsigned short opcode, Quirks quirks);
+    // What op runs as under quirk profile Q, see Quirks.h.
+    template<class Q> static unsigned char profileOp(unsigned char op);
+    const Instruction& fetch(unsigned short address);
+    void invalidate(unsigned short address); // Memory at address was written to.
+    unsigned int step(); // Emulates one instruction.
+    unsigned int stepProfiled(); // step() recording the instruction in m_profile.
+    unsigned short word(unsigned short address) const; // Opcode at address.
+    // Finds the delay timer polling loop m_pc is in, false if there is none.
+    bool pollLoop(unsigned short& start, unsigned char& x) const;
+    // Emulates up to cycles instructions of a blocked program without executing them, returns
+    // the number emulated (0 if it isn't blocked).
+    unsigned int skipIdle(unsigned int cycles);
+
+    // Block engine.
+    unsigned int runBlock(unsigned int cycles); // Returns 0 if the next block doesn't fit in cycles.
+    unsigned int runNative(unsigned int block, unsigned int cycles); // Compiled prefix of block.
+    // JIT::Routine running handler H on the Instruction it is given.
+    template<Handler H> static void callOut(void* core, const void* instruction);
+    // Call-out routines of quirk profile Q, indexed by Op. nullptr for the instructions the JIT
+    // compiles itself or leaves to the interpreter.
+    template<class Q> static const JIT::Routine* callOuts();
+    // Runs m_recompiled, then interprets the block it stopped at if cycles are left.
+    unsigned int runRecompiled(unsigned int cycles);
+    bool translateBlock(unsigned short address);
+    static bool endsBlock(unsigned char op);
+    void flushBlocks();
+
+    template<class Q> void skip(); // Steps over the instruction at m_pc.
+    void clearScreen(); // Clears all planes, for resolution changes.
+
+    // Opcode handlers.
+    unsigned int opDecode(const Instruction&);
+    unsigned int opSYS(const Instruction&);
+    unsigned int opCLS(const Instruction&);
+    unsigned int opRET(const Instruction&);
+    unsigned int opJP(const Instruction&);
+    unsigned int opCALL(const Instruction&);
+    template<class Q> unsigned int opSEByte(const Instruction&);
+    template<class Q> unsigned int opSNEByte(const Instruction&);
+    template<class Q> unsigned int opSEReg(const Instruction&);
+    unsigned int opLDByte(const Instruction&);
+    unsigned int opADDByte(const Instruction&);
+    unsigned int opLDReg(const Instruction&);
+    unsigned int opOR(const Instruction&);
+    unsigned int opAND(const Instruction&);
+    unsigned int opXOR(const Instruction&);
+    unsigned int opADDReg(const Instruction&);
+    unsigned int opSUB(const Instruction&);
+    template<class Q> unsigned int opSHR(const Instruction&);
+    unsigned int opSUBN(const Instruction&);
+    template<class Q> unsigned int opSHL(const Instruction&);
+    template<class Q> unsigned int opSNEReg(const Instruction&);
+    unsigned int opLDI(const Instruction&);
+    template<class Q> unsigned int opJPV0(const Instruction&);
+    unsigned int opRND(const Instruction&);
+    template<class Q> unsigned int opDRW(const Instruction&);
+    template<class Q> unsigned int opSKP(const Instruction&);
+    template<class Q> unsigned int opSKNP(const Instruction&);
+    unsigned int opLDVxDT(const Instruction&);
+    unsigned int opLDVxK(const Instruction&);
+    unsigned int opLDDTVx(const Instruction&);
+    unsigned int opLDSTVx(const Instruction&);
+    template<class Q> unsigned int opADDIVx(const Instruction&);
+    unsigned int opLDFVx(const Instruction&);
+    unsigned int opLDBVx(const Instruction&);
+    template<class Q> unsigned int opLDMemVx(const Instruction&);
+    template<class Q> unsigned int opLDVxMem(const Instruction&);
+    unsigned int opSCD(const Instruction&);
+    unsigned int opSCR(const Instruction&);
+    unsigned int opSCL(const Instruction&);
+    unsigned int opEXIT(const Instruction&);
+    unsigned int opLOW(const Instruction&);
+    unsigned int opHIGH(const Instruction&);
+    unsigned int opLDHFVx(const Instruction&);
+    unsigned int opLDRVx(const Instruction&);
+    unsigned int opLDVxR(const Instruction&);
+    unsigned int opSCU(const Instruction&);
+    unsigned int opSAVERange(const Instruction&);
+    unsigned int opLOADRange(const Instruction&);
+    unsigned int opLDILong(const Instruction&);
+    unsigned int opPLANE(const Instruction&);
+    unsigned int opAUDIO(const Instruction&);
+    unsigned int opPITCH(const Instruction&);
+    unsigned int opUnknown(const Instruction&);
+    unsigned int opLDADDByte(const Instruction&);
+    template<class Q> unsigned int opLDIDRW(const Instruction&);
+    unsigned int opPollDT(const Instruction&);
+
+    // Machine state, the small registers first so the ones every instruction uses share a few
+    // cache lines.
 
-    /* Memory map
-    0x000-0x1FF - CHIP-8 interpreter (contains font set in emu)
-    0x050-0x0A0 - Used for the built in 4x5 pixel font set (0-F)
-    0x200-0xFFF - Program ROM and work RAM
-    */
-    std::array<unsigned char, 4096> m_memory; // Memory
-    
     // 8-bit general purpose CPU registers, V[0xF] is a carry flag.
     std::array<unsigned char, 16> m_V; // CPU registers.
 
@@ -44,27 +330,81 @@ private:
     // form the "effective" address of the actual data (operand).
     unsigned short m_I; // Index register (used for modifying operand addresses).
 
-    unsigned short m_pc; // program counter, between 0x000 and 0xFFF
-
-    std::array<bool, 2048> m_gfx; //Black and white screen, 2048 pixels in 64 x 32 resolution.
+    unsigned short m_pc; // program counter, between 0x000 and m_memory_mask
+    unsigned short m_memory_mask; // Q::ADDRESS_MASK of m_quirks, addresses wrap around past it.
+    unsigned short m_sp; // Stack pointer, remembers which level of the stack is used.
 
-    // Timer registers. Counts down at 60 Hz. When set above 0 they will count down to 0.
+    // Timer registers. Counts down at 60 Hz (see updateTimers). When set above 0 they will count down to 0.
     unsigned char m_delay_timer; // Used for timing of events.
     unsigned char m_sound_timer; // The system's buzzer sounds when it reaches 0.
 
-    std::array<unsigned short, 16> m_stack; // Remembers memory locations on jumps or calls of a subroutine.
-    unsigned short m_sp; // Stack pointer, remembers which level of the stack is used.
-
-    /* HEX based keypad. Layout:
+    /* HEX based keypad, bit n is set while key n is pressed. Layout:
     1 2 3 c
     4 5 6 d
     7 8 9 e
     a 0 b f
     */
-    std::array<bool, 16> m_key; // HEX based (0x0-0xF) keypad states.
+    unsigned short m_keys;
 
     bool m_draw_flag; // Indicates whether drawing should be done.
+    bool m_hires; // 128 x 64 resolution.
+    unsigned char m_planes; // Planes drawn to, scrolled and cleared, bit n is set for plane n.
+    unsigned char m_pitch; // XO-CHIP pitch, the pattern plays at 4000 * 2^((pitch - 64) / 48) Hz.
+
+    std::array<unsigned short, 16> m_stack; // Remembers memory locations on jumps or calls of a subroutine.
+    std::array<unsigned char, 16> m_flags; // SUPER-CHIP RPL user flags, FX75 and FX85.
+    std::array<unsigned char, 16> m_pattern; // XO-CHIP audio pattern, one bit per sample.
+
+    Random m_random; // Random numbers for CXNN.
+    unsigned long long m_cycles; // Instructions emulated so far.
+    unsigned long long m_skipped_cycles; // Of m_cycles, skipped by skipIdle().
+    std::uint64_t m_dirty_rows; // Rows of m_gfx changed since the last clearDirtyRows().
+
+    /* Memory map
+    0x000-0x1FF - CHIP-8 interpreter (contains font set in emu)
+    0x000-0x04F - Used for the built in 4x5 pixel font set (0-F)
+    0x050-0x0EF - Used for the built in 8x10 pixel SUPER-CHIP font set (0-F)
+    0x200-0xFFF - Program ROM and work RAM
+    0x1000-0xFFFF - More work RAM, XO-CHIP only
+    */
+    std::vector<unsigned char> m_memory; // Memory, m_memory_mask + 1 bytes.
+
+    // Screen of two planes, 64 x 32 pixels in low resolution and 128 x 64 in high resolution.
+    // Two words per row, bit 63 of the first one is x = 0. In low resolution only the first word
+    // of the first 32 rows is used, everything outside of the current resolution stays 0.
+    static const unsigned int SCREEN_STRIDE = 2; // Words per row.
+    static const unsigned int PLANE_SIZE = 64 * SCREEN_STRIDE; // Words per plane.
+    std::array<std::uint64_t, 2 * PLANE_SIZE> m_gfx;
+
+    // Caches of the engines, only allocated for the engines that use them (see engine(Engine)).
+
+    // Predecoded image of the program region 0x200-0xFFF, one entry per even address. Entries
+    // are decoded on first execution and reset to OP_DECODE when the memory under them changes.
+    // Empty with ENGINE_INTERPRETER.
+    std::vector<Instruction> m_decoded;
+    Instruction m_scratch; // Decoded instruction for addresses outside of m_decoded.
+
+    Engine m_engine;
+    Quirks m_quirks;
+    const Handler* m_handlers; // handlers() of m_quirks.
+    const JIT::Routine* m_call_outs; // callOuts() of m_quirks.
+    std::vector<Block> m_blocks;
+    std::vector<Instruction> m_block_code;
+    // Block starting at each even address of the program region, 0 if none, otherwise index + 1,
+    // with SHORT_BLOCK set for blocks ENGINE_BLOCKS steps through instead. Empty unless a block
+    // engine is selected, like m_block_memory.
+    std::vector<unsigned short> m_block_index;
+    static const unsigned short SHORT_BLOCK = 0x8000;
+    std::vector<bool> m_block_memory; // Bytes of 0x000-0xFFF that are part of a translated block.
+    bool m_flush_blocks; // A translated block was written to, flush after the running block.
+    JIT m_jit; // Native code of hot blocks, indexed like m_blocks.
+    unsigned long long m_unsupported; // See unsupported().
+    unsigned short m_last_unsupported;
+    const Recompiled* m_recompiled; // nullptr if the program wasn't recompiled.
+    // Addresses of 0x000-0xFFF where entering the native code isn't worth it, see runRecompiled.
+    // Empty unless ENGINE_NATIVE is selected.
+    std::vector<bool> m_native_cold;
 
-    std::mt19937 m_mersenne_twister;
-    std::uniform_int_distribution<int> m_distribution;
+    bool m_profiling;
+    Profile m_profile;
 };
@@ -0,0 +1,425 @@
+#include "Capture.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+    const unsigned char MAGIC[4] = { 'C', '8', 'C', 'V' };
+    const unsigned char INDEX_MAGIC[4] = { 'C', '8', 'I', 'X' };
+    const unsigned short VERSION = 1;
+    const std::size_t HEADER_SIZE = 16;
+    const std::size_t ENTRY_SIZE = 16;
+    const std::size_t FOOTER_SIZE = 24;
+    const std::size_t SCREEN_BYTES = 2 * 128 * 8;
+    const unsigned char FLAG_KEYFRAME = 1;
+    const unsigned char FLAG_HIRES = 2;
+    // A literal run only ends at this many unchanged bytes in a row, shorter gaps are cheaper to
+    // copy than to start a new run for.
+    const std::size_t MIN_GAP = 3;
+
+    void put(std::vector<unsigned char>& out, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+
+    std::uint64_t get(const unsigned char* in, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint64_t>(in[i]) << (i * 8);
+        return value;
+    }
+
+    void putVarint(std::vector<unsigned char>& out, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    // Reads a varint at position, false if it runs past end.
+    bool getVarint(const unsigned char* data, std::size_t& position, std::size_t end, std::uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && position < end; shift += 7)
+        {
+            unsigned char byte = data[position++];
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Byte i of a screen serialized as in the format, most significant byte of each word first.
+    unsigned char screenByte(const std::array<std::uint64_t, 2 * 128>& screen, std::size_t i)
+    {
+        return static_cast<unsigned char>(screen[i / 8] >> (56 - 8 * (i % 8)));
+    }
+}
+
+CaptureWriter::CaptureWriter(std::size_t queue_size): m_head(0),
+                                                      m_tail(0),
+                                                      m_dropped(0),
+                                                      m_closing(false),
+                                                      m_offset(0),
+                                                      m_records(0),
+                                                      m_previous_frame(0)
+{
+    std::size_t size = 1;
+    while (size < queue_size)
+        size <<= 1;
+    m_queue.resize(size);
+    m_mask = size - 1;
+    m_previous.fill(0);
+}
+
+CaptureWriter::~CaptureWriter(void)
+{
+    close();
+}
+
+bool CaptureWriter::open(const std::string& file_name)
+{
+    close();
+    m_file.open(file_name, std::ofstream::binary | std::ofstream::trunc);
+    if (!m_file.good())
+        return false;
+
+    std::vector<unsigned char> header(MAGIC, MAGIC + 4);
+    put(header, VERSION, 2);
+    put(header, KEYFRAME_INTERVAL, 2);
+    put(header, 0, 8);
+    m_file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    m_offset = header.size();
+    m_records.store(0, std::memory_order_relaxed);
+    m_dropped.store(0, std::memory_order_relaxed);
+    m_index.clear();
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+    m_closing.store(false, std::memory_order_relaxed);
+    m_thread = std::thread(&CaptureWriter::encode, this);
+    return true;
+}
+
+void CaptureWriter::capture(const CHIP8::FrameView& screen, std::uint64_t frame)
+{
+    if (!m_thread.joinable())
+        return;
+
+    // The indices only grow, their difference is the fill level even once they wrap around.
+    std::size_t head = m_head.load(std::memory_order_relaxed);
+    std::size_t tail = m_tail.load(std::memory_order_acquire);
+    if (head - tail == m_queue.size())
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Queued& queued = m_queue[head & m_mask];
+    queued.frame = frame;
+    queued.hires = screen.width == 128;
+    for (unsigned int plane = 0; plane < 2; ++plane)
+    {
+        for (unsigned int y = 0; y < 64; ++y)
+        {
+            queued.planes[plane * 128 + y * 2] = screen.planes[plane][y * screen.stride];
+            queued.planes[plane * 128 + y * 2 + 1] = screen.planes[plane][y * screen.stride + 1];
+        }
+    }
+    m_head.store(head + 1, std::memory_order_release);
+
+    std::lock_guard<std::mutex> lock(m_mutex); // Not between the encoder's check and its wait.
+    m_queued.notify_one();
+}
+
+bool CaptureWriter::close()
+{
+    if (!m_thread.joinable())
+        return true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closing.store(true, std::memory_order_release);
+    }
+    m_queued.notify_one();
+    m_thread.join();
+
+    std::uint64_t index_offset = m_offset;
+    put(m_index, index_offset, 8);
+    put(m_index, m_records.load(std::memory_order_relaxed), 8);
+    put(m_index, 0, 4);
+    m_index.insert(m_index.end(), INDEX_MAGIC, INDEX_MAGIC + 4);
+    m_file.write(reinterpret_cast<const char*>(m_index.data()), m_index.size());
+    m_file.close();
+    bool written = !m_file.fail();
+    m_file.clear();
+    return written;
+}
+
+std::uint64_t CaptureWriter::captured() const
+{
+    return m_records.load(std::memory_order_relaxed);
+}
+
+std::uint64_t CaptureWriter::dropped() const
+{
+    return m_dropped.load(std::memory_order_relaxed);
+}
+
+void CaptureWriter::encode()
+{
+    for (;;)
+    {
+        std::size_t tail = m_tail.load(std::memory_order_relaxed);
+        std::size_t head;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (;;)
+            {
+                // Frames queued before close() are visible once m_closing is, so none is left behind.
+                bool closing = m_closing.load(std::memory_order_acquire);
+                head = m_head.load(std::memory_order_acquire);
+                if (tail != head)
+                    break;
+                if (closing)
+                    return;
+                m_queued.wait(lock);
+            }
+        }
+        for (; tail != head; ++tail)
+        {
+            write(m_queue[tail & m_mask]);
+            m_tail.store(tail + 1, std::memory_order_release); // The slot can be reused.
+        }
+    }
+}
+
+void CaptureWriter::write(const Queued& frame)
+{
+    std::uint64_t record = m_records.load(std::memory_order_relaxed);
+    bool keyframe = record % KEYFRAME_INTERVAL == 0;
+    if (keyframe)
+    {
+        put(m_index, frame.frame, 8);
+        put(m_index, m_offset, 8);
+        m_previous.fill(0);
+        m_previous_frame = 0;
+    }
+
+    std::array<std::uint64_t, 2 * 128> changes;
+    for (std::size_t i = 0; i < changes.size(); ++i)
+        changes[i] = frame.planes[i] ^ m_previous[i];
+
+    // Alternating runs of unchanged and changed bytes over the XOR.
+    m_runs.clear();
+    std::size_t position = 0;
+    while (position < SCREEN_BYTES)
+    {
+        std::size_t start = position;
+        while (position < SCREEN_BYTES && screenByte(changes, position) == 0)
+            ++position;
+        putVarint(m_runs, position - start);
+
+        start = position;
+        std::size_t end = position; // One past the last changed byte of the run.
+        while (position < SCREEN_BYTES)
+        {
+            if (screenByte(changes, position) != 0)
+                end = ++position;
+            else if (position + 1 - end < MIN_GAP) // Unchanged bytes since end, this one included.
+                ++position;
+            else
+                break;
+        }
+        position = end;
+        putVarint(m_runs, end - start);
+        for (std::size_t i = start; i < end; ++i)
+            m_runs.push_back(screenByte(changes, i));
+    }
+
+    m_record.clear();
+    m_record.push_back(static_cast<unsigned char>((keyframe ? FLAG_KEYFRAME : 0) | (frame.hires ? FLAG_HIRES : 0)));
+    putVarint(m_record, frame.frame - m_previous_frame);
+    putVarint(m_record, m_runs.size());
+    m_record.insert(m_record.end(), m_runs.begin(), m_runs.end());
+    m_file.write(reinterpret_cast<const char*>(m_record.data()), m_record.size());
+
+    m_offset += m_record.size();
+    m_previous = frame.planes;
+    m_previous_frame = frame.frame;
+    m_records.store(record + 1, std::memory_order_relaxed);
+}
+
+CHIP8::FrameView CaptureReader::Frame::view() const
+{
+    CHIP8::FrameView view = { { &planes[0], &planes[128] }, 2, hires ? 128u : 64u, hires ? 64u : 32u };
+    return view;
+}
+
+CaptureReader::CaptureReader(void): m_interval(0),
+                                    m_records(0),
+                                    m_end(0),
+                                    m_position(0),
+                                    m_next(0)
+{
+    m_frame.frame = 0;
+    m_frame.hires = false;
+    m_frame.planes.fill(0);
+}
+
+bool CaptureReader::open(const std::string& file_name)
+{
+    close();
+    if (!m_file.open(file_name))
+        return false;
+
+    const unsigned char* data = m_file.data();
+    std::size_t size = m_file.size();
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, 4) != 0 || get(data + 4, 2) != VERSION ||
+        get(data + 6, 2) == 0)
+    {
+        m_file.close();
+        return false;
+    }
+    m_interval = static_cast<std::size_t>(get(data + 6, 2));
+
+    // The index, if the footer is there and consistent.
+    if (size >= HEADER_SIZE + FOOTER_SIZE && std::memcmp(data + size - 4, INDEX_MAGIC, 4) == 0)
+    {
+        const unsigned char* footer = data + size - FOOTER_SIZE;
+        std::uint64_t index_offset = get(footer, 8);
+        std::uint64_t records = get(footer + 8, 8);
+        std::uint64_t keyframes = (records + m_interval - 1) / m_interval;
+        if (index_offset >= HEADER_SIZE && index_offset <= size - FOOTER_SIZE &&
+            keyframes == (size - FOOTER_SIZE - index_offset) / ENTRY_SIZE &&
+            index_offset + keyframes * ENTRY_SIZE + FOOTER_SIZE == size)
+        {
+            for (std::size_t i = 0; i < keyframes; ++i)
+            {
+                std::uint64_t offset = get(data + index_offset + i * ENTRY_SIZE + 8, 8);
+                if (offset < HEADER_SIZE || offset >= index_offset)
+                    break;
+                m_keyframes.push_back(static_cast<std::size_t>(offset));
+            }
+            if (m_keyframes.size() == keyframes)
+            {
+                m_records = static_cast<std::size_t>(records);
+                m_end = static_cast<std::size_t>(index_offset);
+                m_position = HEADER_SIZE;
+                return true;
+            }
+            m_keyframes.clear();
+        }
+    }
+
+    // No usable index, the capture was cut short. Walk the records up to the first incomplete one.
+    std::size_t position = HEADER_SIZE;
+    while (position < size)
+    {
+        std::size_t start = position;
+        std::uint64_t delta = 0;
+        std::uint64_t length = 0;
+        bool keyframe = (data[position++] & FLAG_KEYFRAME) != 0;
+        if (!getVarint(data, position, size, delta) || !getVarint(data, position, size, length) ||
+            length > size - position || keyframe != (m_records % m_interval == 0))
+            break;
+        if (keyframe)
+            m_keyframes.push_back(start);
+        position += static_cast<std::size_t>(length);
+        ++m_records;
+        m_end = position;
+    }
+    m_position = HEADER_SIZE;
+    return true;
+}
+
+void CaptureReader::close()
+{
+    m_file.close();
+    m_keyframes.clear();
+    m_interval = 0;
+    m_records = 0;
+    m_end = 0;
+    m_position = 0;
+    m_next = 0;
+}
+
+std::size_t CaptureReader::size() const
+{
+    return m_records;
+}
+
+bool CaptureReader::seek(std::size_t index)
+{
+    if (index >= m_records)
+    {
+        m_next = m_records;
+        return index == m_records;
+    }
+
+    // Decode forward from the keyframe before it.
+    std::size_t keyframe = index / m_interval;
+    m_position = m_keyframes[keyframe];
+    m_next = keyframe * m_interval;
+    while (m_next < index)
+    {
+        if (!decode())
+            return false;
+    }
+    return true;
+}
+
+bool CaptureReader::next(Frame& frame)
+{
+    if (m_next >= m_records || !decode())
+        return false;
+    frame = m_frame;
+    return true;
+}
+
+bool CaptureReader::decode()
+{
+    const unsigned char* data = m_file.data();
+    std::size_t position = m_position;
+    std::uint64_t delta = 0;
+    std::uint64_t length = 0;
+    if (position >= m_end)
+        return false;
+    unsigned char flags = data[position++];
+    if (!getVarint(data, position, m_end, delta) || !getVarint(data, position, m_end, length) ||
+        length > m_end - position)
+        return false;
+    std::size_t end = position + static_cast<std::size_t>(length);
+
+    if (flags & FLAG_KEYFRAME)
+    {
+        m_frame.planes.fill(0);
+        m_frame.frame = 0;
+    }
+    m_frame.frame += delta;
+    m_frame.hires = (flags & FLAG_HIRES) != 0;
+
+    std::size_t covered = 0;
+    while (covered < SCREEN_BYTES)
+    {
+        std::uint64_t unchanged = 0;
+        std::uint64_t changed = 0;
+        if (!getVarint(data, position, end, unchanged) || !getVarint(data, position, end, changed) ||
+            unchanged + changed == 0 || unchanged > SCREEN_BYTES - covered ||
+            changed > SCREEN_BYTES - covered - unchanged || changed > end - position)
+            return false;
+        covered += static_cast<std::size_t>(unchanged);
+        for (std::size_t i = 0; i < changed; ++i, ++covered)
+            m_frame.planes[covered / 8] ^= static_cast<std::uint64_t>(data[position++]) << (56 - 8 * (covered % 8));
+    }
+
+    m_position = end;
+    ++m_next;
+    return true;
+}
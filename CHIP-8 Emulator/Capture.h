@@ -0,0 +1,141 @@
+#pragma once
+#include "CHIP8.h"
+#include "MappedFile.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Video of the presented frames. Consecutive CHIP-8 frames rarely differ in more than a few bytes,
+so each frame is stored as the XOR with the one before it, run-length encoded. Every
+KEYFRAME_INTERVAL-th frame is XORed with a blank screen instead, and an index of these keyframes at
+the end of the file lets a reader start anywhere without decoding everything before.
+
+Format, version 1. Multi-byte values are little endian, offsets are from the start of the file.
+Varints are unsigned LEB128, 7 bits per byte, low bits first, the top bit set on all but the last.
+Offset  Size    Contents
+0       4       Magic "C8CV"
+4       2       Version
+6       2       Keyframe interval K, in frames
+8       8       Reserved, 0
+16              Frames, one record each:
+                1       Flags: bit 0 keyframe, bit 1 high resolution
+                varint  Frame number, minus the one of the previous record (absolute in keyframes)
+                varint  Size of the runs
+                        Runs covering the 2048 bytes of the XORed screen (plane 0 then plane 1,
+                        64 rows of 2 words each, each word most significant byte first):
+                        varint bytes unchanged, varint bytes changed, the changed bytes
+Trailer, written on close:
+                16 * N  Index, one entry per keyframe (records 0, K, 2K, ...):
+                        0   8   Frame number
+                        8   8   Offset of the record
+                24      Footer:
+                        0   8   Offset of the index
+                        8   8   Number of records
+                        16  4   Reserved, 0
+                        20  4   Magic "C8IX"
+A capture cut short by a crash has no trailer, readers then find the records by walking them.
+*/
+class CaptureWriter
+{
+public:
+    static const unsigned int KEYFRAME_INTERVAL = 600; // 10 s of 60 Hz frames.
+
+    explicit CaptureWriter(std::size_t queue_size = 64); // Frames queued, rounded up to a power of two.
+    ~CaptureWriter(void); // Closes the capture.
+
+    // Starts a capture and the thread encoding it. Returns false if the file can't be created.
+    bool open(const std::string& file_name);
+    // Queues a copy of the screen for the encoder, numbered with frame (e.g. Scheduler::frames()).
+    // Never allocates or waits for the encoder to catch up, a frame that finds the queue full is
+    // dropped and counted. Waking the encoder takes a lock it only holds to check the queue.
+    void capture(const CHIP8::FrameView& screen, std::uint64_t frame);
+    // Encodes the frames still queued and writes the index. Returns false if anything couldn't be
+    // written, the capture is then only readable up to there.
+    bool close();
+
+    std::uint64_t captured() const; // Frames written so far.
+    std::uint64_t dropped() const; // Frames dropped because the encoder was behind.
+
+private:
+    CaptureWriter(const CaptureWriter&); // Not copyable.
+    CaptureWriter& operator=(const CaptureWriter&);
+
+    struct Queued
+    {
+        std::uint64_t frame;
+        bool hires;
+        std::array<std::uint64_t, 2 * 128> planes; // Stride 2, like CHIP8::FrameView.
+    };
+
+    void encode(); // The encoder thread, until m_closing.
+    void write(const Queued& frame);
+
+    // Single producer, single consumer ring like AudioRing, the producer only writes m_head.
+    std::vector<Queued> m_queue;
+    std::size_t m_mask; // m_queue.size() - 1.
+    std::atomic<std::size_t> m_head; // Frames queued so far.
+    std::atomic<std::size_t> m_tail; // Frames taken by the encoder so far.
+    std::atomic<std::uint64_t> m_dropped;
+    std::atomic<bool> m_closing;
+    std::mutex m_mutex; // Held by the encoder from checking the queue to waiting on m_queued.
+    std::condition_variable m_queued; // Signalled by capture() and close().
+    std::thread m_thread;
+
+    // Encoder state, only touched by the encoder thread while it runs.
+    std::ofstream m_file;
+    std::uint64_t m_offset; // Bytes written to m_file.
+    std::atomic<std::uint64_t> m_records;
+    std::uint64_t m_previous_frame;
+    std::array<std::uint64_t, 2 * 128> m_previous; // Screen of the previous record.
+    std::vector<unsigned char> m_runs; // Of the record being written.
+    std::vector<unsigned char> m_record;
+    std::vector<unsigned char> m_index; // Trailer entries so far.
+};
+
+// Reads captures written by CaptureWriter, memory-mapped.
+class CaptureReader
+{
+public:
+    struct Frame
+    {
+        std::uint64_t frame; // As given to CaptureWriter::capture.
+        bool hires;
+        std::array<std::uint64_t, 2 * 128> planes; // Stride 2, see CHIP8::FrameView.
+
+        CHIP8::FrameView view() const;
+    };
+
+    CaptureReader(void);
+
+    // Returns false if the file can't be read or isn't a capture. Without a trailer the records
+    // are walked up to the first incomplete one.
+    bool open(const std::string& file_name);
+    void close();
+
+    std::size_t size() const; // Number of frames.
+    bool seek(std::size_t index); // The next frame read is frame index.
+    bool next(Frame& frame); // Decodes the next frame, false at the end.
+
+private:
+    CaptureReader(const CaptureReader&); // Not copyable.
+    CaptureReader& operator=(const CaptureReader&);
+
+    bool decode(); // Decodes the record at m_position into m_frame, moving on to the next one.
+
+    MappedFile m_file;
+    std::size_t m_interval; // Keyframe interval.
+    std::vector<std::size_t> m_keyframes; // Offsets of the keyframe records.
+    std::size_t m_records;
+    std::size_t m_end; // End of the records, where the index starts.
+    std::size_t m_position; // Offset of the next record.
+    std::size_t m_next; // Index of the next record.
+    Frame m_frame; // The last one decoded, what the next one is XORed with.
+};
@@ -0,0 +1,183 @@
+#include "Input.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+
+namespace
+{
+    // SDL keycodes: characters are their ASCII code, function keys 1073741882 + n - 1.
+    const std::int32_t KEY_BACKSPACE = 8;
+    const std::int32_t KEY_TAB = 9;
+    const std::int32_t KEY_ESCAPE = 27;
+    const std::int32_t KEY_F5 = 1073741886;
+    const std::int32_t KEY_F9 = 1073741890;
+
+    // Default host key of each CHIP-8 key, by key.
+    const char KEYPAD[] = "x123qweasdzc4rfv";
+
+    const struct
+    {
+        std::int32_t key;
+        Keymap::Binding binding;
+    } DEFAULT_ACTIONS[] =
+    {
+        { KEY_ESCAPE, Keymap::BIND_QUIT },
+        { KEY_TAB, Keymap::BIND_TURBO },
+        { KEY_BACKSPACE, Keymap::BIND_REWIND },
+        { KEY_F5, Keymap::BIND_SAVE },
+        { KEY_F9, Keymap::BIND_LOAD }
+    };
+
+    const char* const ACTION_NAMES[] = { "quit", "turbo", "rewind", "save", "load" }; // From BIND_QUIT on.
+
+    bool parseBinding(const std::string& name, Keymap::Binding& binding)
+    {
+        if (name.size() == 1 && std::isxdigit(static_cast<unsigned char>(name[0])))
+        {
+            binding = Keymap::Binding(std::stoi(name, nullptr, 16));
+            return true;
+        }
+        for (int i = 0; i < Keymap::BIND_NONE - Keymap::BIND_QUIT; ++i)
+        {
+            if (name == ACTION_NAMES[i])
+            {
+                binding = Keymap::Binding(Keymap::BIND_QUIT + i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool byKey(const std::pair<std::int32_t, Keymap::Binding>& entry, std::int32_t key)
+    {
+        return entry.first < key;
+    }
+}
+
+Keymap::Keymap(void)
+{
+    for (int key = BIND_KEY_0; key <= BIND_KEY_F; ++key)
+        bind(KEYPAD[key], Binding(key));
+    for (std::size_t i = 0; i < sizeof(DEFAULT_ACTIONS) / sizeof(DEFAULT_ACTIONS[0]); ++i)
+        bind(DEFAULT_ACTIONS[i].key, DEFAULT_ACTIONS[i].binding);
+}
+
+Keymap::Binding Keymap::lookup(std::int32_t key) const
+{
+    std::vector<std::pair<std::int32_t, Binding> >::const_iterator entry =
+        std::lower_bound(m_bindings.begin(), m_bindings.end(), key, byKey);
+    return entry != m_bindings.end() && entry->first == key ? entry->second : BIND_NONE;
+}
+
+void Keymap::bind(std::int32_t key, Binding binding)
+{
+    std::vector<std::pair<std::int32_t, Binding> >::iterator entry =
+        std::lower_bound(m_bindings.begin(), m_bindings.end(), key, byKey);
+    if (entry != m_bindings.end() && entry->first == key)
+    {
+        if (binding == BIND_NONE)
+            m_bindings.erase(entry);
+        else
+            entry->second = binding;
+    }
+    else if (binding != BIND_NONE)
+        m_bindings.insert(entry, std::make_pair(key, binding));
+}
+
+void Keymap::clear()
+{
+    m_bindings.clear();
+}
+
+bool Keymap::load(const std::string& file_name, KeyCode code, std::string& error)
+{
+    std::ifstream file(file_name);
+    if (!file.good())
+    {
+        error = "Could not read " + file_name;
+        return false;
+    }
+
+    Keymap keymap;
+    keymap.clear();
+    std::string line;
+    for (unsigned int number = 1; std::getline(file, line); ++number)
+    {
+        std::size_t end = line.find_last_not_of(" \t\r");
+        line.erase(end == std::string::npos ? 0 : end + 1);
+        std::istringstream fields(line);
+        std::string name;
+        if (!(fields >> name) || name[0] == '#')
+            continue;
+        std::string key;
+        std::getline(fields >> std::ws, key);
+
+        Binding binding = BIND_NONE;
+        std::int32_t host_key = key.empty() ? 0 : code(key.c_str());
+        if (!parseBinding(name, binding) || host_key == 0)
+        {
+            std::ostringstream message;
+            message << file_name << ":" << number << ": expected a hex digit or quit, turbo, rewind, save or load"
+                    << " and the name of a key, got \"" << line << "\"";
+            error = message.str();
+            return false;
+        }
+        keymap.bind(host_key, binding);
+    }
+    m_bindings.swap(keymap.m_bindings);
+    return true;
+}
+
+void LatencyMeter::event(std::uint32_t time, unsigned long long frame, unsigned char key, bool pressed)
+{
+    if (m_pending.size() == MAX_PENDING)
+        m_pending.erase(m_pending.begin());
+    Pending pending = { { time, 0, key, pressed }, frame };
+    m_pending.push_back(pending);
+}
+
+void LatencyMeter::present(std::uint32_t time, unsigned long long frame)
+{
+    // Events are applied in order, so the ones shown are a prefix of m_pending.
+    std::size_t shown = 0;
+    while (shown < m_pending.size() && m_pending[shown].frame <= frame)
+    {
+        Sample sample = m_pending[shown].sample;
+        sample.present = time;
+        m_samples.push_back(sample);
+        ++shown;
+    }
+    m_pending.erase(m_pending.begin(), m_pending.begin() + shown);
+}
+
+const std::vector<LatencyMeter::Sample>& LatencyMeter::samples() const
+{
+    return m_samples;
+}
+
+std::uint32_t LatencyMeter::percentile(double fraction) const
+{
+    if (m_samples.empty())
+        return 0;
+    std::vector<std::uint32_t> latencies;
+    latencies.reserve(m_samples.size());
+    for (std::size_t i = 0; i < m_samples.size(); ++i)
+        latencies.push_back(m_samples[i].present - m_samples[i].event);
+    std::size_t index = std::min(latencies.size() - 1, static_cast<std::size_t>(fraction * latencies.size()));
+    std::nth_element(latencies.begin(), latencies.begin() + index, latencies.end());
+    return latencies[index];
+}
+
+void LatencyMeter::writeCSV(std::ostream& out) const
+{
+    out << "key,pressed,event_ms,present_ms,latency_ms\n";
+    for (std::size_t i = 0; i < m_samples.size(); ++i)
+    {
+        const Sample& sample = m_samples[i];
+        out << "0123456789ABCDEF"[sample.key & 0xF] << ',' << (sample.pressed ? 1 : 0) << ',' << sample.event << ',' << sample.present << ','
+            << sample.present - sample.event << '\n';
+    }
+}
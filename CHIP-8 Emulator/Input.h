@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/* Host keys bound to CHIP-8 keys and frontend actions. Host keys are the frontend's key codes (SDL
+keycodes in the SDL frontend), the keymap itself doesn't depend on SDL. By default the keypad is
+mapped to the left of a QWERTY keyboard:
+1 2 3 4   >>>   1 2 3 c
+q w e r   >>>   4 5 6 d
+a s d f   >>>   7 8 9 e
+z x c v   >>>   a 0 b f
+with Escape to quit, Tab to toggle fast-forward, Backspace to rewind, F5 and F9 to save and load.
+
+A keymap file replaces all of the bindings. Each line binds a key, a hex digit, or an action (quit,
+turbo, rewind, save or load) to the host key named by the rest of the line, e.g. "5 Up" or
+"quit Escape". Empty lines and lines starting with # are ignored.
+*/
+class Keymap
+{
+public:
+    enum Binding
+    {
+        BIND_KEY_0 = 0x0, // CHIP-8 keys 0x0 to 0xF bind to their own value.
+        BIND_KEY_F = 0xF,
+        BIND_QUIT,
+        BIND_TURBO, // Toggles fast-forward.
+        BIND_REWIND, // Rewinds while held.
+        BIND_SAVE, // Quick save.
+        BIND_LOAD, // Quick load.
+        BIND_NONE
+    };
+
+    // Resolves a host key name of a keymap file to its code, 0 for a name it doesn't know.
+    typedef std::int32_t (*KeyCode)(const char* name);
+
+    Keymap(void); // The default bindings.
+
+    Binding lookup(std::int32_t key) const; // BIND_NONE for an unbound key.
+    void bind(std::int32_t key, Binding binding); // BIND_NONE unbinds the key.
+    void clear(); // Unbinds every key.
+
+    // Returns false and leaves the keymap untouched if the file can't be read or a line is
+    // malformed, error then tells which one.
+    bool load(const std::string& file_name, KeyCode code, std::string& error);
+
+private:
+    std::vector<std::pair<std::int32_t, Binding> > m_bindings; // Sorted by key, for lookup().
+};
+
+/* Time from each key event to the first present showing a frame emulated with it, i.e. the input
+lag a player sees. Times are milliseconds on any clock the frontend likes, event times the ones the
+host stamped on its input events so time spent in the event queue counts as well.
+*/
+class LatencyMeter
+{
+public:
+    struct Sample
+    {
+        std::uint32_t event; // Time of the event.
+        std::uint32_t present; // Time of the present.
+        unsigned char key; // 0x0-0xF
+        bool pressed;
+    };
+
+    // A key event applied to the core, first emulated in frame (e.g. Scheduler::frames() + 1).
+    void event(std::uint32_t time, unsigned long long frame, unsigned char key, bool pressed);
+    // A present showing frames up to frame, completes the samples of the events emulated by then.
+    void present(std::uint32_t time, unsigned long long frame);
+
+    const std::vector<Sample>& samples() const;
+    // Latency below which the given fraction (0 to 1) of the samples are, in milliseconds.
+    std::uint32_t percentile(double fraction) const;
+
+    void writeCSV(std::ostream& out) const; // One sample per line.
+
+private:
+    struct Pending
+    {
+        Sample sample;
+        unsigned long long frame;
+    };
+
+    // Events not presented yet. A program that ignores keys never completes them, only the last
+    // MAX_PENDING are kept.
+    static const std::size_t MAX_PENDING = 64;
+    std::vector<Pending> m_pending;
+    std::vector<Sample> m_samples;
+};
@@ -0,0 +1,203 @@
+#include "InputLog.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <fstream>
+
+
+namespace
+{
+    const unsigned char MAGIC[4] = { 'C', '8', 'I', 'L' };
+    const unsigned short VERSION = 2;
+    const std::size_t HEADER_SIZE = 31;
+
+    void put(std::vector<unsigned char>& out, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+
+    std::uint64_t get(const unsigned char*& in, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint64_t>(in[i]) << (i * 8);
+        in += bytes;
+        return value;
+    }
+}
+
+InputLog::InputLog(void): m_seed(0),
+                          m_clock(0),
+                          m_quirks(CHIP8::QUIRKS_DEFAULT),
+                          m_end(0),
+                          m_keys(0)
+{
+}
+
+std::uint64_t InputLog::seed() const
+{
+    return m_seed;
+}
+
+void InputLog::seed(std::uint64_t seed)
+{
+    m_seed = seed;
+}
+
+unsigned int InputLog::clock() const
+{
+    return m_clock;
+}
+
+void InputLog::clock(unsigned int clock)
+{
+    m_clock = clock;
+}
+
+CHIP8::Quirks InputLog::quirks() const
+{
+    return m_quirks;
+}
+
+void InputLog::quirks(CHIP8::Quirks quirks)
+{
+    m_quirks = quirks;
+}
+
+unsigned long long InputLog::end() const
+{
+    return m_end;
+}
+
+void InputLog::end(unsigned long long cycle)
+{
+    m_end = cycle;
+}
+
+void InputLog::record(unsigned long long cycle, unsigned short key, bool pressed)
+{
+    key &= 0xF;
+    if (!m_events.empty() && cycle < m_events.back().cycle)
+        truncate(cycle);
+    if (((m_keys >> key) & 1) == pressed)
+        return;
+
+    m_keys ^= 1 << key;
+    Event event = { cycle, static_cast<unsigned char>(key), pressed };
+    m_events.push_back(event);
+    if (cycle > m_end)
+        m_end = cycle;
+}
+
+void InputLog::truncate(unsigned long long cycle)
+{
+    while (!m_events.empty() && m_events.back().cycle > cycle)
+    {
+        // Undo the change so m_keys is the key state at cycle.
+        m_keys ^= 1 << m_events.back().key;
+        m_events.pop_back();
+    }
+    if (m_end > cycle)
+        m_end = cycle;
+}
+
+void InputLog::clear()
+{
+    m_events.clear();
+    m_keys = 0;
+    m_end = 0;
+}
+
+const std::vector<InputLog::Event>& InputLog::events() const
+{
+    return m_events;
+}
+
+bool InputLog::save(const std::string& file_name) const
+{
+    std::vector<unsigned char> out;
+    out.reserve(HEADER_SIZE + m_events.size() * 3);
+    out.insert(out.end(), MAGIC, MAGIC + 4);
+    put(out, VERSION, 2);
+    put(out, m_seed, 8);
+    put(out, m_clock, 4);
+    put(out, m_quirks, 1);
+    put(out, m_end, 8);
+    put(out, m_events.size(), 4);
+
+    unsigned long long previous = 0;
+    for (std::size_t i = 0; i < m_events.size(); ++i)
+    {
+        unsigned long long delta = m_events[i].cycle - previous;
+        previous = m_events[i].cycle;
+        while (delta >= 0x80)
+        {
+            out.push_back(static_cast<unsigned char>(delta | 0x80));
+            delta >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(delta));
+        out.push_back(m_events[i].key | (m_events[i].pressed << 4));
+    }
+
+    std::ofstream file(file_name, std::ofstream::binary);
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return file.good();
+}
+
+bool InputLog::load(const std::string& file_name)
+{
+    MappedFile file;
+    if (!file.open(file_name) || file.size() < HEADER_SIZE || std::memcmp(file.data(), MAGIC, 4) != 0)
+        return false;
+    const unsigned char* in = file.data() + 4;
+    const unsigned char* last = file.data() + file.size();
+    if (get(in, 2) != VERSION)
+        return false;
+    std::uint64_t seed = get(in, 8);
+    unsigned int clock = static_cast<unsigned int>(get(in, 4));
+    std::uint64_t profile = get(in, 1);
+    unsigned long long end = get(in, 8);
+    std::size_t count = static_cast<std::size_t>(get(in, 4));
+    if (profile > CHIP8::QUIRKS_XOCHIP)
+        return false;
+    if (count > static_cast<std::size_t>(last - in) / 2) // Every event takes at least two bytes.
+        return false;
+    CHIP8::Quirks quirks = static_cast<CHIP8::Quirks>(profile);
+
+    std::vector<Event> events;
+    events.reserve(count);
+    unsigned short keys = 0;
+    unsigned long long cycle = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        unsigned long long delta = 0;
+        int shift = 0;
+        do
+        {
+            if (in == last || shift > 63)
+                return false;
+            delta |= static_cast<unsigned long long>(*in & 0x7F) << shift;
+            shift += 7;
+        } while (*in++ & 0x80);
+        if (in == last)
+            return false;
+
+        cycle += delta;
+        Event event = { cycle, static_cast<unsigned char>(*in & 0xF), (*in & 0x10) != 0 };
+        ++in;
+        if (event.pressed)
+            keys |= 1 << event.key;
+        else
+            keys &= ~(1 << event.key);
+        events.push_back(event);
+    }
+
+    m_seed = seed;
+    m_clock = clock;
+    m_quirks = quirks;
+    m_end = end;
+    m_events.swap(events);
+    m_keys = keys;
+    return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Key presses and releases stamped with the number of instructions the core had emulated when they
+were applied, see CHIP8::cycles(). Together with the random seed, the clock and the quirk profile
+this is everything a run depends on besides the ROM, so replaying the log (see Replay.h) reproduces the run exactly.
+
+File format, multi-byte values are little endian:
+Offset  Size  Contents
+0       4     Magic "C8IL"
+4       2     Version
+6       8     Random seed
+14      4     Clock, instructions per second
+18      1     Quirk profile, see CHIP8::Quirks
+19      8     Cycles emulated when the recording stopped
+27      4     Number of events
+31            Events: cycles since the previous event as a base-128 varint (low group first),
+              followed by one byte with the key in the low nibble and bit 4 set for a press.
+*/
+class InputLog
+{
+public:
+    struct Event
+    {
+        unsigned long long cycle; // CHIP8::cycles() when the key changed.
+        unsigned char key; // 0x0-0xF
+        bool pressed;
+    };
+
+    InputLog(void);
+
+    std::uint64_t seed() const; // Random seed getter.
+    void seed(std::uint64_t); // Random seed setter.
+    unsigned int clock() const; // Clock getter.
+    void clock(unsigned int); // Clock setter.
+    CHIP8::Quirks quirks() const; // Quirk profile getter.
+    void quirks(CHIP8::Quirks); // Quirk profile setter.
+    unsigned long long end() const; // Cycles at the end of the recording getter.
+    void end(unsigned long long); // Cycles at the end of the recording setter.
+
+    // Records a key change at cycle. Repeats of the key's current state are ignored, so key
+    // repeat from the host doesn't bloat the log.
+    void record(unsigned long long cycle, unsigned short key, bool pressed);
+    // Drops the events after cycle, for when the core was put back in time (rewinding, loading a
+    // state) while recording.
+    void truncate(unsigned long long cycle);
+    void clear(); // Drops all events.
+
+    const std::vector<Event>& events() const;
+
+    bool save(const std::string& file_name) const;
+    bool load(const std::string& file_name); // Leaves the log untouched if the file is malformed.
+
+private:
+    std::uint64_t m_seed;
+    unsigned int m_clock;
+    CHIP8::Quirks m_quirks;
+    unsigned long long m_end;
+    std::vector<Event> m_events; // Ordered by cycle.
+    unsigned short m_keys; // Key state after the last event, bit n for key n.
+};
@@ -0,0 +1,391 @@
+#include "JIT.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#endif
+
+
+namespace
+{
+    const unsigned int CODE_SIZE = 256 * 1024; // Size of the executable buffer.
+    const unsigned int PROLOGUE_SIZE = 51; // Saving and loading rbx and r12-r15, then the budget check.
+    const unsigned int MAX_INSTRUCTION_SIZE = 25; // Largest sequence emitted for one opcode, a call-out.
+    const unsigned int EPILOGUE_SIZE = 43; // The exit to the next block or the caller, and the bail-out.
+    const unsigned int CHAIN_SIZE = 0x1004; // Addresses a block can exit to, up to a skip from 0xFFE.
+    const unsigned int DATA_ALIGNMENT = 8; // Of the call-out data.
+}
+
+JIT::JIT(void): m_code(nullptr),
+                m_size(0)
+{
+}
+
+JIT::~JIT(void)
+{
+#ifdef JIT_X86_64
+    if (m_code != nullptr)
+        munmap(m_code, CODE_SIZE);
+#endif
+}
+
+JIT::JIT(const JIT&): m_code(nullptr),
+                      m_size(0)
+{
+}
+
+JIT& JIT::operator=(const JIT&)
+{
+    reset();
+    return *this;
+}
+
+bool JIT::available()
+{
+#ifdef JIT_X86_64
+    return true;
+#else
+    return false;
+#endif
+}
+
+unsigned int JIT::compile(unsigned int block, unsigned short address, const unsigned short* opcodes,
+                          const CallOut* call_outs, unsigned int count)
+{
+    if (block >= m_entries.size())
+    {
+        Entry empty = { nullptr, 0 };
+        m_entries.resize(block + 1, empty);
+        m_compiled.resize(block + 1, false);
+    }
+    m_compiled[block] = true;
+
+    unsigned int length = 0;
+    unsigned int data_size = 0; // Call-out data, aligned.
+    while (length < count)
+    {
+        if (call_outs[length].routine != nullptr)
+            data_size += (call_outs[length++].size + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+        else if (!supported(opcodes[length]))
+            break;
+        else if (endsBlock(opcodes[length++]))
+            break;
+    }
+    if (length == 0 || !available())
+        return 0;
+
+#ifdef JIT_X86_64
+    if (m_code == nullptr)
+    {
+        void* code = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED)
+            return 0;
+        m_code = static_cast<unsigned char*>(code);
+        m_chain.assign(CHAIN_SIZE, nullptr); // Never reallocated, the compiled code addresses it.
+    }
+    else if (!writable(true))
+        return 0;
+
+    if (m_size + DATA_ALIGNMENT + data_size + PROLOGUE_SIZE + length * MAX_INSTRUCTION_SIZE + EPILOGUE_SIZE >
+        CODE_SIZE)
+    {
+        // Out of space, start over. The other blocks get compiled again when they're run.
+        reset();
+        m_entries.resize(block + 1);
+        m_compiled.resize(block + 1, false);
+        m_compiled[block] = true;
+    }
+
+    // The call-out data goes in front of the function, in the order of the call-outs.
+    m_size = (m_size + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+    const unsigned char* data = m_code + m_size;
+    for (unsigned int i = 0; i < length; ++i)
+    {
+        if (call_outs[i].routine != nullptr)
+        {
+            std::memcpy(m_code + m_size, call_outs[i].data, call_outs[i].size);
+            m_size += (call_outs[i].size + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+        }
+    }
+
+    unsigned char* function = m_code + m_size;
+    emit(0x53); // push rbx
+    emit(0x41); emit(0x54); // push r12
+    emit(0x41); emit(0x55); // push r13
+    emit(0x41); emit(0x56); // push r14
+    emit(0x41); emit(0x57); // push r15
+    emit(0x48); emit(0x89); emit(0xFB); // mov rbx, rdi
+    emit(0x49); emit(0x89); emit(0xF4); // mov r12, rsi
+    emit(0x49); emit(0x89); emit(0xD5); // mov r13, rdx
+    emit(0x49); emit(0x89); emit(0xCE); // mov r14, rcx
+    emit(0x49); emit(0xBF); emit64(reinterpret_cast<unsigned long long>(m_chain.data())); // mov r15, m_chain
+
+    // Other blocks jump in here, with the registers already loaded.
+    unsigned char* chain_entry = m_code + m_size;
+    emit(0x41); emit(0x81); emit(0x3E); emit32(length); // cmp dword [r14], length
+    emit(0x0F); emit(0x82); // jb bail
+    unsigned int bail_jump = m_size;
+    emit32(0);
+    emit(0x41); emit(0x81); emit(0x2E); emit32(length); // sub dword [r14], length
+
+    unsigned short pc = address;
+    bool ended = false;
+    for (unsigned int i = 0; i < length; ++i, pc += 2)
+    {
+        if (call_outs[i].routine != nullptr)
+        {
+            emitCallOut(call_outs[i].routine, data);
+            data += (call_outs[i].size + DATA_ALIGNMENT - 1) & ~(DATA_ALIGNMENT - 1);
+        }
+        else
+        {
+            emitInstruction(pc, opcodes[i]);
+            ended = endsBlock(opcodes[i]);
+        }
+    }
+    if (!ended)
+    {
+        emit(0xB8); emit32(pc); // mov eax, pc
+    }
+
+    // A jump to itself is left to the caller, which skips the cycles it idles for.
+    if (length != 1 || opcodes[0] != (0x1000 | address))
+    {
+        emit(0x89); emit(0xC2); // mov edx, eax
+        emit(0x49); emit(0x8B); emit(0x0C); emit(0xD7); // mov rcx, [r15+rdx*8]
+        emit(0x48); emit(0x85); emit(0xC9); // test rcx, rcx
+        emit(0x74); emit(0x02); // jz return
+        emit(0xFF); emit(0xE1); // jmp rcx
+    }
+    emitReturn();
+
+    // Not enough of the budget left to run the block, return to the caller before it.
+    unsigned int bail = m_size;
+    m_size = bail_jump;
+    emit32(bail - (bail_jump + 4));
+    m_size = bail;
+    emit(0xB8); emit32(address); // mov eax, address
+    emitReturn();
+
+    if (!writable(false))
+        return 0;
+
+    m_chain[address] = chain_entry;
+    m_entries[block].function = reinterpret_cast<Function>(function);
+    m_entries[block].length = length;
+#endif
+    return length;
+}
+
+bool JIT::compiled(unsigned int block) const
+{
+    return block < m_compiled.size() && m_compiled[block];
+}
+
+JIT::Function JIT::function(unsigned int block) const
+{
+    return block < m_entries.size() ? m_entries[block].function : nullptr;
+}
+
+unsigned int JIT::length(unsigned int block) const
+{
+    return block < m_entries.size() ? m_entries[block].length : 0;
+}
+
+std::size_t JIT::allocated() const
+{
+    return (m_code != nullptr ? CODE_SIZE : 0) + m_entries.capacity() * sizeof(Entry) +
+           m_compiled.capacity() / 8 + m_chain.capacity() * sizeof(unsigned char*);
+}
+
+void JIT::reset()
+{
+    m_entries.clear();
+    m_compiled.clear();
+    std::fill(m_chain.begin(), m_chain.end(), nullptr);
+    m_size = 0;
+}
+
+bool JIT::supported(unsigned short opcode)
+{
+    unsigned char x = (opcode & 0x0F00) >> 8;
+    unsigned char y = (opcode & 0x00F0) >> 4;
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+        case 0x3000:
+        case 0x4000:
+        case 0x6000:
+        case 0x7000:
+        case 0xA000:
+            return true;
+        case 0x5000:
+        case 0x9000:
+            return (opcode & 0x000F) == 0x0;
+        case 0xF000:
+            return (opcode & 0x00FF) == 0x29;
+        case 0x8000:
+            switch (opcode & 0x000F)
+            {
+                case 0x0:
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    return true;
+                case 0x4:
+                case 0x5:
+                    // The interpreter sets VF before the arithmetic, don't bother matching that
+                    // ordering when VF is an operand.
+                    return x != 0xF && y != 0xF;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+bool JIT::endsBlock(unsigned short opcode)
+{
+    switch (opcode & 0xF000)
+    {
+        case 0x1000:
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void JIT::emit(unsigned char byte)
+{
+    m_code[m_size++] = byte;
+}
+
+void JIT::emit32(unsigned int value)
+{
+    for (int i = 0; i < 4; ++i)
+        emit((value >> (i * 8)) & 0xFF);
+}
+
+void JIT::emit64(unsigned long long value)
+{
+    for (int i = 0; i < 8; ++i)
+        emit((value >> (i * 8)) & 0xFF);
+}
+
+void JIT::emitInstruction(unsigned short address, unsigned short opcode)
+{
+    // ModRM byte for [rbx + disp8] with the given reg field.
+    #define RBX_DISP8(reg) (0x43 | ((reg) << 3))
+
+    unsigned char x = (opcode & 0x0F00) >> 8;
+    unsigned char y = (opcode & 0x00F0) >> 4;
+    unsigned char nn = opcode & 0x00FF;
+    unsigned short nnn = opcode & 0x0FFF;
+    unsigned char cmov = 0; // Second byte of the cmovcc selecting the skip address, 0 if not a skip.
+
+    switch (opcode & 0xF000)
+    {
+        case 0x1000: // JP addr
+        {
+            emit(0xB8); emit32(nnn); // mov eax, nnn
+            break;
+        }
+        case 0x3000: // SE Vx, byte
+        case 0x4000: // SNE Vx, byte
+        {
+            emit(0x80); emit(RBX_DISP8(7)); emit(x); emit(nn); // cmp byte [rbx+x], nn
+            cmov = (opcode & 0xF000) == 0x3000 ? 0x44 : 0x45; // cmove : cmovne
+            break;
+        }
+        case 0x5000: // SE Vx, Vy
+        case 0x9000: // SNE Vx, Vy
+        {
+            emit(0x8A); emit(RBX_DISP8(0)); emit(y); // mov al, [rbx+y]
+            emit(0x38); emit(RBX_DISP8(0)); emit(x); // cmp [rbx+x], al
+            cmov = (opcode & 0xF000) == 0x5000 ? 0x44 : 0x45;
+            break;
+        }
+        case 0x6000: // LD Vx, byte
+        {
+            emit(0xC6); emit(RBX_DISP8(0)); emit(x); emit(nn); // mov byte [rbx+x], nn
+            break;
+        }
+        case 0x7000: // ADD Vx, byte
+        {
+            emit(0x80); emit(RBX_DISP8(0)); emit(x); emit(nn); // add byte [rbx+x], nn
+            break;
+        }
+        case 0x8000:
+        {
+            // ALU opcode for op r/m8, r8 indexed by the last nibble.
+            static const unsigned char alu[] = { 0x88, 0x08, 0x20, 0x30, 0x00, 0x28 };
+            emit(0x8A); emit(RBX_DISP8(0)); emit(y); // mov al, [rbx+y]
+            emit(alu[opcode & 0x000F]); emit(RBX_DISP8(0)); emit(x); // op [rbx+x], al
+            if ((opcode & 0x000F) == 0x4)
+            {
+                emit(0x0F); emit(0x92); emit(RBX_DISP8(0)); emit(0xF); // setc [rbx+15]
+            }
+            else if ((opcode & 0x000F) == 0x5)
+            {
+                emit(0x0F); emit(0x93); emit(RBX_DISP8(0)); emit(0xF); // setnc [rbx+15]
+            }
+            break;
+        }
+        case 0xA000: // LD I, addr
+        {
+            emit(0x66); emit(0x41); emit(0xC7); emit(0x04); emit(0x24); // mov word [r12], nnn
+            emit(nnn & 0xFF); emit(nnn >> 8);
+            break;
+        }
+        case 0xF000: // LD F, Vx
+        {
+            emit(0x0F); emit(0xB6); emit(RBX_DISP8(0)); emit(x); // movzx eax, byte [rbx+x]
+            emit(0x8D); emit(0x04); emit(0x80); // lea eax, [rax+rax*4]
+            emit(0x66); emit(0x41); emit(0x89); emit(0x04); emit(0x24); // mov [r12], ax
+            break;
+        }
+    }
+
+    if (cmov != 0)
+    {
+        emit(0xB8); emit32(address + 2); // mov eax, address + 2
+        emit(0xBA); emit32(address + 4); // mov edx, address + 4
+        emit(0x0F); emit(cmov); emit(0xC2); // cmovcc eax, edx
+    }
+    #undef RBX_DISP8
+}
+
+void JIT::emitCallOut(Routine routine, const unsigned char* data)
+{
+    emit(0x4C); emit(0x89); emit(0xEF); // mov rdi, r13
+    emit(0x48); emit(0xBE); emit64(reinterpret_cast<unsigned long long>(data)); // mov rsi, data
+    emit(0x48); emit(0xB8); emit64(reinterpret_cast<unsigned long long>(routine)); // mov rax, routine
+    emit(0xFF); emit(0xD0); // call rax
+}
+
+void JIT::emitReturn()
+{
+    emit(0x41); emit(0x5F); // pop r15
+    emit(0x41); emit(0x5E); // pop r14
+    emit(0x41); emit(0x5D); // pop r13
+    emit(0x41); emit(0x5C); // pop r12
+    emit(0x5B); // pop rbx
+    emit(0xC3); // ret
+}
+
+bool JIT::writable(bool writable)
+{
+#ifdef JIT_X86_64
+    return mprotect(m_code, CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#else
+    (void)writable;
+    return false;
+#endif
+}
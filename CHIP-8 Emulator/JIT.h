@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+/* Dynamic recompiler from CHIP-8 to x86-64, only available on x86-64 Linux.
+Compiles the longest prefix of a block that it supports. 6XNN, 7XNN, 8XY0-8XY5, ANNN, FX29 and the
+jumps and skips 1NNN, 3XNN, 4XNN, 5XY0 and 9XY0 ending a block are compiled inline. Any other
+instruction the caller gives a call-out for is compiled as a direct call to the call-out's routine,
+with the call-out's data (e.g. the predecoded instruction) copied next to the code, so nothing is
+decoded at run time. The caller interprets whatever follows the prefix. Call-outs must complete at
+once and leave the program counter alone.
+
+Compiled blocks are chained: a block exits straight into the compiled block at its new program
+counter, found through a table of the compiled blocks by address, for as long as the cycle budget
+covers the whole of the next block. Control only returns to the caller at a block that isn't
+compiled, when the budget runs out, and at a block jumping to itself (so the caller sees the idle
+loop).
+
+Register use in compiled code, the call-outs only see V and I through memory:
+rbx - base of the V registers
+r12 - address of I
+r13 - context passed to the call-outs
+r14 - address of the cycle budget, counted down by each block on entry
+r15 - base of the table of blocks to chain to
+eax - program counter returned on exit
+rbx and r12-r15 are saved on entry, which also leaves the stack aligned for the call-outs.
+*/
+class JIT
+{
+public:
+    // Compiled prefix of a block and whatever it chains to, returns the new program counter.
+    // context is passed to call-outs, cycles is lowered by the instructions run, none if the block
+    // doesn't fit in it.
+    typedef unsigned int (*Function)(unsigned char* V, unsigned short* I, void* context,
+                                     unsigned int* cycles);
+    // Runs one instruction compiled as a call-out, given the copy of its data.
+    typedef void (*Routine)(void* context, const void* data);
+    struct CallOut
+    {
+        Routine routine; // nullptr if the instruction isn't called out.
+        const void* data;
+        unsigned int size; // Bytes of data.
+    };
+
+    JIT(void);
+    ~JIT(void);
+    JIT(const JIT&); // Copies start out empty, their blocks are compiled again when hot.
+    JIT& operator=(const JIT&);
+
+    static bool available(); // Whether compiled code can run on this host.
+
+    // Compiles the supported prefix of the block with the given opcodes starting at address, with
+    // one call-out per opcode. Returns the number of instructions compiled, 0 if the first one
+    // isn't supported.
+    unsigned int compile(unsigned int block, unsigned short address, const unsigned short* opcodes,
+                         const CallOut* call_outs, unsigned int count);
+    bool compiled(unsigned int block) const; // Whether compile() has been tried for block.
+    Function function(unsigned int block) const; // nullptr if nothing was compiled.
+    unsigned int length(unsigned int block) const; // Instructions covered by function(block).
+    void reset(); // Drops all compiled code.
+    // Bytes allocated: the executable buffer once mapped and the per-block tables.
+    std::size_t allocated() const;
+
+private:
+    struct Entry
+    {
+        Function function;
+        unsigned int length;
+    };
+
+    static bool supported(unsigned short opcode);
+    static bool endsBlock(unsigned short opcode);
+    void emit(unsigned char byte);
+    void emit32(unsigned int value);
+    void emit64(unsigned long long value);
+    void emitInstruction(unsigned short address, unsigned short opcode);
+    void emitCallOut(Routine routine, const unsigned char* data);
+    void emitReturn(); // Restores the saved registers and returns.
+    bool writable(bool writable); // Switches the code buffer between writable and executable.
+
+    std::vector<Entry> m_entries; // Indexed by block.
+    std::vector<bool> m_compiled; // Indexed by block.
+    std::vector<unsigned char*> m_chain; // Entry past the prologue of each address' block, or nullptr.
+    unsigned char* m_code; // Executable buffer, allocated on the first compile.
+    unsigned int m_size; // Bytes used in m_code.
+};
@@ -0,0 +1,155 @@
+#include "Machine.h"
+#include "CHIP8.h"
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <new>
+
+
+struct CHIP8Machine
+{
+    explicit CHIP8Machine(std::uint64_t seed): core(seed),
+                                               scheduler(core)
+    {
+        core.engine(CHIP8::ENGINE_INTERPRETER);
+    }
+
+    CHIP8 core;
+    Scheduler scheduler;
+};
+
+CHIP8Machine* chip8_create(uint64_t seed)
+{
+    // Nothing may throw across the C interface.
+    try
+    {
+        return new CHIP8Machine(seed);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return nullptr;
+    }
+}
+
+void chip8_destroy(CHIP8Machine* machine)
+{
+    delete machine;
+}
+
+int chip8_load(CHIP8Machine* machine, const unsigned char* program, size_t size, int quirks)
+{
+    if (quirks < CHIP8::QUIRKS_DEFAULT || quirks > CHIP8::QUIRKS_XOCHIP)
+        return 0;
+    try
+    {
+        return machine->core.loadGame(program, size, static_cast<CHIP8::Quirks>(quirks)) == CHIP8::LOAD_OK;
+    }
+    catch (const std::bad_alloc&)
+    {
+        return 0;
+    }
+}
+
+int chip8_engine(CHIP8Machine* machine, int engine)
+{
+    if (engine < CHIP8::ENGINE_INTERPRETER || engine > CHIP8::ENGINE_NATIVE)
+        return 0;
+    try
+    {
+        machine->core.engine(static_cast<CHIP8::Engine>(engine));
+    }
+    catch (const std::bad_alloc&)
+    {
+        machine->core.engine(CHIP8::ENGINE_INTERPRETER); // Needs no memory.
+        return 0;
+    }
+    return 1;
+}
+
+void chip8_clock(CHIP8Machine* machine, unsigned int clock)
+{
+    machine->scheduler.clock(clock);
+}
+
+uint64_t chip8_run(CHIP8Machine* machine, unsigned int frames)
+{
+    uint64_t instructions = 0;
+    try
+    {
+        // The caching engines allocate as they translate and compile blocks.
+        for (unsigned int i = 0; i < frames; ++i)
+            instructions += machine->scheduler.runFrame();
+    }
+    catch (const std::bad_alloc&)
+    {
+        machine->core.engine(CHIP8::ENGINE_INTERPRETER); // Needs no memory.
+    }
+    return instructions;
+}
+
+void chip8_key(CHIP8Machine* machine, unsigned int key, int pressed)
+{
+    if (key <= 0xF)
+        machine->core.setKeys(key, pressed != 0);
+}
+
+const uint64_t* chip8_screen(const CHIP8Machine* machine, unsigned int plane, unsigned int* stride,
+                             unsigned int* width, unsigned int* height)
+{
+    CHIP8::FrameView frame = machine->core.gfx();
+    if (stride != nullptr)
+        *stride = frame.stride;
+    if (width != nullptr)
+        *width = frame.width;
+    if (height != nullptr)
+        *height = frame.height;
+    return plane < 2 ? frame.planes[plane] : nullptr;
+}
+
+uint64_t chip8_dirty_rows(CHIP8Machine* machine)
+{
+    uint64_t rows = machine->core.dirtyRows();
+    machine->core.clearDirtyRows();
+    return rows;
+}
+
+int chip8_buzzer(const CHIP8Machine* machine)
+{
+    return machine->core.buzzer();
+}
+
+int chip8_idle(const CHIP8Machine* machine)
+{
+    return machine->core.idle();
+}
+
+uint64_t chip8_cycles(const CHIP8Machine* machine)
+{
+    return machine->core.cycles();
+}
+
+size_t chip8_save_state(const CHIP8Machine* machine, unsigned char* buffer, size_t capacity)
+{
+    std::vector<unsigned char> state;
+    try
+    {
+        machine->core.saveState(state);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return 0;
+    }
+    if (state.size() <= capacity)
+        std::copy(state.begin(), state.end(), buffer);
+    return state.size();
+}
+
+int chip8_load_state(CHIP8Machine* machine, const unsigned char* state, size_t size)
+{
+    return machine->core.loadState(state, size);
+}
+
+size_t chip8_footprint(const CHIP8Machine* machine)
+{
+    return sizeof(CHIP8Machine) - sizeof(CHIP8) + machine->core.footprint();
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* C interface for embedding the emulator, e.g. hosting many machines in one process or driving the
+core from another language. A machine is a core plus its 60 Hz frame pacing, behind an opaque
+handle. Machines share nothing, so every function is reentrant and different machines can run on
+different threads at the same time (one thread per machine at a time).
+
+A new machine uses ENGINE_INTERPRETER, the engine without caches, which keeps it at a few KB
+(chip8_footprint). Select a faster engine with chip8_engine where memory per machine matters less.
+Frames are only ever emulated by chip8_run, there is no wall-clock pacing in here.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CHIP8Machine CHIP8Machine;
+
+// Returns nullptr when out of memory. The seed fixes the CXNN random numbers.
+CHIP8Machine* chip8_create(uint64_t seed);
+void chip8_destroy(CHIP8Machine* machine);
+
+// quirks and engine are values of CHIP8::Quirks and CHIP8::Engine. Returns 0 for an unknown value,
+// and chip8_load also for an empty program or one too large for the profile's memory.
+int chip8_load(CHIP8Machine* machine, const unsigned char* program, size_t size, int quirks);
+int chip8_engine(CHIP8Machine* machine, int engine);
+void chip8_clock(CHIP8Machine* machine, unsigned int clock); // Instructions per second, 700 by default.
+
+// Emulates the given number of 60 Hz frames, returns the number of instructions emulated. Stops
+// early if the engine runs out of memory, which falls back to ENGINE_INTERPRETER.
+uint64_t chip8_run(CHIP8Machine* machine, unsigned int frames);
+void chip8_key(CHIP8Machine* machine, unsigned int key, int pressed); // Keys 0x0 to 0xF.
+
+// Plane 0 or 1 of the screen, see CHIP8::FrameView. Any of the out parameters may be nullptr.
+const uint64_t* chip8_screen(const CHIP8Machine* machine, unsigned int plane, unsigned int* stride,
+                             unsigned int* width, unsigned int* height);
+uint64_t chip8_dirty_rows(CHIP8Machine* machine); // Rows changed since the last call.
+int chip8_buzzer(const CHIP8Machine* machine); // Whether the buzzer sounds.
+int chip8_idle(const CHIP8Machine* machine); // A value of CHIP8::Idle.
+uint64_t chip8_cycles(const CHIP8Machine* machine);
+
+// Writes the save state to buffer if it fits in capacity bytes, returns its size either way.
+size_t chip8_save_state(const CHIP8Machine* machine, unsigned char* buffer, size_t capacity);
+// Returns 0 and leaves the machine untouched if the state is malformed or of another quirk profile.
+int chip8_load_state(CHIP8Machine* machine, const unsigned char* state, size_t size);
+
+size_t chip8_footprint(const CHIP8Machine* machine); // Bytes used by the machine.
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,21 +1,68 @@
 #include "CHIP8.h" // Cpu core implementation.
+#include "Audio.h"
+#include "Capture.h"
+#include "Input.h"
+#include "InputLog.h"
+#include "Renderer.h"
+#include "Replay.h"
+#include "Rewind.h"
+#include "Scheduler.h"
+#include "SDLAudio.h"
+#include "SharedFrames.h"
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <SDL.h>
 #include <string>
-#include <vector>
 
 
-CHIP8 CHIP8_core;
-
 const int WINDOW_WIDTH = 64;
 const int WINDOW_HEIGHT = 32;
-int WINDOW_MODIFIER = 10;
+const int WINDOW_MODIFIER = 10;
+
+// Everything one emulator window runs on, so nothing in the frontend is global.
+struct Frontend
+{
+    Frontend(void): scheduler(core),
+                    rewinding(false),
+                    replay(nullptr),
+                    shared(nullptr),
+                    shared_keys(0),
+                    capture(nullptr),
+                    latency(nullptr),
+                    window(nullptr),
+                    renderer(nullptr),
+                    audio(&silence),
+                    quit(false)
+    {
+    }
+
+    CHIP8 core;
+    Scheduler scheduler; // Runs the core in 60 Hz frames.
+    Rewind rewind_buffer; // Recording of the last frames, played back while Backspace is held.
+    bool rewinding;
+    InputLog input_log; // Key changes of this run, saved to record_file_name on exit.
+    std::string record_file_name; // Empty when not recording.
+    Replay* replay; // Plays input_log back instead of taking input when replaying.
+    SharedFrames* shared; // Frames published for other processes, nullptr unless exporting.
+    unsigned short shared_keys; // Keys of shared's input block applied so far.
+    CaptureWriter* capture; // Records the presented frames, nullptr unless capturing.
+    Keymap keymap; // What the keys of the keyboard do.
+    LatencyMeter* latency; // Input lag of the key events, nullptr unless measuring.
+
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    Renderer screen; // Streaming texture the screen is drawn through.
+    AudioSynth synth; // Sound of each emulated frame.
+    SDLAudioSink speaker;
+    NullAudioSink silence; // Used when muted or without an audio device.
+    AudioSink* audio; // Where synth writes to.
 
-SDL_Window *window = nullptr;
-SDL_Renderer *renderer = nullptr;
+    std::string state_file_name; // Quick save state, next to the ROM.
 
-bool quit = false;
-SDL_Event e; // SDL_Event is implemented as a queue with SDL_PollEvent reading the oldest event.
+    bool quit;
+};
 
 /**
 * Log an SDL error with some error messages to the output stream of our choice.
@@ -28,7 +75,7 @@ void logSDLError(std::ostream &os, const std::string &msg)
 }
 
 
-int setupSDL()
+int setupSDL(Frontend& frontend)
 {
     if (SDL_Init(SDL_INIT_EVERYTHING) != 0)
     {
@@ -38,222 +85,446 @@ int setupSDL()
         return -1;
     }
 
-    window = SDL_CreateWindow("CHIP-8 Emulator", 100, 100, WINDOW_WIDTH*WINDOW_MODIFIER,
-                              WINDOW_HEIGHT*WINDOW_MODIFIER, SDL_WINDOW_SHOWN);
-    if (window == nullptr)
+    frontend.window = SDL_CreateWindow("CHIP-8 Emulator", 100, 100, WINDOW_WIDTH*WINDOW_MODIFIER,
+                                       WINDOW_HEIGHT*WINDOW_MODIFIER, SDL_WINDOW_SHOWN);
+    if (frontend.window == nullptr)
     {
         logSDLError(std::cout, "CreateWindow");
 
-        SDL_DestroyWindow(window);
+        SDL_DestroyWindow(frontend.window);
         SDL_Quit();
         return -2;
     }
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED |
-                                  SDL_RENDERER_PRESENTVSYNC);
-    if (renderer == nullptr)
+    frontend.renderer = SDL_CreateRenderer(frontend.window, -1, SDL_RENDERER_ACCELERATED |
+                                           SDL_RENDERER_PRESENTVSYNC);
+    if (frontend.renderer == nullptr)
     {
         logSDLError(std::cout, "CreateRenderer");
 
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
+        SDL_DestroyRenderer(frontend.renderer);
+        SDL_DestroyWindow(frontend.window);
+        frontend.renderer = nullptr;
+        frontend.window = nullptr;
         SDL_Quit();
         return -3;
     }
 
-    SDL_RenderSetScale(renderer, (float)WINDOW_MODIFIER, (float)WINDOW_MODIFIER);
+    if (!frontend.screen.create(frontend.renderer))
+    {
+        logSDLError(std::cout, "CreateTexture");
+
+        SDL_DestroyRenderer(frontend.renderer);
+        SDL_DestroyWindow(frontend.window);
+        frontend.renderer = nullptr;
+        frontend.window = nullptr;
+        SDL_Quit();
+        return -4;
+    }
     return 0;
 }
 
-void draw()
+void draw(Frontend& frontend)
 {
-    auto gfx = CHIP8_core.gfx();
-    std::vector<SDL_Point> white_points;
-    std::vector<SDL_Point> black_points;
+    // Only the rows changed since the last present are uploaded.
+    frontend.screen.draw(frontend.core.gfx(), frontend.core.dirtyRows());
+    if (frontend.capture != nullptr) // Only copied here, encoded and written by the capture's thread.
+        frontend.capture->capture(frontend.core.gfx(), frontend.scheduler.frames());
+    frontend.core.draw_flag(false);
+    frontend.core.clearDirtyRows();
+    if (frontend.latency != nullptr) // The present is done, SDL_RenderPresent waits for it.
+        frontend.latency->present(SDL_GetTicks(), frontend.scheduler.frames());
+}
 
-    for (int x = 0; x < WINDOW_WIDTH; ++x)
+// Sleeps until timeout has passed or an event arrives, so input is handled as soon as it comes.
+void waitForEvent(std::chrono::microseconds timeout)
+{
+    int milliseconds = static_cast<int>(timeout.count() / 1000);
+    if (milliseconds > 0)
+        SDL_WaitEventTimeout(nullptr, milliseconds);
+}
+
+// Whether the core can only go on after a key press (or a state change from the frontend).
+bool blockedOnInput(const CHIP8& core)
+{
+    CHIP8::Idle idle = core.idle();
+    return idle == CHIP8::IDLE_KEY || idle == CHIP8::IDLE_HALTED;
+}
+
+void setKey(Frontend& frontend, unsigned short key, bool state)
+{
+    if (frontend.replay != nullptr) // Keys come from the log.
+        return;
+    frontend.core.setKeys(key, state);
+    frontend.input_log.record(frontend.core.cycles(), key, state);
+}
+
+// The core was put back in time by rewinding or loading a state.
+void resyncInput(Frontend& frontend)
+{
+    if (frontend.replay != nullptr)
     {
-        for (int y = 0; y < WINDOW_HEIGHT; ++y)
-        {
-            if (gfx.at(x+y*WINDOW_WIDTH))
-            {
-                white_points.emplace_back();
-                white_points.back().x = x;
-                white_points.back().y = y;
-            }
-            else
-            {
-                black_points.emplace_back();
-                black_points.back().x = x;
-                black_points.back().y = y;
-            }
-        }
+        frontend.replay->seek(frontend.core);
+        frontend.replay->apply(frontend.core);
     }
+    else
+        frontend.input_log.truncate(frontend.core.cycles());
+}
 
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255); // White.
-    SDL_RenderDrawPoints(renderer, white_points.data(), white_points.size());
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255); // Black.
-    SDL_RenderDrawPoints(renderer, black_points.data(), black_points.size());
-
-    SDL_RenderPresent(renderer);
-    CHIP8_core.draw_flag(false);
+// Applies the keys other processes changed in the shared input block, like keys of the keyboard.
+void handleSharedInput(Frontend& frontend)
+{
+    unsigned short keys = frontend.shared->keys();
+    unsigned short changed = keys ^ frontend.shared_keys;
+    for (unsigned short key = 0; key < 16; ++key)
+    {
+        if (changed & 1 << key)
+            setKey(frontend, key, (keys >> key & 1) != 0);
+    }
+    frontend.shared_keys = keys;
 }
 
-void handleInput()
+void handleEvent(Frontend& frontend, const SDL_Event& e)
 {
-    // SDL_PollEvent reads the oldest event on the event queue.
-    while (SDL_PollEvent(&e) != 0 )
+    if (e.type == SDL_QUIT) // "Xsing out of the window", ie pressing top right X button.
     {
-        if (e.type == SDL_QUIT) // "Xsing out of the window", ie pressing top right X button.
-            quit = true;
-        else if (e.type == SDL_KEYDOWN)
-        {
-            switch (e.key.keysym.sym)
-            {
-            case 27:
-                quit = true;
-                break;
-            case 49: // 1
-                CHIP8_core.setKeys(0x1, true);
-                break;
-            case 50: // 2
-                CHIP8_core.setKeys(0x2, true);
-                break;
-            case 51: // 3
-                CHIP8_core.setKeys(0x3, true);
-                break;
-            case 52: // 4
-                CHIP8_core.setKeys(0xC, true);
-                break;
-            case 113: // q
-                CHIP8_core.setKeys(0x4, true);
-                break;
-            case 119: // w
-                CHIP8_core.setKeys(0x5, true);
-                break;
-            case 101: // e
-                CHIP8_core.setKeys(0x6, true);
-                break;
-            case 114: // r
-                CHIP8_core.setKeys(0xD, true);
-                break;
-            case 97: // a
-                CHIP8_core.setKeys(0x7, true);
-                break;
-            case 115: // s
-                CHIP8_core.setKeys(0x8, true);
-                break;
-            case 100: // d
-                CHIP8_core.setKeys(0x9, true);
-                break;
-            case 102: // f
-                CHIP8_core.setKeys(0xE, true);
-                break;
-            case 122: // z
-                CHIP8_core.setKeys(0xA, true);
-                break;
-            case 120: // x
-                CHIP8_core.setKeys(0x0, true);
-                break;
-            case 99: // c
-                CHIP8_core.setKeys(0xB, true);
-                break;
-            case 118: // v
-                CHIP8_core.setKeys(0xF, true);
-                break;
-            default:
-                break;
-            }
-        }
-        else if (e.type == SDL_KEYUP)
+        frontend.quit = true;
+        return;
+    }
+    if ((e.type != SDL_KEYDOWN && e.type != SDL_KEYUP) || e.key.repeat != 0)
+        return;
+
+    bool pressed = e.type == SDL_KEYDOWN;
+    Keymap::Binding binding = frontend.keymap.lookup(e.key.keysym.sym);
+    if (binding <= Keymap::BIND_KEY_F)
+    {
+        setKey(frontend, static_cast<unsigned short>(binding), pressed);
+        // The key is first seen by the frame after the current one.
+        if (frontend.latency != nullptr && frontend.replay == nullptr)
+            frontend.latency->event(e.key.timestamp, frontend.scheduler.frames() + 1,
+                                    static_cast<unsigned char>(binding), pressed);
+        return;
+    }
+
+    switch (binding)
+    {
+    case Keymap::BIND_QUIT:
+        if (pressed)
+            frontend.quit = true;
+        break;
+    case Keymap::BIND_TURBO: // Toggles fast-forward.
+        if (pressed)
+            frontend.scheduler.turbo(!frontend.scheduler.turbo());
+        break;
+    case Keymap::BIND_REWIND: // Rewinds while held.
+        frontend.rewinding = pressed;
+        if (!pressed)
+            resyncInput(frontend);
+        break;
+    case Keymap::BIND_SAVE:
+        if (pressed && !frontend.core.saveState(frontend.state_file_name))
+            std::cout << "Could not write " << frontend.state_file_name << std::endl;
+        break;
+    case Keymap::BIND_LOAD:
+        if (pressed)
         {
-            switch (e.key.keysym.sym)
-            {
-            case 49: // 1
-                CHIP8_core.setKeys(0x1, false);
-                break;
-            case 50: // 2
-                CHIP8_core.setKeys(0x2, false);
-                break;
-            case 51: // 3
-                CHIP8_core.setKeys(0x3, false);
-                break;
-            case 52: // 4
-                CHIP8_core.setKeys(0xC, false);
-                break;
-            case 113: // q
-                CHIP8_core.setKeys(0x4, false);
-                break;
-            case 119: // w
-                CHIP8_core.setKeys(0x5, false);
-                break;
-            case 101: // e
-                CHIP8_core.setKeys(0x6, false);
-                break;
-            case 114: // r
-                CHIP8_core.setKeys(0xD, false);
-                break;
-            case 97: // a
-                CHIP8_core.setKeys(0x7, false);
-                break;
-            case 115: // s
-                CHIP8_core.setKeys(0x8, false);
-                break;
-            case 100: // d
-                CHIP8_core.setKeys(0x9, false);
-                break;
-            case 102: // f
-                CHIP8_core.setKeys(0xE, false);
-                break;
-            case 122: // z
-                CHIP8_core.setKeys(0xA, false);
-                break;
-            case 120: // x
-                CHIP8_core.setKeys(0x0, false);
-                break;
-            case 99: // c
-                CHIP8_core.setKeys(0xB, false);
-                break;
-            case 118: // v
-                CHIP8_core.setKeys(0xF, false);
-                break;
-            default:
-                break;
-            }
+            if (!frontend.core.loadState(frontend.state_file_name))
+                std::cout << "Could not load " << frontend.state_file_name << std::endl;
+            resyncInput(frontend);
         }
+        break;
+    default:
+        break;
+    }
+}
+
+// Handles the events that arrived since the last call, once per pass of the emulation loop. They
+// are taken off SDL's queue a batch at a time rather than one call each.
+void handleInput(Frontend& frontend)
+{
+    const int BATCH = 32;
+    SDL_Event events[BATCH];
+    SDL_PumpEvents();
+    int count = 0;
+    while ((count = SDL_PeepEvents(events, BATCH, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT)) > 0)
+    {
+        for (int i = 0; i < count; ++i)
+            handleEvent(frontend, events[i]);
     }
 }
 
 int main(int argc, char **argv)
 {
+    Frontend frontend;
+
     // Check correct argument usage.
-    if (argc <= 1)
+    const char* file_name = nullptr;
+    std::uint64_t seed = std::random_device()();
+    std::string replay_file_name;
+    std::string profile_file_name;
+    std::string shared_name;
+    std::string capture_file_name;
+    std::string keymap_file_name;
+    std::string latency_file_name;
+    CHIP8::Quirks quirks = CHIP8::QUIRKS_DEFAULT;
+    bool quirks_given = false; // Otherwise the ROM's extension picks the profile.
+    bool mute = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 8, "--clock=") == 0) // Instructions per second.
+            frontend.scheduler.clock(std::atoi(argument.c_str() + 8));
+        else if (argument == "--turbo") // Start fast-forwarding.
+            frontend.scheduler.turbo(true);
+        else if (argument.compare(0, 12, "--frameskip=") == 0) // Frames per present when fast-forwarding.
+            frontend.scheduler.frame_skip(std::atoi(argument.c_str() + 12));
+        else if (argument.compare(0, 9, "--rewind=") == 0) // Rewind buffer size in MB.
+            frontend.rewind_buffer.budget(static_cast<std::size_t>(std::atoi(argument.c_str() + 9)) * 1024 * 1024);
+        else if (argument.compare(0, 7, "--seed=") == 0) // Random seed, for reproducible runs.
+            seed = std::strtoull(argument.c_str() + 7, nullptr, 0);
+        else if (argument.compare(0, 9, "--record=") == 0) // Input log to write on exit.
+            frontend.record_file_name = argument.substr(9);
+        else if (argument.compare(0, 9, "--replay=") == 0) // Input log to play back.
+            replay_file_name = argument.substr(9);
+        else if (argument.compare(0, 10, "--profile=") == 0) // Profile to write on exit.
+            profile_file_name = argument.substr(10);
+        else if (argument.compare(0, 6, "--shm=") == 0) // Shared memory object to publish frames to.
+            shared_name = argument.substr(6);
+        else if (argument.compare(0, 10, "--capture=") == 0) // Video of the presented frames.
+            capture_file_name = argument.substr(10);
+        else if (argument.compare(0, 9, "--keymap=") == 0) // Key bindings, see Keymap.
+            keymap_file_name = argument.substr(9);
+        else if (argument.compare(0, 10, "--latency=") == 0) // Input lag of each key event to write on exit.
+            latency_file_name = argument.substr(10);
+        else if (argument == "--mute") // No audio device.
+            mute = true;
+        else if (argument.compare(0, 9, "--quirks=") == 0) // Behaviour of the variant the ROM was written for.
+        {
+            quirks_given = CHIP8::parseQuirks(argument.substr(9), quirks);
+            if (!quirks_given)
+                std::cout << "Unknown quirk profile " << argument.substr(9) << std::endl;
+        }
+        else
+            file_name = argv[i];
+    }
+    if (file_name == nullptr)
     {
         std::cout << "Program must take an argument, the full path to the file to be loaded." << std::endl;
+        std::cout << "Options: --clock=N (instructions per second, default " << frontend.scheduler.clock() << ")" << std::endl;
+        std::cout << "         --turbo (start fast-forwarding, toggled with Tab)" << std::endl;
+        std::cout << "         --frameskip=N (frames per present when fast-forwarding, 0 for none, default "
+                  << frontend.scheduler.frame_skip() << ")" << std::endl;
+        std::cout << "         --rewind=N (MB kept for rewinding with Backspace, 0 to disable, default "
+                  << frontend.rewind_buffer.budget() / (1024 * 1024) << ")" << std::endl;
+        std::cout << "         --quirks=NAME (cosmac, schip, xochip or default, by default schip for .sc8 files, xochip"
+                  << " for .xo8 files and this emulator's own otherwise)" << std::endl;
+        std::cout << "         --seed=N (random seed, random by default)" << std::endl;
+        std::cout << "         --record=FILE (write the input of this run to FILE on exit)" << std::endl;
+        std::cout << "         --replay=FILE (play back the input recorded in FILE)" << std::endl;
+        std::cout << "         --profile=FILE (write execution statistics to FILE on exit, JSON or .csv)" << std::endl;
+        std::cout << "         --shm=NAME (publish every frame to the shared memory object NAME and take keys from it)"
+                  << std::endl;
+        std::cout << "         --capture=FILE (record the presented frames to FILE, see chip8-capture)" << std::endl;
+        std::cout << "         --keymap=FILE (key bindings, lines of a hex digit or action and a key name, see Input.h)"
+                  << std::endl;
+        std::cout << "         --latency=FILE (write the time from each key event to its present to FILE on exit, CSV)"
+                  << std::endl;
+        std::cout << "         --mute (no sound)" << std::endl;
         return 0;
     }
+    if (!quirks_given)
+        quirks = CHIP8::quirksForFile(file_name);
 
-    // Set up SDL.
-    setupSDL();
+    // A replay takes its seed and clock from the log, so it runs exactly like the recording.
+    if (!replay_file_name.empty())
+    {
+        if (!frontend.input_log.load(replay_file_name))
+        {
+            std::cout << "Could not load " << replay_file_name << std::endl;
+            return 0;
+        }
+        seed = frontend.input_log.seed();
+        frontend.scheduler.clock(frontend.input_log.clock());
+        quirks = frontend.input_log.quirks();
+    }
 
     // Load the program into memory.
-    CHIP8_core.loadGame(argv[1]);
-    
-    // Emulation loop
-    while(!quit)
+    switch (frontend.core.loadGame(file_name, quirks))
+    {
+        case CHIP8::LOAD_OK:
+            break;
+        case CHIP8::LOAD_UNREADABLE:
+            std::cout << "Could not read " << file_name << std::endl;
+            return 0;
+        case CHIP8::LOAD_EMPTY:
+            std::cout << file_name << " is empty" << std::endl;
+            return 0;
+        case CHIP8::LOAD_TOO_LARGE:
+            std::cout << file_name << " is larger than the " << CHIP8::programCapacity(quirks)
+                      << " bytes of memory available to programs" << std::endl;
+            return 0;
+    }
+
+    // Set up SDL.
+    if (setupSDL(frontend) != 0)
+        return 0;
+    if (!keymap_file_name.empty())
+    {
+        std::string error;
+        if (!frontend.keymap.load(keymap_file_name, SDL_GetKeyFromName, error))
+            std::cout << error << std::endl;
+    }
+    if (!mute)
+    {
+        if (frontend.speaker.open())
+            frontend.audio = &frontend.speaker;
+        else
+            logSDLError(std::cout, "OpenAudioDevice");
+    }
+
+    frontend.core.seed(seed);
+    frontend.state_file_name = std::string(file_name) + ".state";
+    frontend.core.engine(CHIP8::ENGINE_NATIVE); // Blocks, unless the ROM was recompiled and linked in.
+    if (!profile_file_name.empty())
+    {
+        frontend.core.profiling(true);
+        if (!frontend.core.profiling())
+            std::cout << "Profiling needs a build with CHIP8_INSTRUMENTATION defined" << std::endl;
+    }
+    SharedFrames exporter;
+    if (!shared_name.empty())
+    {
+        if (exporter.create(shared_name))
+            frontend.shared = &exporter;
+        else
+            std::cout << "Could not create the shared memory object " << shared_name << std::endl;
+    }
+    LatencyMeter meter;
+    if (!latency_file_name.empty())
+        frontend.latency = &meter;
+    CaptureWriter recorder;
+    if (!capture_file_name.empty())
+    {
+        if (recorder.open(capture_file_name))
+            frontend.capture = &recorder;
+        else
+            std::cout << "Could not write " << capture_file_name << std::endl;
+    }
+    frontend.scheduler.onFrame([&frontend]()
+    {
+        frontend.rewind_buffer.record(frontend.core);
+        frontend.synth.frame(frontend.core, *frontend.audio);
+        if (frontend.shared != nullptr)
+        {
+            frontend.shared->publish(frontend.core, frontend.scheduler.frames());
+            handleSharedInput(frontend);
+        }
+        if (frontend.replay != nullptr) // Input for the next frame.
+            frontend.replay->apply(frontend.core);
+    });
+
+    Replay player(frontend.input_log);
+    if (!replay_file_name.empty())
+    {
+        frontend.replay = &player;
+        frontend.replay->apply(frontend.core);
+    }
+    else
     {
-        // Emulate one cycle.
-        CHIP8_core.emulateCycle();
-        // If the draw flag is set, update the screen.
-        if (CHIP8_core.draw_flag())
-            draw();
+        frontend.input_log.seed(seed);
+        frontend.input_log.clock(frontend.scheduler.clock());
+        frontend.input_log.quirks(quirks);
+    }
 
+    // Emulation loop
+    while(!frontend.quit)
+    {
         // Store key press state (press and release).
-        handleInput();
+        handleInput(frontend);
+
+        // While rewinding, step back one recorded frame per frame instead of emulating.
+        if (frontend.rewinding && !frontend.scheduler.turbo())
+        {
+            unsigned int frames = frontend.scheduler.due();
+            bool rewound = false;
+            for (unsigned int i = 0; i < frames; ++i)
+                rewound = frontend.rewind_buffer.rewind(frontend.core) || rewound;
+            if (rewound)
+                draw(frontend);
+            else
+                waitForEvent(frontend.scheduler.untilNextFrame());
+            continue;
+        }
+
+        // Emulate the frames that are due. Presenting waits for vsync, so the screen is presented
+        // at most once per display refresh whatever the clock is. Fast-forwarding a program that
+        // waits for a key would only spin the host, its frames are paced as usual until the key
+        // comes (unless replaying, the keys are in the log then).
+        bool paced = !frontend.scheduler.turbo() || (frontend.replay == nullptr && blockedOnInput(frontend.core));
+        unsigned int frames = 0;
+        if (paced)
+        {
+            frames = frontend.scheduler.due();
+            for (unsigned int i = 0; i < frames; ++i)
+                frontend.scheduler.runFrame();
+        }
+        else
+            frames = frontend.scheduler.runDue();
+
+        bool present = frames > 0 && (frontend.scheduler.present() || paced);
+        if (present && frontend.core.draw_flag())
+            draw(frontend);
+        else if (paced)
+            waitForEvent(frontend.scheduler.untilNextFrame());
+    }
+
+    if (!frontend.record_file_name.empty())
+    {
+        frontend.input_log.end(frontend.core.cycles());
+        if (!frontend.input_log.save(frontend.record_file_name))
+            std::cout << "Could not write " << frontend.record_file_name << std::endl;
+    }
+
+    if (frontend.capture != nullptr)
+    {
+        if (!recorder.close())
+            std::cout << "Could not write " << capture_file_name << std::endl;
+        if (recorder.dropped() > 0)
+            std::cout << recorder.dropped() << " frames were dropped from " << capture_file_name << std::endl;
+    }
+
+    if (frontend.latency != nullptr)
+    {
+        std::ofstream latency(latency_file_name);
+        meter.writeCSV(latency);
+        if (!latency.good())
+            std::cout << "Could not write " << latency_file_name << std::endl;
+        if (!meter.samples().empty())
+            std::cout << "Input latency over " << meter.samples().size() << " key events: median "
+                      << meter.percentile(0.5) << " ms, 95th percentile " << meter.percentile(0.95) << " ms, worst "
+                      << meter.percentile(1.0) << " ms" << std::endl;
+    }
+
+    if (frontend.core.unsupported() > 0)
+        std::cout << frontend.core.unsupported() << " unsupported instructions (0NNN or unknown) were executed, the last at 0x"
+                  << std::hex << frontend.core.lastUnsupported() << std::dec << std::endl;
+
+    if (frontend.core.profiling())
+    {
+        std::ofstream profile(profile_file_name);
+        std::string extension = profile_file_name.substr(profile_file_name.find_last_of('.') + 1);
+        if (extension == "csv")
+            frontend.core.profile().writeCSV(profile);
+        else
+            frontend.core.profile().writeJSON(profile);
+        if (!profile.good())
+            std::cout << "Could not write " << profile_file_name << std::endl;
     }
 
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
+    frontend.speaker.close();
+    frontend.screen.destroy();
+    SDL_DestroyRenderer(frontend.renderer);
+    SDL_DestroyWindow(frontend.window);
     SDL_Quit();
 
     return 0;
@@ -0,0 +1,87 @@
+#include "MappedFile.h"
+
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(void): m_data(nullptr),
+                              m_size(0),
+                              m_mapped(false)
+{
+}
+
+MappedFile::~MappedFile(void)
+{
+    close();
+}
+
+bool MappedFile::open(const std::string& file_name)
+{
+    close();
+
+#ifndef _WIN32
+    int descriptor = ::open(file_name.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) == 0 && status.st_size > 0)
+    {
+        void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (data != MAP_FAILED)
+        {
+            m_data = static_cast<const unsigned char*>(data);
+            m_size = status.st_size;
+            m_mapped = true;
+        }
+    }
+    ::close(descriptor);
+    if (m_mapped)
+        return true;
+#endif
+
+    // Fall back to reading the whole file.
+    std::ifstream file(file_name, std::ifstream::binary);
+    if (!file.good())
+        return false;
+    file.seekg(0, std::ifstream::end);
+    std::streamoff size = file.tellg();
+    if (size < 0)
+        return false;
+    file.seekg(0, std::ifstream::beg);
+    m_buffer.resize(static_cast<std::size_t>(size));
+    if (size > 0 && !file.read(reinterpret_cast<char*>(m_buffer.data()), size))
+        return false;
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifndef _WIN32
+    if (m_mapped)
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
+
+const unsigned char* MappedFile::data() const
+{
+    return m_data;
+}
+
+std::size_t MappedFile::size() const
+{
+    return m_size;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/* Read-only view of a whole file. The file is memory-mapped where the platform supports it and
+read into memory otherwise.
+*/
+class MappedFile
+{
+public:
+    MappedFile(void);
+    ~MappedFile(void);
+
+    bool open(const std::string& file_name); // Returns false if the file can't be read.
+    void close();
+
+    const unsigned char* data() const;
+    std::size_t size() const;
+
+private:
+    MappedFile(const MappedFile&); // Not copyable.
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* m_data;
+    std::size_t m_size;
+    bool m_mapped; // m_data is a mapping rather than m_buffer.
+    std::vector<unsigned char> m_buffer;
+};
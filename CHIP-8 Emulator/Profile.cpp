@@ -0,0 +1,160 @@
+#include "Profile.h"
+
+
+namespace
+{
+    // Must list the mnemonics in the same order as Profile::Class.
+    const char* const MNEMONICS[Profile::CLASS_COUNT] =
+    {
+        "SYS addr", "CLS", "RET", "JP addr", "CALL addr",
+        "SE Vx, byte", "SNE Vx, byte", "SE Vx, Vy", "LD Vx, byte", "ADD Vx, byte",
+        "LD Vx, Vy", "OR Vx, Vy", "AND Vx, Vy", "XOR Vx, Vy", "ADD Vx, Vy", "SUB Vx, Vy", "SHR Vx", "SUBN Vx, Vy",
+        "SHL Vx", "SNE Vx, Vy", "LD I, addr", "JP V0, addr", "RND Vx, byte", "DRW Vx, Vy, nibble", "SKP Vx",
+        "SKNP Vx", "LD Vx, DT", "LD Vx, K", "LD DT, Vx", "LD ST, Vx", "ADD I, Vx", "LD F, Vx",
+        "LD B, Vx", "LD [I], Vx", "LD Vx, [I]",
+        "SCD nibble", "SCR", "SCL", "EXIT", "LOW", "HIGH", "LD HF, Vx", "LD R, Vx", "LD Vx, R",
+        "SCU nibble", "SAVE Vx, Vy", "LOAD Vx, Vy", "LD I, long", "PLANE n", "AUDIO", "PITCH Vx",
+        "unknown"
+    };
+
+    void writeAddress(std::ostream& out, unsigned short address)
+    {
+        const char* digits = "0123456789ABCDEF";
+        out << "0x";
+        if (address > 0xFFF) // XO-CHIP memory.
+            out << digits[address >> 12];
+        out << digits[(address >> 8) & 0xF] << digits[(address >> 4) & 0xF] << digits[address & 0xF];
+    }
+}
+
+Profile::Profile(void)
+{
+    clear();
+}
+
+const char* Profile::mnemonic(Class type)
+{
+    return type < CLASS_COUNT ? MNEMONICS[type] : "";
+}
+
+unsigned long long Profile::instructions() const
+{
+    return m_instructions;
+}
+
+unsigned long long Profile::count(Class type) const
+{
+    return type < CLASS_COUNT ? m_classes[type] : 0;
+}
+
+unsigned long long Profile::executions(unsigned short address) const
+{
+    return address < m_addresses.size() ? m_addresses[address] : 0;
+}
+
+unsigned long long Profile::draws() const
+{
+    return m_classes[CLASS_DRW];
+}
+
+unsigned long long Profile::keyWaitCycles() const
+{
+    return m_key_wait;
+}
+
+unsigned long long Profile::timerWaitCycles() const
+{
+    return m_timer_wait;
+}
+
+std::size_t Profile::allocated() const
+{
+    return m_addresses.capacity() * sizeof(m_addresses[0]);
+}
+
+void Profile::clear()
+{
+    m_instructions = 0;
+    m_classes.fill(0);
+    m_addresses.clear();
+    m_key_wait = 0;
+    m_timer_wait = 0;
+    m_poll_address = NO_POLL;
+    m_poll_instruction = 0;
+}
+
+void Profile::writeJSON(std::ostream& out) const
+{
+    out << "{\n  \"instructions\": " << m_instructions << ",\n  \"draws\": " << draws()
+        << ",\n  \"key_wait_cycles\": " << m_key_wait << ",\n  \"timer_wait_cycles\": " << m_timer_wait
+        << ",\n  \"opcodes\": {";
+    bool first = true;
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        if (m_classes[i] == 0)
+            continue;
+        out << (first ? "\n" : ",\n") << "    \"" << MNEMONICS[i] << "\": " << m_classes[i];
+        first = false;
+    }
+    out << "\n  },\n  \"addresses\": {";
+    first = true;
+    for (unsigned int address = 0; address < m_addresses.size(); ++address)
+    {
+        if (m_addresses[address] == 0)
+            continue;
+        out << (first ? "\n" : ",\n") << "    \"";
+        writeAddress(out, address);
+        out << "\": " << m_addresses[address];
+        first = false;
+    }
+    out << "\n  }\n}\n";
+}
+
+void Profile::writeCSV(std::ostream& out) const
+{
+    out << "metric,key,value\n";
+    out << "instructions,," << m_instructions << '\n';
+    out << "draws,," << draws() << '\n';
+    out << "key_wait_cycles,," << m_key_wait << '\n';
+    out << "timer_wait_cycles,," << m_timer_wait << '\n';
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        if (m_classes[i] != 0)
+            out << "opcode,\"" << MNEMONICS[i] << "\"," << m_classes[i] << '\n';
+    }
+    for (unsigned int address = 0; address < m_addresses.size(); ++address)
+    {
+        if (m_addresses[address] == 0)
+            continue;
+        out << "address,";
+        writeAddress(out, address);
+        out << ',' << m_addresses[address] << '\n';
+    }
+}
+
+void Profile::instruction(unsigned short address, Class type)
+{
+    if (address >= m_addresses.size())
+        m_addresses.resize(address < 0x1000 ? 0x1000 : 0x10000);
+    ++m_instructions;
+    ++m_classes[type];
+    ++m_addresses[address];
+}
+
+void Profile::keyWait()
+{
+    ++m_key_wait;
+}
+
+void Profile::timerRead(unsigned short address, unsigned char value)
+{
+    if (value == 0)
+    {
+        m_poll_address = NO_POLL;
+        return;
+    }
+    if (address == m_poll_address)
+        m_timer_wait += m_instructions - m_poll_instruction;
+    m_poll_address = address;
+    m_poll_instruction = m_instructions;
+}
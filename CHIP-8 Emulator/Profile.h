@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+/* Execution statistics of a CHIP8 core, see CHIP8::profiling(bool). Collected only when the core
+is compiled with CHIP8_INSTRUMENTATION defined. Without it the hooks are compiled out and the
+profile stays empty.
+
+Counts instructions per opcode class and per address, DXYN draws, the cycles spent in FX0A
+waiting for a key and the cycles spent polling the delay timer. A poll is an FX07 reading a
+non-zero timer, the cycles from one poll to the next at the same address count as waiting.
+*/
+class Profile
+{
+public:
+    enum Class
+    {
+        CLASS_SYS, CLASS_CLS, CLASS_RET, CLASS_JP, CLASS_CALL,
+        CLASS_SE_BYTE, CLASS_SNE_BYTE, CLASS_SE_REG, CLASS_LD_BYTE, CLASS_ADD_BYTE,
+        CLASS_LD_REG, CLASS_OR, CLASS_AND, CLASS_XOR, CLASS_ADD_REG, CLASS_SUB, CLASS_SHR, CLASS_SUBN,
+        CLASS_SHL, CLASS_SNE_REG, CLASS_LD_I, CLASS_JP_V0, CLASS_RND, CLASS_DRW, CLASS_SKP, CLASS_SKNP,
+        CLASS_LD_VX_DT, CLASS_LD_VX_K, CLASS_LD_DT_VX, CLASS_LD_ST_VX, CLASS_ADD_I_VX, CLASS_LD_F_VX,
+        CLASS_LD_B_VX, CLASS_LD_MEM_VX, CLASS_LD_VX_MEM,
+        CLASS_SCD, CLASS_SCR, CLASS_SCL, CLASS_EXIT, CLASS_LOW, CLASS_HIGH, CLASS_LD_HF_VX, CLASS_LD_R_VX,
+        CLASS_LD_VX_R,
+        CLASS_SCU, CLASS_SAVE_RANGE, CLASS_LOAD_RANGE, CLASS_LD_I_LONG, CLASS_PLANE, CLASS_AUDIO,
+        CLASS_PITCH,
+        CLASS_UNKNOWN,
+        CLASS_COUNT
+    };
+
+    Profile(void);
+
+    static const char* mnemonic(Class); // E.g. "DRW Vx, Vy, nibble".
+
+    unsigned long long instructions() const;
+    unsigned long long count(Class) const; // Instructions of the class executed.
+    unsigned long long executions(unsigned short address) const; // Instructions executed at address.
+    unsigned long long draws() const; // DXYN executed.
+    unsigned long long keyWaitCycles() const; // Cycles spent in FX0A without a key pressed.
+    unsigned long long timerWaitCycles() const; // Cycles spent polling the delay timer.
+    std::size_t allocated() const; // Bytes allocated for the address histogram.
+    void clear();
+
+    // Snapshots. The address histogram only lists addresses that were executed.
+    void writeJSON(std::ostream&) const;
+    void writeCSV(std::ostream&) const;
+
+    // Recording, called by the core.
+    void instruction(unsigned short address, Class);
+    void keyWait();
+    void timerRead(unsigned short address, unsigned char value);
+
+private:
+    static const unsigned short NO_POLL = 0xFFFF;
+
+    unsigned long long m_instructions;
+    std::array<unsigned long long, CLASS_COUNT> m_classes;
+    // Allocated on the first instruction, 4096 entries or 65536 once
+    // an XO-CHIP program runs past 0xFFF.
+    std::vector<unsigned long long> m_addresses;
+    unsigned long long m_key_wait;
+    unsigned long long m_timer_wait;
+    unsigned short m_poll_address; // Address of the last polling FX07, NO_POLL if the timer ran out.
+    unsigned long long m_poll_instruction; // m_instructions at that FX07.
+};
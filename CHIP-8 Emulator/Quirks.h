@@ -0,0 +1,72 @@
+#pragma once
+
+/* Behaviours that differ between CHIP-8 interpreters. Each profile is a policy the quirky opcode
+handlers are instantiated with (see CHIP8::Quirks), so the choice is made once per handler table
+rather than on every instruction.
+
+SHIFT_VY        8XY6/8XYE shift VY into VX rather than shifting VX in place.
+INCREMENT_I     FX55/FX65 leave I pointing past the last register stored or loaded.
+JUMP_VX         BXNN jumps to XNN plus VX rather than BNNN jumping to NNN plus V0.
+ADD_I_CARRY     FX1E sets VF when I goes past 0xFFF.
+DRAW_WRAP       DXYN wraps sprites around the screen edges rather than clipping them.
+LONG_SKIP       Skips step over F000 NNNN as a whole, it is two words long.
+ADDRESS_MASK    Addressable memory, 4 KB or the 64 KB of XO-CHIP.
+SCHIP_OPCODES   The SUPER-CHIP instructions run, rather than being 0NNN or unknown instructions.
+XOCHIP_OPCODES  The XO-CHIP instructions run, likewise.
+*/
+
+// What this emulator has always done.
+struct DefaultQuirks
+{
+    static const bool SHIFT_VY = false;
+    static const bool INCREMENT_I = true;
+    static const bool JUMP_VX = false;
+    static const bool ADD_I_CARRY = true;
+    static const bool DRAW_WRAP = false;
+    static const bool LONG_SKIP = false;
+    static const unsigned short ADDRESS_MASK = 0xFFF;
+    static const bool SCHIP_OPCODES = false;
+    static const bool XOCHIP_OPCODES = false;
+};
+
+// The original COSMAC VIP interpreter.
+struct CosmacQuirks
+{
+    static const bool SHIFT_VY = true;
+    static const bool INCREMENT_I = true;
+    static const bool JUMP_VX = false;
+    static const bool ADD_I_CARRY = false;
+    static const bool DRAW_WRAP = false;
+    static const bool LONG_SKIP = false;
+    static const unsigned short ADDRESS_MASK = 0xFFF;
+    static const bool SCHIP_OPCODES = false;
+    static const bool XOCHIP_OPCODES = false;
+};
+
+// SUPER-CHIP 1.1 on the HP 48.
+struct SchipQuirks
+{
+    static const bool SHIFT_VY = false;
+    static const bool INCREMENT_I = false;
+    static const bool JUMP_VX = true;
+    static const bool ADD_I_CARRY = false;
+    static const bool DRAW_WRAP = false;
+    static const bool LONG_SKIP = false;
+    static const unsigned short ADDRESS_MASK = 0xFFF;
+    static const bool SCHIP_OPCODES = true;
+    static const bool XOCHIP_OPCODES = false;
+};
+
+// XO-CHIP (Octo).
+struct XochipQuirks
+{
+    static const bool SHIFT_VY = true;
+    static const bool INCREMENT_I = true;
+    static const bool JUMP_VX = false;
+    static const bool ADD_I_CARRY = false;
+    static const bool DRAW_WRAP = true;
+    static const bool LONG_SKIP = true;
+    static const unsigned short ADDRESS_MASK = 0xFFFF;
+    static const bool SCHIP_OPCODES = true;
+    static const bool XOCHIP_OPCODES = true;
+};
@@ -0,0 +1,36 @@
+#include "Random.h"
+
+
+Random::Random(std::uint64_t seed)
+{
+    this->seed(seed);
+}
+
+void Random::seed(std::uint64_t seed)
+{
+    // Scramble the seed (splitmix64) so that similar seeds don't give similar sequences.
+    std::uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    m_state = z ^ (z >> 31);
+    if (m_state == 0)
+        m_state = 1;
+}
+
+unsigned char Random::byte()
+{
+    m_state ^= m_state >> 12;
+    m_state ^= m_state << 25;
+    m_state ^= m_state >> 27;
+    return static_cast<unsigned char>((m_state * 0x2545F4914F6CDD1DULL) >> 56); // High bits are the best.
+}
+
+std::uint64_t Random::state() const
+{
+    return m_state;
+}
+
+void Random::state(std::uint64_t state)
+{
+    m_state = state != 0 ? state : 1;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+
+/* Random number generator for CXNN (xorshift64*). Its whole state is one word, so it can be saved
+and restored along with the rest of the machine.
+*/
+class Random
+{
+public:
+    explicit Random(std::uint64_t seed = 1);
+
+    void seed(std::uint64_t seed);
+    unsigned char byte(); // Next random number between 0x00 and 0xFF.
+
+    std::uint64_t state() const; // State getter.
+    void state(std::uint64_t); // State setter, a state from state() resumes the same sequence.
+
+private:
+    std::uint64_t m_state; // Never 0.
+};
@@ -0,0 +1,41 @@
+#include "Recompiled.h"
+#include "RomPack.h"
+
+#include <vector>
+
+
+namespace
+{
+    // Filled by static initializers, a function local so it exists before the first of them runs.
+    std::vector<const Recompiled*>& programs()
+    {
+        static std::vector<const Recompiled*> registered;
+        return registered;
+    }
+}
+
+Recompiled::Registration::Registration(const Recompiled& program)
+{
+    programs().push_back(&program);
+}
+
+const Recompiled* Recompiled::find(const unsigned char* program, std::size_t size, unsigned char quirks)
+{
+    const std::vector<const Recompiled*>& registered = programs();
+    if (registered.empty()) // Don't hash every ROM loaded when nothing was linked in.
+        return nullptr;
+
+    std::uint64_t hash = RomPack::hash(program, size);
+    for (std::size_t i = 0; i < registered.size(); ++i)
+    {
+        const Recompiled& candidate = *registered[i];
+        if (candidate.size == size && candidate.hash == hash && candidate.quirks == quirks)
+            return &candidate;
+    }
+    return nullptr;
+}
+
+std::size_t Recompiled::count()
+{
+    return programs().size();
+}
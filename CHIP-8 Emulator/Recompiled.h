@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/* A ROM recompiled ahead of time to C++ by chip8-recompile (see Recompiler.h). Each generated
+source file defines its programs and registers them, so linking the file into a host is all it
+takes: loadGame looks the loaded ROM up by its hash and quirk profile, and ENGINE_NATIVE runs its
+native code.
+
+The native code runs on a copy of the registers, from State::pc until it uses up its cycles or
+reaches an instruction it leaves to the interpreter: drawing, random numbers, key waits, memory
+writes and BNNN, whose target isn't known ahead of time. Every instruction is compared with memory
+before it runs, code the program has overwritten since is interpreted as well.
+*/
+struct Recompiled
+{
+    // Registers of the machine, copied from CHIP8 before a call and back after it.
+    struct State
+    {
+        unsigned char V[16];
+        unsigned short stack[16];
+        unsigned short I;
+        unsigned short pc;
+        unsigned short sp;
+        unsigned short keys; // Bit n is set while key n is pressed.
+        unsigned char delay_timer;
+        unsigned char sound_timer;
+        const unsigned char* memory; // Read only, writes are left to the interpreter.
+    };
+
+    // Runs up to cycles instructions, returns the number run. Stops early at an instruction that
+    // has to be interpreted, with state.pc pointing at it.
+    typedef unsigned int (*Function)(State& state, unsigned int cycles);
+
+    // Adds a program to the ones find() knows about, meant for a static object in the generated
+    // source file. The program has to outlive the registration.
+    struct Registration
+    {
+        explicit Registration(const Recompiled& program);
+    };
+
+    // Program compiled from the given ROM for the quirk profile, nullptr if none was linked in.
+    static const Recompiled* find(const unsigned char* program, std::size_t size, unsigned char quirks);
+    static std::size_t count(); // Number of programs linked in.
+
+    const char* name; // As given to chip8-recompile.
+    unsigned char quirks; // CHIP8::Quirks the semantics were compiled for.
+    std::size_t size; // Of the ROM.
+    std::uint64_t hash; // Of the ROM, see RomPack::hash.
+    Function function;
+};
@@ -0,0 +1,425 @@
+#include "Recompiler.h"
+#include "RomPack.h"
+
+#include <iomanip>
+#include <sstream>
+
+
+namespace
+{
+    // The quirks the generated code depends on, see Quirks.h.
+    struct Semantics
+    {
+        bool shift_vy;
+        bool increment_i;
+        bool add_i_carry;
+        bool long_skip;
+        unsigned short address_mask;
+    };
+
+    template<class Q>
+    Semantics semantics()
+    {
+        Semantics semantics = { Q::SHIFT_VY, Q::INCREMENT_I, Q::ADD_I_CARRY, Q::LONG_SKIP, Q::ADDRESS_MASK };
+        return semantics;
+    }
+
+    Semantics semantics(CHIP8::Quirks quirks)
+    {
+        switch (quirks)
+        {
+            case CHIP8::QUIRKS_COSMAC:
+                return semantics<CosmacQuirks>();
+            case CHIP8::QUIRKS_SCHIP:
+                return semantics<SchipQuirks>();
+            case CHIP8::QUIRKS_XOCHIP:
+                return semantics<XochipQuirks>();
+            default:
+                return semantics<DefaultQuirks>();
+        }
+    }
+
+    std::string hex(unsigned long long value, int digits)
+    {
+        std::ostringstream text;
+        text << "0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(digits) << value;
+        return text.str();
+    }
+
+    std::string label(unsigned int address)
+    {
+        return "L_" + hex(address, 4).substr(2);
+    }
+
+    std::string V(unsigned int x)
+    {
+        return "s.V[" + hex(x, 1) + "]";
+    }
+}
+
+Recompiler::Recompiler(const unsigned char* program, std::size_t size, CHIP8::Quirks quirks):
+    m_memory(semantics(quirks).address_mask + 1u, 0),
+    m_end(0x200 + size),
+    m_reached(m_memory.size(), false),
+    m_quirks(quirks),
+    m_hash(RomPack::hash(program, size))
+{
+    std::copy(program, program + size, m_memory.begin() + 0x200);
+
+    // Follow the control flow from 0x200. Anything not reached is taken for data.
+    std::vector<unsigned int> pending(1, 0x200);
+    while (!pending.empty())
+    {
+        unsigned int address = pending.back();
+        pending.pop_back();
+        if (address < 0x200 || address + 2 > m_end || m_reached[address])
+            continue;
+        m_reached[address] = true;
+
+        CHIP8::Instruction instruction = CHIP8::decodeOpcode(word(address), m_quirks);
+        unsigned int next = (address + 2) & 0xFFFF;
+        switch (instruction.op)
+        {
+            case CHIP8::OP_JP:
+                pending.push_back(instruction.nnn);
+                break;
+            case CHIP8::OP_CALL:
+                pending.push_back(instruction.nnn);
+                pending.push_back(next);
+                break;
+            case CHIP8::OP_SE_BYTE:
+            case CHIP8::OP_SNE_BYTE:
+            case CHIP8::OP_SE_REG:
+            case CHIP8::OP_SNE_REG:
+            case CHIP8::OP_SKP:
+            case CHIP8::OP_SKNP:
+                pending.push_back(next);
+                pending.push_back(skipTarget(address));
+                break;
+            case CHIP8::OP_LD_I_LONG:
+                pending.push_back((address + 4) & 0xFFFF);
+                break;
+            case CHIP8::OP_RET:
+            case CHIP8::OP_JP_V0: // Indirect, its targets are only found at runtime.
+            case CHIP8::OP_EXIT:
+            case CHIP8::OP_SYS: // Nearly always zeroed memory rather than code.
+            case CHIP8::OP_UNKNOWN:
+                break;
+            default:
+                pending.push_back(next);
+                break;
+        }
+    }
+}
+
+std::size_t Recompiler::reached() const
+{
+    std::size_t count = 0;
+    for (std::size_t address = 0; address < m_reached.size(); ++address)
+        count += m_reached[address];
+    return count;
+}
+
+std::size_t Recompiler::compiled() const
+{
+    std::size_t count = 0;
+    for (std::size_t address = 0; address < m_reached.size(); ++address)
+        count += m_reached[address] && native(address);
+    return count;
+}
+
+void Recompiler::writeHeader(std::ostream& out)
+{
+    out << "// Generated by chip8-recompile, see Recompiler.h.\n"
+        << "#include \"Recompiled.h\"\n"
+        << "\n"
+        << "// Opcode at address, as the instructions are checked against it before they run.\n"
+        << "#define WORD(address) (M[address] << 8 | M[(address) + 1])\n"
+        << "// Stops with the program counter at address.\n"
+        << "#define EXIT(address) { s.pc = address; goto out; }\n";
+}
+
+void Recompiler::write(std::ostream& out, const std::string& name, const std::string& id) const
+{
+    std::vector<unsigned int> addresses;
+    bool returns = false;
+    for (unsigned int address = 0; address < m_reached.size(); ++address)
+    {
+        if (!m_reached[address])
+            continue;
+        addresses.push_back(address);
+        if (CHIP8::decodeOpcode(word(address), m_quirks).op == CHIP8::OP_RET)
+            returns = true;
+    }
+
+    out << "\n"
+        << "// " << name << ", " << m_end - 0x200 << " bytes. " << compiled() << " of the " << reached()
+        << " instructions reached are compiled.\n"
+        << "namespace\n"
+        << "{\n"
+        << "namespace " << id << "\n"
+        << "{\n"
+        << "    unsigned int run(Recompiled::State& state, unsigned int cycles)\n"
+        << "    {\n"
+        << "        Recompiled::State s = state;\n";
+    if (compiled() > 0)
+        out << "        const unsigned char* M = s.memory;\n";
+    out << "        unsigned int left = cycles;\n"
+        << "\n";
+    if (returns)
+        out << "    dispatch:\n";
+    out << "        switch (s.pc)\n"
+        << "        {\n";
+    for (std::size_t i = 0; i < addresses.size(); ++i)
+        out << "            case " << hex(addresses[i], 4) << ": goto " << label(addresses[i]) << ";\n";
+    out << "            default: goto out;\n"
+        << "        }\n";
+
+    for (std::size_t i = 0; i < addresses.size(); ++i)
+        writeInstruction(out, addresses[i], i + 1 < addresses.size() ? addresses[i + 1] : ~0u);
+
+    std::string escaped;
+    for (std::size_t i = 0; i < name.size(); ++i)
+    {
+        if (name[i] == '"' || name[i] == '\\')
+            escaped += '\\';
+        escaped += name[i];
+    }
+    out << "\n"
+        << "    out:\n"
+        << "        state = s;\n"
+        << "        return cycles - left;\n"
+        << "    }\n"
+        << "\n"
+        << "    const Recompiled program = { \"" << escaped << "\", " << static_cast<int>(m_quirks) << ", "
+        << m_end - 0x200 << ", " << hex(m_hash, 16) << "ull, run };\n"
+        << "    const Recompiled::Registration registration(program);\n"
+        << "}\n"
+        << "}\n";
+}
+
+unsigned short Recompiler::word(unsigned int address) const
+{
+    unsigned int mask = m_memory.size() - 1;
+    return m_memory[address & mask] << 8 | m_memory[(address + 1) & mask];
+}
+
+bool Recompiler::native(unsigned int address) const
+{
+    CHIP8::Instruction instruction = CHIP8::decodeOpcode(word(address), m_quirks);
+    switch (instruction.op)
+    {
+        case CHIP8::OP_JP:
+            // A jump to itself halts, the interpreter notices that and stops running it.
+            return instruction.nnn != address;
+        case CHIP8::OP_SE_BYTE:
+        case CHIP8::OP_SNE_BYTE:
+        case CHIP8::OP_SE_REG:
+        case CHIP8::OP_SNE_REG:
+        case CHIP8::OP_SKP:
+        case CHIP8::OP_SKNP:
+            // With long skips the word after the skip is checked as well, it has to be in memory.
+            return !semantics(m_quirks).long_skip || address + 3 < m_memory.size();
+        case CHIP8::OP_RET:
+        case CHIP8::OP_CALL:
+        case CHIP8::OP_LD_BYTE:
+        case CHIP8::OP_ADD_BYTE:
+        case CHIP8::OP_LD_REG:
+        case CHIP8::OP_OR:
+        case CHIP8::OP_AND:
+        case CHIP8::OP_XOR:
+        case CHIP8::OP_ADD_REG:
+        case CHIP8::OP_SUB:
+        case CHIP8::OP_SHR:
+        case CHIP8::OP_SUBN:
+        case CHIP8::OP_SHL:
+        case CHIP8::OP_LD_I:
+        case CHIP8::OP_LD_VX_DT:
+        case CHIP8::OP_LD_DT_VX:
+        case CHIP8::OP_LD_ST_VX:
+        case CHIP8::OP_ADD_I_VX:
+        case CHIP8::OP_LD_F_VX:
+        case CHIP8::OP_LD_HF_VX:
+        case CHIP8::OP_LD_VX_MEM:
+        case CHIP8::OP_LOAD_RANGE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+unsigned int Recompiler::skipTarget(unsigned int address) const
+{
+    if (semantics(m_quirks).long_skip && word(address + 2) == 0xF000)
+        return (address + 6) & 0xFFFF;
+    return (address + 4) & 0xFFFF;
+}
+
+std::string Recompiler::branch(unsigned int target) const
+{
+    if (target < m_reached.size() && m_reached[target])
+        return "goto " + label(target) + ";";
+    return "EXIT(" + hex(target, 4) + ");";
+}
+
+void Recompiler::writeInstruction(std::ostream& out, unsigned int address, unsigned int next) const
+{
+    CHIP8::Instruction instruction = CHIP8::decodeOpcode(word(address), m_quirks);
+    out << "    " << label(address) << ": // " << hex(instruction.opcode, 4) << "\n";
+    if (!native(address))
+    {
+        out << "        EXIT(" << hex(address, 4) << ");\n";
+        return;
+    }
+
+    Semantics quirks = semantics(m_quirks);
+    unsigned int following = (address + 2) & 0xFFFF;
+    std::string x = V(instruction.x);
+    std::string y = V(instruction.y);
+    std::string mask = hex(quirks.address_mask, 3);
+
+    // Run only while there are cycles left and the instruction is still the one compiled. Skips
+    // also depend on whether the next instruction is a long load.
+    out << "        if (left == 0 || WORD(" << hex(address, 4) << ") != " << hex(instruction.opcode, 4);
+    switch (instruction.op)
+    {
+        case CHIP8::OP_SE_BYTE:
+        case CHIP8::OP_SNE_BYTE:
+        case CHIP8::OP_SE_REG:
+        case CHIP8::OP_SNE_REG:
+        case CHIP8::OP_SKP:
+        case CHIP8::OP_SKNP:
+            if (quirks.long_skip)
+                out << " || WORD(" << hex(following, 4) << ") " << (word(following) == 0xF000 ? "!=" : "==")
+                    << " 0xF000";
+            break;
+    }
+    out << ") EXIT(" << hex(address, 4) << ");\n"
+        << "        --left;\n";
+
+    std::string condition; // Of a skip.
+    switch (instruction.op)
+    {
+        case CHIP8::OP_RET:
+            out << "        s.pc = s.stack[s.sp & 0xF];\n"
+                << "        --s.sp;\n"
+                << "        goto dispatch;\n";
+            return;
+        case CHIP8::OP_JP:
+            out << "        " << branch(instruction.nnn) << "\n";
+            return;
+        case CHIP8::OP_CALL:
+            out << "        ++s.sp;\n"
+                << "        s.stack[s.sp & 0xF] = " << hex(following, 4) << ";\n"
+                << "        " << branch(instruction.nnn) << "\n";
+            return;
+        case CHIP8::OP_SE_BYTE:
+            condition = x + " == " + hex(instruction.nn, 2);
+            break;
+        case CHIP8::OP_SNE_BYTE:
+            condition = x + " != " + hex(instruction.nn, 2);
+            break;
+        case CHIP8::OP_SE_REG:
+            condition = x + " == " + y;
+            break;
+        case CHIP8::OP_SNE_REG:
+            condition = x + " != " + y;
+            break;
+        case CHIP8::OP_SKP:
+            condition = "(s.keys >> (" + x + " & 0xF)) & 1";
+            break;
+        case CHIP8::OP_SKNP:
+            condition = "((s.keys >> (" + x + " & 0xF)) & 1) == 0";
+            break;
+        case CHIP8::OP_LD_BYTE:
+            out << "        " << x << " = " << hex(instruction.nn, 2) << ";\n";
+            break;
+        case CHIP8::OP_ADD_BYTE:
+            out << "        " << x << " += " << hex(instruction.nn, 2) << ";\n";
+            break;
+        case CHIP8::OP_LD_REG:
+            out << "        " << x << " = " << y << ";\n";
+            break;
+        case CHIP8::OP_OR:
+            out << "        " << x << " |= " << y << ";\n";
+            break;
+        case CHIP8::OP_AND:
+            out << "        " << x << " &= " << y << ";\n";
+            break;
+        case CHIP8::OP_XOR:
+            out << "        " << x << " ^= " << y << ";\n";
+            break;
+        // VF is set before the arithmetic, like the interpreter does, in case it is an operand.
+        case CHIP8::OP_ADD_REG:
+            out << "        s.V[0xF] = " << y << " > 0xFF - " << x << ";\n"
+                << "        " << x << " += " << y << ";\n";
+            break;
+        case CHIP8::OP_SUB:
+            out << "        s.V[0xF] = " << x << " >= " << y << ";\n"
+                << "        " << x << " -= " << y << ";\n";
+            break;
+        case CHIP8::OP_SUBN:
+            out << "        s.V[0xF] = " << x << " <= " << y << ";\n"
+                << "        " << x << " = " << y << " - " << x << ";\n";
+            break;
+        case CHIP8::OP_SHR:
+            if (quirks.shift_vy)
+                out << "        { unsigned char value = " << y << "; " << x << " = value >> 1; s.V[0xF] = value & 0x01; }\n";
+            else
+                out << "        s.V[0xF] = " << x << " & 0x01;\n"
+                    << "        " << x << " >>= 1;\n";
+            break;
+        case CHIP8::OP_SHL:
+            if (quirks.shift_vy)
+                out << "        { unsigned char value = " << y << "; " << x << " = value << 1; s.V[0xF] = value >> 7; }\n";
+            else
+                out << "        s.V[0xF] = " << x << " >> 7;\n"
+                    << "        " << x << " <<= 1;\n";
+            break;
+        case CHIP8::OP_LD_I:
+            out << "        s.I = " << hex(instruction.nnn, 3) << ";\n";
+            break;
+        case CHIP8::OP_LD_VX_DT:
+            out << "        " << x << " = s.delay_timer;\n";
+            break;
+        case CHIP8::OP_LD_DT_VX:
+            out << "        s.delay_timer = " << x << ";\n";
+            break;
+        case CHIP8::OP_LD_ST_VX:
+            out << "        s.sound_timer = " << x << ";\n";
+            break;
+        case CHIP8::OP_ADD_I_VX:
+            if (quirks.add_i_carry)
+                out << "        s.V[0xF] = s.I + " << x << " > 0xFFF;\n";
+            out << "        s.I += " << x << ";\n";
+            break;
+        case CHIP8::OP_LD_F_VX:
+            out << "        s.I = " << x << " * 5;\n";
+            break;
+        case CHIP8::OP_LD_HF_VX:
+            out << "        s.I = 0x50 + (" << x << " & 0xF) * 10;\n";
+            break;
+        case CHIP8::OP_LD_VX_MEM:
+            for (unsigned int i = 0; i <= instruction.x; ++i)
+                out << "        " << V(i) << " = M[(s.I + " << i << ") & " << mask << "];\n";
+            if (quirks.increment_i)
+                out << "        s.I += " << instruction.x + 1 << ";\n";
+            break;
+        case CHIP8::OP_LOAD_RANGE:
+        {
+            int step = instruction.x <= instruction.y ? 1 : -1;
+            for (int i = instruction.x, offset = 0; ; i += step, ++offset)
+            {
+                out << "        " << V(i) << " = M[(s.I + " << offset << ") & " << mask << "];\n";
+                if (i == instruction.y)
+                    break;
+            }
+            break;
+        }
+    }
+
+    if (!condition.empty())
+        out << "        if (" << condition << ") " << branch(skipTarget(address)) << "\n";
+    if (following != next)
+        out << "        " << branch(following) << "\n";
+}
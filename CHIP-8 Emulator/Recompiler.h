@@ -0,0 +1,45 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/* Static recompiler from a CHIP-8 ROM to C++, the source of the programs in Recompiled.h.
+The ROM is disassembled from 0x200 with CHIP8's decoder and its control flow followed through
+jumps, calls, returns and both ways of every skip. Each instruction reached becomes a label in one
+function, jumps and calls become gotos and returns a switch over the addresses reached. Register
+instructions, skips, timers, FX65 and 5XY3 are compiled with the semantics of the quirk profile,
+everything else stops the native code at the instruction for the interpreter to run.
+*/
+class Recompiler
+{
+public:
+    // Disassembles the program, which has to fit in programCapacity(quirks).
+    Recompiler(const unsigned char* program, std::size_t size, CHIP8::Quirks quirks);
+
+    std::size_t reached() const; // Instructions found by following the control flow.
+    std::size_t compiled() const; // Those of them compiled to native code.
+
+    // Writes the program as a function and its registration. A source file may hold several
+    // programs: write writeHeader() once, then write() each program with a distinct id, a C++
+    // identifier.
+    static void writeHeader(std::ostream& out);
+    void write(std::ostream& out, const std::string& name, const std::string& id) const;
+
+private:
+    unsigned short word(unsigned int address) const;
+    bool native(unsigned int address) const; // Whether the instruction at address is compiled.
+    unsigned int skipTarget(unsigned int address) const; // Where a skip at address lands.
+    // Statement continuing at target: a goto if it was reached, otherwise leaving the native code.
+    std::string branch(unsigned int target) const;
+    // Writes the instruction at address, falling through when next is the address after it.
+    void writeInstruction(std::ostream& out, unsigned int address, unsigned int next) const;
+
+    std::vector<unsigned char> m_memory; // The program at 0x200, the rest 0.
+    std::size_t m_end; // End of the program.
+    std::vector<bool> m_reached; // Indexed by address.
+    CHIP8::Quirks m_quirks;
+    std::uint64_t m_hash;
+};
@@ -0,0 +1,75 @@
+#include "Renderer.h"
+
+
+namespace
+{
+    const Uint32 WHITE = 0xFFFFFFFF; // ARGB8888
+    const Uint32 BLACK = 0xFF000000;
+    const Uint32 PALETTE[4] = { BLACK, WHITE, 0xFFAAAAAA, 0xFF555555 }; // Indexed by pixel color.
+    const int WIDTH = 128; // Texture size.
+    const int HEIGHT = 64;
+}
+
+Renderer::Renderer(void): m_renderer(nullptr),
+                          m_texture(nullptr)
+{
+    m_pixels.fill(BLACK);
+}
+
+Renderer::~Renderer(void)
+{
+    destroy();
+}
+
+bool Renderer::create(SDL_Renderer* renderer)
+{
+    m_renderer = renderer;
+    m_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+    if (m_texture == nullptr)
+        return false;
+
+    // Streaming textures start out undefined.
+    return SDL_UpdateTexture(m_texture, nullptr, m_pixels.data(), WIDTH * sizeof(Uint32)) == 0;
+}
+
+void Renderer::destroy()
+{
+    if (m_texture != nullptr)
+        SDL_DestroyTexture(m_texture);
+    m_texture = nullptr;
+}
+
+void Renderer::draw(const CHIP8::FrameView& frame, std::uint64_t dirty_rows)
+{
+    // Convert the dirty rows, keeping track of the span to upload.
+    int first = -1;
+    int last = -1;
+    for (unsigned int y = 0; y < frame.height; ++y)
+    {
+        if ((dirty_rows & (1ull << y)) == 0)
+            continue;
+
+        const std::uint64_t* plane0 = &frame.planes[0][y * frame.stride];
+        const std::uint64_t* plane1 = &frame.planes[1][y * frame.stride];
+        Uint32* pixels = &m_pixels[y * WIDTH];
+        for (unsigned int x = 0; x < frame.width; ++x)
+        {
+            unsigned int shift = 63 - (x & 63);
+            pixels[x] = PALETTE[((plane0[x >> 6] >> shift) & 1) | ((plane1[x >> 6] >> shift) & 1) << 1];
+        }
+
+        if (first < 0)
+            first = y;
+        last = y;
+    }
+
+    if (first >= 0)
+    {
+        SDL_Rect rect = { 0, first, static_cast<int>(frame.width), last - first + 1 };
+        SDL_UpdateTexture(m_texture, &rect, &m_pixels[first * WIDTH], WIDTH * sizeof(Uint32));
+    }
+
+    SDL_Rect screen = { 0, 0, static_cast<int>(frame.width), static_cast<int>(frame.height) };
+    SDL_RenderCopy(m_renderer, m_texture, &screen, nullptr);
+    SDL_RenderPresent(m_renderer);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <array>
+#include <SDL.h>
+
+/* Presents the CHIP-8 screen through a streaming texture the size of the high resolution screen.
+Only rows marked dirty are converted and uploaded, the part of the texture in use at the current
+resolution is then stretched over the window with a single copy. Nothing is allocated per frame.
+*/
+class Renderer
+{
+public:
+    Renderer(void);
+    ~Renderer(void);
+
+    // Creates the texture, returns false with the reason in SDL_GetError() on failure.
+    bool create(SDL_Renderer* renderer);
+    void destroy(); // Must be called before the SDL renderer is destroyed.
+    void draw(const CHIP8::FrameView& frame, std::uint64_t dirty_rows);
+
+private:
+    SDL_Renderer* m_renderer;
+    SDL_Texture* m_texture;
+    std::array<Uint32, 128 * 64> m_pixels; // Texture contents, one ARGB8888 pixel per screen pixel.
+};
@@ -0,0 +1,57 @@
+#include "Replay.h"
+
+#include <algorithm>
+
+
+Replay::Replay(const InputLog& log): m_log(log),
+                                     m_next(0)
+{
+}
+
+void Replay::apply(CHIP8& core)
+{
+    const std::vector<InputLog::Event>& events = m_log.events();
+    while (m_next < events.size() && events[m_next].cycle <= core.cycles())
+    {
+        core.setKeys(events[m_next].key, events[m_next].pressed);
+        ++m_next;
+    }
+}
+
+void Replay::seek(const CHIP8& core)
+{
+    // Frames are recorded before the input for the next frame is applied, so the events stamped
+    // with the restored cycle count are still due.
+    const std::vector<InputLog::Event>& events = m_log.events();
+    unsigned long long cycle = core.cycles();
+    m_next = std::find_if(events.begin(), events.end(),
+                          [cycle](const InputLog::Event& event) { return event.cycle >= cycle; }) - events.begin();
+}
+
+bool Replay::finished(const CHIP8& core) const
+{
+    return m_next == m_log.events().size() && core.cycles() >= m_log.end();
+}
+
+unsigned long long Replay::run(CHIP8& core, Scheduler& scheduler, const InputLog& log,
+                               const std::string& rom_file_name)
+{
+    if (log.clock() == 0) // Would never get anywhere.
+        return 0;
+    if (core.loadGame(rom_file_name, log.quirks()) != CHIP8::LOAD_OK)
+        return 0;
+    core.seed(log.seed());
+    scheduler.clock(log.clock());
+
+    Replay replay(log);
+    unsigned long long frames = 0;
+    for (;;)
+    {
+        replay.apply(core);
+        if (replay.finished(core))
+            break;
+        scheduler.runFrame();
+        ++frames;
+    }
+    return frames;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "CHIP8.h"
+#include "InputLog.h"
+#include "Scheduler.h"
+
+#include <cstddef>
+#include <string>
+
+/* Feeds the events of an InputLog back into a core. The frontend applies input between frames, so
+events are applied at frame boundaries too: before each frame, every event stamped at or before
+the core's current cycle count is applied.
+*/
+class Replay
+{
+public:
+    explicit Replay(const InputLog& log); // The log has to outlive the replay.
+
+    void apply(CHIP8& core); // Applies the events that are due at core.cycles().
+    void seek(const CHIP8& core); // Continues from core.cycles(), after the core was rewound.
+    bool finished(const CHIP8& core) const; // All events applied and the recorded end reached.
+
+    // Runs a replay without a frontend: loads the ROM with the log's quirk profile, seeds core and
+    // sets the clock of scheduler from the log, then emulates frames until the end of the
+    // recording. The profile has to be set before loading, it decides how much memory there is.
+    // Returns the number of frames emulated, 0 if the ROM can't be loaded.
+    static unsigned long long run(CHIP8& core, Scheduler& scheduler, const InputLog& log,
+                                  const std::string& rom_file_name);
+
+private:
+    const InputLog& m_log;
+    std::size_t m_next; // Next event to apply.
+};
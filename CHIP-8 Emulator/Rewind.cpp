@@ -0,0 +1,195 @@
+#include "Rewind.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace
+{
+    const std::size_t LENGTH_SIZE = 4; // Size of the lengths around each record.
+    const std::size_t RUN_HEADER_SIZE = 6; // Offset and length of a delta run, XO-CHIP states pass 64 KB.
+    const std::size_t MAX_GAP = 4; // Unchanged bytes a run bridges rather than starting a new one.
+
+    void put16(std::vector<unsigned char>& out, std::size_t value)
+    {
+        out.push_back(value & 0xFF);
+        out.push_back((value >> 8) & 0xFF);
+    }
+
+    void put32(std::vector<unsigned char>& out, std::size_t value)
+    {
+        put16(out, value & 0xFFFF);
+        put16(out, value >> 16);
+    }
+}
+
+Rewind::Rewind(std::size_t budget): m_ring(budget),
+                                    m_head(0),
+                                    m_tail(0),
+                                    m_used(0),
+                                    m_frames(0)
+{
+}
+
+std::size_t Rewind::budget() const
+{
+    return m_ring.size();
+}
+
+void Rewind::budget(std::size_t budget)
+{
+    m_ring.assign(budget, 0);
+    clear();
+}
+
+void Rewind::record(const CHIP8& core)
+{
+    if (m_ring.empty())
+        return;
+
+    core.saveState(m_state);
+    if (m_current.size() != m_state.size())
+    {
+        // First frame, or a frame that can't be diffed against the last one.
+        clear();
+        m_current.swap(m_state);
+        return;
+    }
+
+    // Encode the XOR of the two states as runs of changed bytes.
+    m_delta.clear();
+    std::size_t size = m_state.size();
+    std::size_t i = 0;
+    while (i < size)
+    {
+        // Skip unchanged stretches a word at a time, most of the state doesn't change.
+        if (i + 8 <= size && std::memcmp(&m_state[i], &m_current[i], 8) == 0)
+        {
+            i += 8;
+            continue;
+        }
+        if (m_state[i] == m_current[i])
+        {
+            ++i;
+            continue;
+        }
+
+        std::size_t start = i;
+        std::size_t end = i + 1; // One past the last changed byte.
+        for (i = end; i < size && i - end < MAX_GAP && i - start < 0xFFFF; ++i)
+        {
+            if (m_state[i] != m_current[i])
+                end = i + 1;
+        }
+        put32(m_delta, start);
+        put16(m_delta, end - start);
+        for (std::size_t j = start; j < end; ++j)
+            m_delta.push_back(m_state[j] ^ m_current[j]);
+        i = end;
+    }
+
+    std::size_t record_size = m_delta.size() + 2 * LENGTH_SIZE;
+    if (record_size > m_ring.size())
+    {
+        // Can't be stored, start a new recording from this frame.
+        clear();
+        m_current.swap(m_state);
+        return;
+    }
+    while (m_ring.size() - m_used < record_size)
+        drop();
+
+    unsigned char length[LENGTH_SIZE];
+    for (std::size_t j = 0; j < LENGTH_SIZE; ++j)
+        length[j] = (m_delta.size() >> (j * 8)) & 0xFF;
+    write(m_head, length, LENGTH_SIZE);
+    write(m_head + LENGTH_SIZE, m_delta.data(), m_delta.size());
+    write(m_head + LENGTH_SIZE + m_delta.size(), length, LENGTH_SIZE);
+    m_head = (m_head + record_size) % m_ring.size();
+    m_used += record_size;
+    ++m_frames;
+
+    m_current.swap(m_state);
+}
+
+bool Rewind::rewind(CHIP8& core)
+{
+    if (m_frames == 0)
+        return false;
+
+    // The newest record ends right before m_head.
+    std::size_t end = (m_head + m_ring.size() - LENGTH_SIZE) % m_ring.size();
+    unsigned char length[LENGTH_SIZE];
+    read(end, length, LENGTH_SIZE);
+    std::size_t delta_size = 0;
+    for (std::size_t j = 0; j < LENGTH_SIZE; ++j)
+        delta_size |= static_cast<std::size_t>(length[j]) << (j * 8);
+
+    std::size_t record_size = delta_size + 2 * LENGTH_SIZE;
+    std::size_t start = (m_head + m_ring.size() - record_size) % m_ring.size();
+    m_delta.resize(delta_size);
+    read(start + LENGTH_SIZE, m_delta.data(), delta_size);
+    m_head = start;
+    m_used -= record_size;
+    --m_frames;
+
+    // XOR the runs back out of the current state.
+    std::size_t i = 0;
+    while (i + RUN_HEADER_SIZE <= m_delta.size())
+    {
+        std::size_t offset = m_delta[i] | m_delta[i + 1] << 8 | m_delta[i + 2] << 16 |
+                             static_cast<std::size_t>(m_delta[i + 3]) << 24;
+        std::size_t run = m_delta[i + 4] | m_delta[i + 5] << 8;
+        i += RUN_HEADER_SIZE;
+        for (std::size_t j = 0; j < run; ++j)
+            m_current[offset + j] ^= m_delta[i + j];
+        i += run;
+    }
+
+    return core.loadState(m_current.data(), m_current.size());
+}
+
+void Rewind::clear()
+{
+    m_head = 0;
+    m_tail = 0;
+    m_used = 0;
+    m_frames = 0;
+    m_current.clear();
+}
+
+std::size_t Rewind::frames() const
+{
+    return m_frames;
+}
+
+void Rewind::write(std::size_t position, const unsigned char* data, std::size_t size)
+{
+    // Records may wrap around the end of the ring.
+    position %= m_ring.size();
+    std::size_t first = std::min(size, m_ring.size() - position);
+    std::memcpy(&m_ring[position], data, first);
+    std::memcpy(&m_ring[0], data + first, size - first);
+}
+
+void Rewind::read(std::size_t position, unsigned char* data, std::size_t size) const
+{
+    position %= m_ring.size();
+    std::size_t first = std::min(size, m_ring.size() - position);
+    std::memcpy(data, &m_ring[position], first);
+    std::memcpy(data + first, &m_ring[0], size - first);
+}
+
+void Rewind::drop()
+{
+    unsigned char length[LENGTH_SIZE];
+    read(m_tail, length, LENGTH_SIZE);
+    std::size_t delta_size = 0;
+    for (std::size_t j = 0; j < LENGTH_SIZE; ++j)
+        delta_size |= static_cast<std::size_t>(length[j]) << (j * 8);
+
+    std::size_t record_size = delta_size + 2 * LENGTH_SIZE;
+    m_tail = (m_tail + record_size) % m_ring.size();
+    m_used -= record_size;
+    --m_frames;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <cstddef>
+#include <vector>
+
+/* Records the machine once per emulated frame and steps back through the recording. Each record
+is the XOR of a save state with the one before it, stored as runs of changed bytes, so a frame
+that only changes a few registers takes a few bytes. Records live in a ring buffer of fixed size,
+the oldest ones are dropped to make room.
+
+Ring record layout: length (4 bytes), delta runs, length again (4 bytes) so the ring can be walked
+from either end. A delta run is offset (4 bytes), length (2 bytes) and that many XOR bytes.
+*/
+class Rewind
+{
+public:
+    explicit Rewind(std::size_t budget = 8 * 1024 * 1024); // Ring buffer size in bytes.
+
+    std::size_t budget() const; // Ring buffer size getter.
+    void budget(std::size_t); // Ring buffer size setter, drops the recording.
+
+    void record(const CHIP8& core); // Records the state of core, call once per frame.
+    bool rewind(CHIP8& core); // Puts core back one frame, returns false if nothing is left.
+    void clear();
+
+    std::size_t frames() const; // Frames that can be rewound.
+
+private:
+    void write(std::size_t position, const unsigned char* data, std::size_t size);
+    void read(std::size_t position, unsigned char* data, std::size_t size) const;
+    void drop(); // Drops the oldest record.
+
+    std::vector<unsigned char> m_ring;
+    std::size_t m_head; // Where the next record goes.
+    std::size_t m_tail; // Start of the oldest record.
+    std::size_t m_used; // Bytes used in m_ring.
+    std::size_t m_frames; // Records in m_ring.
+
+    std::vector<unsigned char> m_current; // Last recorded state, empty before the first record.
+    std::vector<unsigned char> m_state; // State being recorded.
+    std::vector<unsigned char> m_delta; // Delta being recorded.
+};
@@ -0,0 +1,197 @@
+#include "RomPack.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+
+namespace
+{
+    const unsigned char MAGIC[4] = { 'C', '8', 'P', 'K' };
+    const unsigned short VERSION = 1;
+    const std::size_t HEADER_SIZE = 16;
+    const std::size_t ENTRY_SIZE = 32;
+
+    void put(std::vector<unsigned char>& out, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+
+    std::uint64_t get(const unsigned char* in, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint64_t>(in[i]) << (i * 8);
+        return value;
+    }
+
+    bool byName(const RomPack::Rom& a, const RomPack::Rom& b)
+    {
+        return a.name < b.name;
+    }
+}
+
+RomPack::RomPack(void): m_count(0)
+{
+}
+
+bool RomPack::open(const std::string& file_name)
+{
+    close();
+    if (!m_file.open(file_name))
+        return false;
+
+    const unsigned char* data = m_file.data();
+    std::size_t size = m_file.size();
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, 4) != 0 || get(data + 4, 2) != VERSION)
+    {
+        m_file.close();
+        return false;
+    }
+    std::uint64_t count = get(data + 8, 4);
+    if (count > (size - HEADER_SIZE) / ENTRY_SIZE)
+    {
+        m_file.close();
+        return false;
+    }
+
+    // Everything the index points to has to be in the file, and the names sorted for find().
+    m_count = static_cast<std::size_t>(count);
+    for (std::size_t i = 0; i < m_count; ++i)
+    {
+        const unsigned char* in = entry(i);
+        std::uint64_t offset = get(in, 8);
+        std::uint64_t length = get(in + 8, 4);
+        std::uint64_t name_offset = get(in + 12, 4);
+        std::uint64_t name_length = get(in + 16, 2);
+        if (offset > size || length > size - offset || name_offset > size || name_length > size - name_offset ||
+            in[18] > CHIP8::QUIRKS_XOCHIP || (i > 0 && !(name(i - 1) < name(i))))
+        {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void RomPack::close()
+{
+    m_file.close();
+    m_count = 0;
+}
+
+std::size_t RomPack::size() const
+{
+    return m_count;
+}
+
+RomPack::Rom RomPack::rom(std::size_t index) const
+{
+    const unsigned char* in = entry(index);
+    Rom rom;
+    rom.name = name(index);
+    rom.data = m_file.data() + get(in, 8);
+    rom.size = static_cast<std::size_t>(get(in + 8, 4));
+    rom.quirks = static_cast<CHIP8::Quirks>(in[18]);
+    rom.clock = static_cast<unsigned int>(get(in + 20, 4));
+    rom.hash = get(in + 24, 8);
+    return rom;
+}
+
+bool RomPack::find(const std::string& name, std::size_t& index) const
+{
+    // Binary search, the index is sorted by name.
+    std::size_t low = 0;
+    std::size_t high = m_count;
+    while (low < high)
+    {
+        std::size_t middle = low + (high - low) / 2;
+        if (this->name(middle) < name)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == m_count || this->name(low) != name)
+        return false;
+    index = low;
+    return true;
+}
+
+bool RomPack::verify(std::size_t index) const
+{
+    Rom rom = this->rom(index);
+    return hash(rom.data, rom.size) == rom.hash;
+}
+
+CHIP8::LoadResult RomPack::load(std::size_t index, CHIP8& core) const
+{
+    Rom rom = this->rom(index);
+    return core.loadGame(rom.data, rom.size, rom.quirks);
+}
+
+std::uint64_t RomPack::hash(const unsigned char* data, std::size_t size, std::uint64_t seed)
+{
+    std::uint64_t value = seed;
+    for (std::size_t i = 0; i < size; ++i)
+        value = (value ^ data[i]) * 0x100000001B3ull;
+    return value;
+}
+
+bool RomPack::write(const std::string& file_name, std::vector<Rom> roms)
+{
+    std::sort(roms.begin(), roms.end(), byName);
+    for (std::size_t i = 1; i < roms.size(); ++i)
+    {
+        if (roms[i - 1].name == roms[i].name)
+            return false;
+    }
+
+    // The index, then all names, then all data.
+    std::vector<unsigned char> header;
+    header.insert(header.end(), MAGIC, MAGIC + 4);
+    put(header, VERSION, 2);
+    put(header, 0, 2);
+    put(header, roms.size(), 4);
+    put(header, 0, 4);
+    std::uint64_t name_offset = HEADER_SIZE + ENTRY_SIZE * roms.size();
+    std::uint64_t offset = name_offset;
+    for (std::size_t i = 0; i < roms.size(); ++i)
+        offset += roms[i].name.size();
+    for (std::size_t i = 0; i < roms.size(); ++i)
+    {
+        const Rom& rom = roms[i];
+        if (rom.name.size() > 0xFFFF || rom.size > 0xFFFFFFFFu || offset + rom.size > 0xFFFFFFFFu)
+            return false; // Names and data past 4 GB don't fit the 32-bit fields.
+        put(header, offset, 8);
+        put(header, rom.size, 4);
+        put(header, name_offset, 4);
+        put(header, rom.name.size(), 2);
+        put(header, rom.quirks, 1);
+        put(header, 0, 1);
+        put(header, rom.clock, 4);
+        put(header, hash(rom.data, rom.size), 8);
+        name_offset += rom.name.size();
+        offset += rom.size;
+    }
+
+    std::ofstream file(file_name, std::ofstream::binary);
+    file.write(reinterpret_cast<const char*>(header.data()), header.size());
+    for (std::size_t i = 0; i < roms.size(); ++i)
+        file.write(roms[i].name.data(), roms[i].name.size());
+    for (std::size_t i = 0; i < roms.size(); ++i)
+        file.write(reinterpret_cast<const char*>(roms[i].data), roms[i].size);
+    return file.good();
+}
+
+const unsigned char* RomPack::entry(std::size_t index) const
+{
+    return m_file.data() + HEADER_SIZE + index * ENTRY_SIZE;
+}
+
+std::string RomPack::name(std::size_t index) const
+{
+    const unsigned char* in = entry(index);
+    const char* name = reinterpret_cast<const char*>(m_file.data() + get(in + 12, 4));
+    return std::string(name, static_cast<std::size_t>(get(in + 16, 2)));
+}
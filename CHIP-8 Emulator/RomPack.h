@@ -0,0 +1,74 @@
+#pragma once
+#include "CHIP8.h"
+#include "MappedFile.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Many ROMs in one file with an index, so a job running thousands of ROMs maps one file instead of
+opening thousands. Each ROM carries its name, the hash of its data and how to run it: the quirk
+profile and the clock. The pack is memory-mapped and ROMs are handed out in place, without copies.
+
+Format, version 1. Multi-byte values are little endian, offsets are from the start of the file.
+Offset  Size    Contents
+0       4       Magic "C8PK"
+4       2       Version
+6       2       Reserved, 0
+8       4       Number of ROMs N
+12      4       Reserved, 0
+16      32 * N  Index, one entry per ROM, sorted by name (bytewise, names are unique):
+                0   8   Offset of the ROM data
+                8   4   Size of the ROM data
+                12  4   Offset of the name
+                16  2   Length of the name
+                18  1   Quirk profile, a CHIP8::Quirks value
+                19  1   Reserved, 0
+                20  4   Clock in instructions per second, 0 for the player's choice
+                24  8   FNV-1a hash of the ROM data
+16+32N          Names and ROM data, anywhere the index points to
+*/
+class RomPack
+{
+public:
+    struct Rom
+    {
+        std::string name;
+        const unsigned char* data;
+        std::size_t size;
+        CHIP8::Quirks quirks;
+        unsigned int clock; // 0 when the pack leaves it to the player.
+        std::uint64_t hash; // Of the data, see hash().
+    };
+
+    RomPack(void);
+
+    // Maps a pack and checks that its index is consistent. Returns false if the file can't be read
+    // or isn't a pack, the data itself is only checked by verify().
+    bool open(const std::string& file_name);
+    void close();
+
+    std::size_t size() const; // Number of ROMs.
+    Rom rom(std::size_t index) const; // The data stays valid until the pack is closed.
+    bool find(const std::string& name, std::size_t& index) const;
+    bool verify(std::size_t index) const; // Whether the data still matches its hash.
+    CHIP8::LoadResult load(std::size_t index, CHIP8& core) const; // With the ROM's quirk profile.
+
+    static const std::uint64_t HASH_SEED = 0xCBF29CE484222325ull; // The FNV-1a offset basis.
+    // FNV-1a, 64 bits. Passing the hash of earlier data as the seed continues it.
+    static std::uint64_t hash(const unsigned char* data, std::size_t size, std::uint64_t seed = HASH_SEED);
+    // Writes a pack of roms, their hashes are computed here. Returns false if the file can't be
+    // written or two ROMs have the same name.
+    static bool write(const std::string& file_name, std::vector<Rom> roms);
+
+private:
+    RomPack(const RomPack&); // Not copyable.
+    RomPack& operator=(const RomPack&);
+
+    const unsigned char* entry(std::size_t index) const;
+    std::string name(std::size_t index) const;
+
+    MappedFile m_file;
+    std::size_t m_count; // 0 when closed.
+};
@@ -0,0 +1,70 @@
+#include "SDLAudio.h"
+
+#include <algorithm>
+
+
+namespace
+{
+    const Uint16 CALLBACK_SAMPLES = 512; // Samples per callback, about 12 ms at 44.1 kHz.
+    const std::size_t RING_SAMPLES = 4096; // About 90 ms at 44.1 kHz, the most that is queued.
+}
+
+SDLAudioSink::SDLAudioSink(void): m_device(0),
+                                  m_rate(44100),
+                                  m_ring(RING_SAMPLES)
+{
+}
+
+SDLAudioSink::~SDLAudioSink(void)
+{
+    close();
+}
+
+bool SDLAudioSink::open(unsigned int rate)
+{
+    close();
+
+    SDL_AudioSpec wanted = {};
+    wanted.freq = rate;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = CALLBACK_SAMPLES;
+    wanted.callback = &SDLAudioSink::callback;
+    wanted.userdata = this;
+
+    // SDL converts from the wanted format if the device doesn't support it.
+    SDL_AudioSpec obtained;
+    m_device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+    if (m_device == 0)
+        return false;
+
+    m_rate = rate;
+    SDL_PauseAudioDevice(m_device, 0);
+    return true;
+}
+
+void SDLAudioSink::close()
+{
+    if (m_device != 0)
+        SDL_CloseAudioDevice(m_device);
+    m_device = 0;
+}
+
+unsigned int SDLAudioSink::rate() const
+{
+    return m_rate;
+}
+
+void SDLAudioSink::write(const std::int16_t* samples, std::size_t count)
+{
+    m_ring.write(samples, count);
+}
+
+void SDLCALL SDLAudioSink::callback(void* sink, Uint8* stream, int length)
+{
+    // Runs on SDL's audio thread.
+    std::int16_t* samples = reinterpret_cast<std::int16_t*>(stream);
+    std::size_t count = length / sizeof(std::int16_t);
+    std::size_t read = static_cast<SDLAudioSink*>(sink)->m_ring.read(samples, count);
+    std::fill(samples + read, samples + count, 0);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "Audio.h"
+#include "AudioRing.h"
+
+#include <SDL.h>
+
+/* Plays samples through an SDL audio device. write() only puts the samples in a lock-free ring,
+the device's callback takes them out on SDL's audio thread and plays silence when the ring runs
+dry, so the emulation never waits on audio. When emulating faster than real time the samples that
+don't fit in the ring are dropped.
+*/
+class SDLAudioSink : public AudioSink
+{
+public:
+    SDLAudioSink(void);
+    ~SDLAudioSink(void);
+
+    // Opens and starts the default audio device, returns false with the reason in SDL_GetError()
+    // on failure. SDL must have been initialized with SDL_INIT_AUDIO.
+    bool open(unsigned int rate = 44100);
+    void close();
+
+    unsigned int rate() const;
+    void write(const std::int16_t* samples, std::size_t count);
+
+private:
+    static void SDLCALL callback(void* sink, Uint8* stream, int length);
+
+    SDL_AudioDeviceID m_device; // 0 when closed.
+    unsigned int m_rate;
+    AudioRing m_ring;
+};
@@ -0,0 +1,113 @@
+#include "CHIP8.h"
+#include "MappedFile.h"
+#include "SaveStateFormat.h"
+
+#include <cstring>
+#include <fstream>
+
+using namespace SaveStateFormat;
+
+void CHIP8::saveState(std::vector<unsigned char>& state) const
+{
+    state.clear();
+    std::size_t memory_size = m_memory_mask + 1u;
+    state.reserve(STATE_SIZE + memory_size);
+    state.insert(state.end(), MAGIC, MAGIC + 4);
+    put(state, VERSION, 2);
+    put(state, m_quirks, 1);
+    put(state, memory_size, 4);
+    state.insert(state.end(), m_memory.begin(), m_memory.begin() + memory_size);
+    state.insert(state.end(), m_V.begin(), m_V.end());
+    put(state, m_I, 2);
+    put(state, m_pc, 2);
+    put(state, m_sp, 2);
+    for (int i = 0; i < 16; ++i)
+        put(state, m_stack[i], 2);
+    put(state, m_delay_timer, 1);
+    put(state, m_sound_timer, 1);
+    put(state, m_keys, 2);
+    put(state, m_draw_flag, 1);
+    put(state, m_hires, 1);
+    put(state, m_planes, 1);
+    state.insert(state.end(), m_flags.begin(), m_flags.end());
+    state.insert(state.end(), m_pattern.begin(), m_pattern.end());
+    put(state, m_pitch, 1);
+    for (unsigned int i = 0; i < m_gfx.size(); ++i)
+        put(state, m_gfx[i], 8);
+    put(state, m_random.state(), 8);
+    put(state, m_cycles, 8);
+}
+
+bool CHIP8::loadState(const unsigned char* state, std::size_t size)
+{
+    // States only load into a machine with the same quirk profile, and so the same amount of memory.
+    std::size_t memory_size = m_memory_mask + 1u;
+    if (size != STATE_SIZE + memory_size || std::memcmp(state, MAGIC, 4) != 0)
+        return false;
+    const unsigned char* in = state + 4;
+    if (get(in, 2) != VERSION)
+        return false;
+    std::uint64_t profile = get(in, 1);
+    if (profile > QUIRKS_XOCHIP || profile != static_cast<std::uint64_t>(m_quirks) || get(in, 4) != memory_size)
+        return false;
+
+    // Only the bytes that differ are written so that decoded code survives restoring states of
+    // the same program.
+    if (std::memcmp(in, m_memory.data(), memory_size) != 0)
+    {
+        for (unsigned int address = 0; address < memory_size; ++address)
+        {
+            if (m_memory[address] != in[address])
+            {
+                invalidate(address);
+                m_memory[address] = in[address];
+            }
+        }
+        if (m_flush_blocks)
+            flushBlocks();
+    }
+    in += memory_size;
+
+    std::memcpy(m_V.data(), in, m_V.size());
+    in += m_V.size();
+    m_I = static_cast<unsigned short>(get(in, 2));
+    m_pc = static_cast<unsigned short>(get(in, 2));
+    m_sp = static_cast<unsigned short>(get(in, 2));
+    for (int i = 0; i < 16; ++i)
+        m_stack[i] = static_cast<unsigned short>(get(in, 2));
+    m_delay_timer = static_cast<unsigned char>(get(in, 1));
+    m_sound_timer = static_cast<unsigned char>(get(in, 1));
+    m_keys = static_cast<unsigned short>(get(in, 2));
+    get(in, 1); // The draw flag, the whole screen gets redrawn below anyway.
+    m_hires = get(in, 1) != 0;
+    m_planes = static_cast<unsigned char>(get(in, 1)) & 0x3;
+    std::memcpy(m_flags.data(), in, m_flags.size());
+    in += m_flags.size();
+    std::memcpy(m_pattern.data(), in, m_pattern.size());
+    in += m_pattern.size();
+    m_pitch = static_cast<unsigned char>(get(in, 1));
+    for (unsigned int i = 0; i < m_gfx.size(); ++i)
+        m_gfx[i] = get(in, 8);
+    m_random.state(get(in, 8));
+    m_cycles = get(in, 8);
+
+    m_draw_flag = true;
+    m_dirty_rows = ~0ull;
+    return true;
+}
+
+bool CHIP8::saveState(const std::string& file_name) const
+{
+    std::vector<unsigned char> state;
+    saveState(state);
+
+    std::ofstream file(file_name, std::ofstream::binary);
+    file.write(reinterpret_cast<const char*>(state.data()), state.size());
+    return file.good();
+}
+
+bool CHIP8::loadState(const std::string& file_name)
+{
+    MappedFile file;
+    return file.open(file_name) && loadState(file.data(), file.size());
+}
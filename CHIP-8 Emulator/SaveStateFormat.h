@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Save state format, version 4, shared by CHIP8::saveState and Batch::saveState. Multi-byte values
+are little endian. M is the memory size, 4096, or 65536 with the XO-CHIP quirk profile.
+Offset  Size  Contents
+0       4     Magic "C8SS"
+4       2     Version
+6       1     Quirk profile, a CHIP8::Quirks
+7       4     Memory size M
+11      M     Memory
+M+11    16    V0-VF
+M+27    2     I
+M+29    2     Program counter
+M+31    2     Stack pointer
+M+33    32    Stack, 16 entries
+M+65    1     Delay timer
+M+66    1     Sound timer
+M+67    2     Keypad, bit n set when key n is pressed
+M+69    1     Draw flag
+M+70    1     High resolution
+M+71    1     Selected planes
+M+72    16    RPL user flags
+M+88    16    Audio pattern
+M+104   1     Audio pitch
+M+105   2048  Screen, 2 planes of 64 rows of 2 words, see CHIP8::FrameView
+M+2153  8     Random number generator state
+M+2161  8     Cycles emulated
+M+2169        End
+*/
+namespace SaveStateFormat
+{
+    const unsigned char MAGIC[4] = { 'C', '8', 'S', 'S' };
+    const unsigned short VERSION = 4;
+    const std::size_t STATE_SIZE = 2169; // Without the memory.
+    const unsigned int SCREEN_WORDS = 256;
+
+    // Offsets from the table above, plus M.
+    const std::size_t HIRES_OFFSET = 70;
+    const std::size_t PLANES_OFFSET = 71;
+    const std::size_t SCREEN_OFFSET = 105;
+
+    inline void put(std::vector<unsigned char>& out, std::uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+            out.push_back(static_cast<unsigned char>(value >> (i * 8)));
+    }
+
+    inline std::uint64_t get(const unsigned char*& in, int bytes)
+    {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i)
+            value |= static_cast<std::uint64_t>(in[i]) << (i * 8);
+        in += bytes;
+        return value;
+    }
+}
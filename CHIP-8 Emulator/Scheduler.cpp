@@ -0,0 +1,142 @@
+#include "Scheduler.h"
+
+
+namespace
+{
+    const std::chrono::microseconds FRAME_TIME(1000000 / Scheduler::FRAME_RATE);
+}
+
+Scheduler::Scheduler(CHIP8& core, unsigned int clock): m_core(core),
+                                                       m_clock(clock),
+                                                       m_remainder(0),
+                                                       m_next_frame(Clock::now()),
+                                                       m_frames(0),
+                                                       m_turbo(false),
+                                                       m_frame_skip(10),
+                                                       m_presented(0)
+{
+}
+
+unsigned int Scheduler::clock() const
+{
+    return m_clock;
+}
+
+void Scheduler::clock(unsigned int clock)
+{
+    m_clock = clock;
+}
+
+bool Scheduler::turbo() const
+{
+    return m_turbo;
+}
+
+void Scheduler::turbo(bool turbo)
+{
+    m_turbo = turbo;
+    m_presented = m_frames;
+    m_next_frame = Clock::now(); // Normal pacing resumes from now.
+}
+
+unsigned int Scheduler::frame_skip() const
+{
+    return m_frame_skip;
+}
+
+void Scheduler::frame_skip(unsigned int frame_skip)
+{
+    m_frame_skip = frame_skip;
+}
+
+void Scheduler::onFrame(const std::function<void()>& on_frame)
+{
+    m_on_frame = on_frame;
+}
+
+unsigned int Scheduler::runFrame()
+{
+    // Clocks that aren't a multiple of the frame rate carry the fraction over to later frames.
+    m_remainder += m_clock;
+    unsigned int cycles = m_remainder / FRAME_RATE;
+    m_remainder %= FRAME_RATE;
+
+    m_core.emulate(cycles);
+    m_core.updateTimers();
+    ++m_frames;
+    if (m_on_frame)
+        m_on_frame();
+    return cycles;
+}
+
+unsigned int Scheduler::runDue(unsigned int max_frames)
+{
+    if (m_turbo)
+        return runTurbo();
+
+    unsigned int frames = due(max_frames);
+    for (unsigned int i = 0; i < frames; ++i)
+        runFrame();
+    return frames;
+}
+
+unsigned int Scheduler::due(unsigned int max_frames)
+{
+    Clock::time_point now = Clock::now();
+    unsigned int frames = 0;
+    while (m_next_frame <= now && frames < max_frames)
+    {
+        m_next_frame += FRAME_TIME;
+        ++frames;
+    }
+
+    // Drop whatever couldn't be caught up with.
+    if (m_next_frame <= now)
+        m_next_frame = now + FRAME_TIME;
+    return frames;
+}
+
+unsigned int Scheduler::runTurbo()
+{
+    // Emulate until the next present is due, or for a frame's worth of host time when there are
+    // no presents so the frontend still gets to handle input.
+    const unsigned int CLOCK_CHECK_INTERVAL = 16; // Frames between reading the host clock.
+
+    Clock::time_point end = Clock::now() + FRAME_TIME;
+    unsigned int frames = 0;
+    do
+    {
+        runFrame();
+        ++frames;
+        if (m_frame_skip != 0 && m_frames - m_presented >= m_frame_skip)
+            break;
+    }
+    while (frames % CLOCK_CHECK_INTERVAL != 0 || Clock::now() < end);
+
+    m_next_frame = Clock::now();
+    return frames;
+}
+
+bool Scheduler::present()
+{
+    if (!m_turbo)
+        return true;
+    if (m_frame_skip == 0 || m_frames - m_presented < m_frame_skip)
+        return false;
+
+    m_presented = m_frames;
+    return true;
+}
+
+std::chrono::microseconds Scheduler::untilNextFrame() const
+{
+    Clock::time_point now = Clock::now();
+    if (m_next_frame <= now)
+        return std::chrono::microseconds(0);
+    return std::chrono::duration_cast<std::chrono::microseconds>(m_next_frame - now);
+}
+
+unsigned long long Scheduler::frames() const
+{
+    return m_frames;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <chrono>
+#include <functional>
+
+/* Paces emulation in 60 Hz frames. A frame emulates the number of instructions the configured
+clock allows for 1/60 s and then counts the timers down once, so emulated time only depends on
+the instruction count. Wall-clock time only decides how many frames are due, which keeps the
+emulation speed independent of how often the frontend presents.
+
+In turbo mode frames are emulated back to back as fast as the host allows and only every
+frame_skip-th frame is meant to be presented (none at all if frame_skip is 0). The timers still
+count down once per emulated frame, so the emulated program sees normal speed.
+*/
+class Scheduler
+{
+public:
+    static const unsigned int FRAME_RATE = 60; // Frames, and timer ticks, per second.
+
+    explicit Scheduler(CHIP8& core, unsigned int clock = 700);
+
+    unsigned int clock() const; // Instructions per second getter.
+    void clock(unsigned int); // Instructions per second setter.
+    bool turbo() const; // Turbo mode getter.
+    void turbo(bool); // Turbo mode setter.
+    unsigned int frame_skip() const; // Turbo frame skip getter.
+    void frame_skip(unsigned int); // Turbo frame skip setter.
+
+    // Called after every emulated frame, e.g. to record it.
+    void onFrame(const std::function<void()>&);
+
+    // Emulates one frame, returns the number of instructions emulated.
+    unsigned int runFrame();
+    // Returns the number of frames that became due since the previous call, at most max_frames,
+    // without emulating them. For frontends that are doing something else with the time.
+    unsigned int due(unsigned int max_frames = 4);
+    // Emulates the frames that became due since the previous call, at most max_frames. Frames
+    // beyond that are dropped so a stalled host doesn't make the emulator spiral. Returns the
+    // number of frames emulated.
+    unsigned int runDue(unsigned int max_frames = 4);
+    // Whether the frames emulated since the last present should be presented. Always true outside
+    // of turbo mode.
+    bool present();
+    // Time left until the next frame is due. Always 0 after runDue() in turbo mode, frames
+    // emulated with due() and runFrame() are paced in either mode.
+    std::chrono::microseconds untilNextFrame() const;
+
+    unsigned long long frames() const; // Frames emulated so far.
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    unsigned int runTurbo();
+
+    CHIP8& m_core;
+    unsigned int m_clock; // Instructions per second.
+    unsigned int m_remainder; // Instructions owed to the next frames, in 1/FRAME_RATE units.
+    Clock::time_point m_next_frame; // When the next frame is due.
+    unsigned long long m_frames;
+    bool m_turbo;
+    unsigned int m_frame_skip; // Frames per present in turbo mode, 0 for no presents.
+    unsigned long long m_presented; // Frame count at the last present in turbo mode.
+    std::function<void()> m_on_frame;
+};
@@ -0,0 +1,182 @@
+#include "SharedFrames.h"
+
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+SharedFrames::SharedFrames(void): m_layout(nullptr)
+{
+}
+
+SharedFrames::~SharedFrames(void)
+{
+    close();
+}
+
+bool SharedFrames::create(const std::string& name)
+{
+    if (!map(name, true))
+        return false;
+
+    // A stale object left behind by a crash is reused, so everything readers look at is reset.
+    m_layout->magic = 0;
+    m_layout->version = VERSION;
+    m_layout->slots = SLOTS;
+    m_layout->published.store(0, std::memory_order_relaxed);
+    m_layout->keys.store(0, std::memory_order_relaxed);
+    for (std::uint32_t i = 0; i < SLOTS; ++i)
+        m_layout->slot[i].sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_layout->magic = MAGIC;
+    return true;
+}
+
+bool SharedFrames::attach(const std::string& name)
+{
+    if (!map(name, false))
+        return false;
+    if (m_layout->magic != MAGIC || m_layout->version != VERSION || m_layout->slots != SLOTS)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool SharedFrames::map(const std::string& name, bool create)
+{
+    close();
+
+#ifndef _WIN32
+    std::string path = name.compare(0, 1, "/") == 0 ? name : "/" + name;
+    int descriptor = shm_open(path.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0600);
+    if (descriptor < 0)
+        return false;
+
+    bool sized = false;
+    if (create)
+        sized = ftruncate(descriptor, sizeof(Layout)) == 0;
+    else
+    {
+        struct stat status;
+        sized = fstat(descriptor, &status) == 0 && static_cast<std::size_t>(status.st_size) >= sizeof(Layout);
+    }
+    if (sized)
+    {
+        void* data = mmap(nullptr, sizeof(Layout), PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+        if (data != MAP_FAILED)
+            m_layout = static_cast<Layout*>(data);
+    }
+    ::close(descriptor);
+
+    if (m_layout == nullptr)
+    {
+        if (create)
+            shm_unlink(path.c_str());
+        return false;
+    }
+    if (create)
+        m_name = path;
+    return true;
+#else
+    (void)name;
+    (void)create;
+    return false;
+#endif
+}
+
+void SharedFrames::close()
+{
+#ifndef _WIN32
+    if (m_layout != nullptr)
+        munmap(m_layout, sizeof(Layout));
+    if (!m_name.empty())
+        shm_unlink(m_name.c_str());
+#endif
+    m_layout = nullptr;
+    m_name.clear();
+}
+
+void SharedFrames::publish(const CHIP8& core, std::uint64_t frame)
+{
+    if (m_layout == nullptr)
+        return;
+
+    std::uint32_t index = m_layout->published.load(std::memory_order_relaxed);
+    Slot& slot = m_layout->slot[index % SLOTS];
+    std::uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release); // The odd number is seen before any write.
+
+    CHIP8::FrameView view = core.gfx();
+    slot.index = index;
+    slot.frame.frame = frame;
+    slot.frame.cycles = core.cycles();
+    for (unsigned int plane = 0; plane < 2; ++plane)
+        std::copy(view.planes[plane], view.planes[plane] + PLANE_WORDS, slot.frame.planes[plane]);
+    slot.frame.width = view.width;
+    slot.frame.height = view.height;
+    slot.frame.registers = core.registers();
+    slot.frame.idle = static_cast<std::uint8_t>(core.idle());
+    slot.frame.buzzer = core.buzzer() ? 1 : 0;
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    m_layout->published.store(index + 1, std::memory_order_release);
+}
+
+unsigned short SharedFrames::keys() const
+{
+    if (m_layout == nullptr)
+        return 0;
+    return static_cast<unsigned short>(m_layout->keys.load(std::memory_order_acquire));
+}
+
+std::uint32_t SharedFrames::published() const
+{
+    if (m_layout == nullptr)
+        return 0;
+    return m_layout->published.load(std::memory_order_acquire);
+}
+
+bool SharedFrames::read(std::uint32_t index, Frame& frame) const
+{
+    if (m_layout == nullptr)
+        return false;
+
+    // The slot of a published frame is only written again for a frame SLOTS later, so a slot being
+    // written, or written during the copy, no longer holds it.
+    const Slot& slot = m_layout->slot[index % SLOTS];
+    std::uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence & 1)
+        return false;
+    std::uint32_t written = slot.index;
+    frame = slot.frame;
+    std::atomic_thread_fence(std::memory_order_acquire); // The copy is done before the check.
+    return slot.sequence.load(std::memory_order_relaxed) == sequence && written == index;
+}
+
+bool SharedFrames::latest(Frame& frame) const
+{
+    // Only fails if the emulator went round the whole ring between reading published() and the
+    // slot, the next try gets a newer frame.
+    for (;;)
+    {
+        std::uint32_t published = this->published();
+        if (published == 0)
+            return false;
+        if (read(published - 1, frame))
+            return true;
+    }
+}
+
+void SharedFrames::keys(unsigned short keys)
+{
+    if (m_layout != nullptr)
+        m_layout->keys.store(keys, std::memory_order_release);
+}
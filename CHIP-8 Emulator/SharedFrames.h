@@ -0,0 +1,90 @@
+#pragma once
+#include "CHIP8.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/* Emulated frames in POSIX shared memory, for other processes to watch the emulator and press its
+keys without going through a pipe or a socket. The emulator creates the object and publishes every
+frame into a ring of the last SLOTS ones: a copy of the screen, the registers and the frame number.
+Any number of readers attach to the object by name and copy frames out of it.
+
+The emulator is the only writer of the ring and never waits for the readers. Each slot is guarded by
+a sequence number that is odd while the slot is being written (a seqlock): a reader copies the slot
+and keeps the copy only if the sequence number was even and unchanged across it, otherwise the
+frame was overwritten meanwhile. The input block goes the other way, readers store the keys held
+and the emulator applies the changes once per frame.
+
+Only available where shm_open is, create and attach fail elsewhere.
+*/
+class SharedFrames
+{
+public:
+    static const std::uint32_t MAGIC = 0x46533843; // "C8SF" in a little endian file.
+    static const std::uint32_t VERSION = 1;
+    static const std::uint32_t SLOTS = 8; // A power of two, so published() can wrap around.
+    static const unsigned int PLANE_WORDS = 128; // Rows of 2 words like CHIP8::FrameView, 64 rows.
+
+    // One published frame.
+    struct Frame
+    {
+        std::uint64_t frame; // Frames emulated so far, see Scheduler::frames().
+        std::uint64_t cycles; // CHIP8::cycles().
+        std::uint64_t planes[2][PLANE_WORDS]; // Stride 2, see CHIP8::FrameView.
+        std::uint32_t width; // 64 or 128.
+        std::uint32_t height; // 32 or 64.
+        CHIP8::Registers registers;
+        std::uint8_t idle; // CHIP8::Idle.
+        std::uint8_t buzzer; // Whether the buzzer sounds.
+    };
+
+    struct Slot
+    {
+        std::atomic<std::uint32_t> sequence; // Odd while the slot is written.
+        std::uint32_t index; // Frame number in the ring, published() when it was written.
+        Frame frame;
+    };
+
+    // The shared object. Attaching checks magic, version and slots, the rest follows from them.
+    struct Layout
+    {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint32_t slots;
+        std::atomic<std::uint32_t> published; // Frames written, the latest in slot (published - 1) % SLOTS.
+        std::atomic<std::uint32_t> keys; // Input block, bit n is set while a reader holds key n.
+        Slot slot[SLOTS];
+    };
+
+    SharedFrames(void);
+    ~SharedFrames(void);
+
+    // Emulator side. Creates the object, replacing a stale one of the same name, and removes the
+    // name again on close; readers keep their mapping until they close it. A name without the
+    // leading '/' shm_open wants gets one.
+    bool create(const std::string& name);
+    void publish(const CHIP8& core, std::uint64_t frame);
+    unsigned short keys() const; // Keys held by readers.
+
+    // Reader side. Attaches to an object created by another process.
+    bool attach(const std::string& name);
+    std::uint32_t published() const; // Frames published so far, wrapping around.
+    // Copies out frame index (a value of published() - 1 or earlier). Returns false if it was
+    // overwritten, which only happens to frames more than SLOTS behind.
+    bool read(std::uint32_t index, Frame& frame) const;
+    bool latest(Frame& frame) const; // The newest frame, false before the first one.
+    void keys(unsigned short keys); // Sets the keys held, applied before the next frame.
+
+    void close();
+
+private:
+    SharedFrames(const SharedFrames&); // Not copyable.
+    SharedFrames& operator=(const SharedFrames&);
+
+    bool map(const std::string& name, bool create);
+
+    Layout* m_layout; // nullptr when closed.
+    std::string m_name; // Of the object created, empty when attached.
+};
@@ -0,0 +1,130 @@
+#include "CHIP8.h"
+#include "MappedFile.h"
+#include "RomPack.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Builds ROM packs (see RomPack.h) and lists them. ROMs are named by their file name as given on
+the command line. --quirks and --clock apply to the ROMs after them, without --quirks a ROM's
+profile follows its extension (see CHIP8::quirksForFile).
+*/
+
+namespace
+{
+    // Prints the index and checks every ROM's hash, returns false if any doesn't match.
+    bool list(const RomPack& pack)
+    {
+        bool intact = true;
+        std::cout << std::left << std::setw(40) << "name" << std::right << std::setw(8) << "size"
+                  << std::setw(9) << "quirks" << std::setw(7) << "clock" << "  hash" << '\n';
+        for (std::size_t i = 0; i < pack.size(); ++i)
+        {
+            RomPack::Rom rom = pack.rom(i);
+            bool verified = pack.verify(i);
+            intact = intact && verified;
+            std::cout << std::left << std::setw(40) << rom.name << std::right << std::setw(8) << rom.size
+                      << std::setw(9) << CHIP8::quirksName(rom.quirks) << std::setw(7) << rom.clock << "  "
+                      << std::hex << std::setfill('0') << std::setw(16) << rom.hash << std::dec
+                      << std::setfill(' ') << (verified ? "" : "  corrupt") << '\n';
+        }
+        std::cout << pack.size() << " ROMs" << std::endl;
+        return intact;
+    }
+
+    void usage()
+    {
+        std::cout << "Usage: chip8-pack --output=PACK [options] ROM files" << std::endl;
+        std::cout << "       chip8-pack --list=PACK" << std::endl;
+        std::cout << "Options: --quirks=NAME (cosmac, schip, xochip or default, for the ROMs after it)" << std::endl;
+        std::cout << "         --clock=N (instructions per second for the ROMs after it, 0 to leave it open)"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string output;
+    std::string listed;
+    bool override_quirks = false;
+    CHIP8::Quirks quirks = CHIP8::QUIRKS_DEFAULT;
+    unsigned int clock = 0;
+    std::vector<RomPack::Rom> roms;
+    std::vector<std::vector<unsigned char> > data;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 9, "--output=") == 0)
+            output = argument.substr(9);
+        else if (argument.compare(0, 7, "--list=") == 0)
+            listed = argument.substr(7);
+        else if (argument.compare(0, 9, "--quirks=") == 0)
+        {
+            if (!CHIP8::parseQuirks(argument.substr(9), quirks))
+            {
+                std::cerr << "Unknown quirk profile " << argument.substr(9) << std::endl;
+                return 2;
+            }
+            override_quirks = true;
+        }
+        else if (argument.compare(0, 8, "--clock=") == 0)
+            clock = std::atoi(argument.c_str() + 8);
+        else if (argument == "--help" || argument.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return argument == "--help" ? 0 : 2;
+        }
+        else
+        {
+            RomPack::Rom rom = { argument, nullptr, 0, quirks, clock, 0 };
+            if (!override_quirks)
+                rom.quirks = CHIP8::quirksForFile(argument);
+
+            // Checked here so a pack never holds a ROM that can't be loaded.
+            MappedFile file;
+            if (!file.open(argument))
+            {
+                std::cerr << "Could not read " << argument << std::endl;
+                return 2;
+            }
+            if (file.size() == 0 || file.size() > CHIP8::programCapacity(rom.quirks))
+            {
+                std::cerr << argument << " is empty or larger than the " << CHIP8::programCapacity(rom.quirks)
+                          << " bytes of memory available to programs" << std::endl;
+                return 2;
+            }
+            data.push_back(std::vector<unsigned char>(file.data(), file.data() + file.size()));
+            rom.size = file.size();
+            roms.push_back(rom);
+        }
+    }
+
+    if (!listed.empty())
+    {
+        RomPack pack;
+        if (!pack.open(listed))
+        {
+            std::cerr << "Could not read " << listed << " as a ROM pack" << std::endl;
+            return 2;
+        }
+        return list(pack) ? 0 : 1;
+    }
+    if (output.empty() || roms.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    for (std::size_t i = 0; i < roms.size(); ++i)
+        roms[i].data = data[i].data();
+    if (!RomPack::write(output, roms))
+    {
+        std::cerr << "Could not write " << output << " (are two ROMs named the same?)" << std::endl;
+        return 2;
+    }
+    std::cout << "Packed " << roms.size() << " ROMs into " << output << std::endl;
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "CHIP8.h"
+#include "MappedFile.h"
+#include "Programs.h"
+#include "Recompiler.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/* Recompiles ROMs ahead of time into one C++ source file (see Recompiler.h). Compiling the file
+into a host along with the core makes loadGame pick up the native code of those ROMs, which
+ENGINE_NATIVE runs. --quirks applies to the ROMs after it, without it a ROM's profile follows its
+extension (see CHIP8::quirksForFile). The native code only runs with the profile it was compiled
+for.
+*/
+
+namespace
+{
+    struct Rom
+    {
+        std::string name;
+        std::vector<unsigned char> data;
+        CHIP8::Quirks quirks;
+    };
+
+    void usage()
+    {
+        std::cout << "Usage: chip8-recompile --output=FILE [options] ROM files" << std::endl;
+        std::cout << "Options: --quirks=NAME (cosmac, schip, xochip or default, for the ROMs after it)" << std::endl;
+        std::cout << "         --builtin (also recompile the benchmark's built-in programs, with the quirks given before it)"
+                  << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string output;
+    bool override_quirks = false;
+    CHIP8::Quirks quirks = CHIP8::QUIRKS_DEFAULT;
+    std::vector<Rom> roms;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 9, "--output=") == 0)
+            output = argument.substr(9);
+        else if (argument.compare(0, 9, "--quirks=") == 0)
+        {
+            if (!CHIP8::parseQuirks(argument.substr(9), quirks))
+            {
+                std::cerr << "Unknown quirk profile " << argument.substr(9) << std::endl;
+                return 2;
+            }
+            override_quirks = true;
+        }
+        else if (argument == "--builtin")
+        {
+            // Named like the regression runner names them.
+            for (std::size_t j = 0; j < MICRO_PROGRAM_COUNT + ROM_PROGRAM_COUNT; ++j)
+            {
+                const Program& program = j < MICRO_PROGRAM_COUNT ? MICRO_PROGRAMS[j] : ROM_PROGRAMS[j - MICRO_PROGRAM_COUNT];
+                Rom rom = { std::string("builtin/") + program.name,
+                            std::vector<unsigned char>(program.data, program.data + program.size), quirks };
+                roms.push_back(rom);
+            }
+        }
+        else if (argument == "--help" || argument.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return argument == "--help" ? 0 : 2;
+        }
+        else
+        {
+            Rom rom = { argument, std::vector<unsigned char>(), quirks };
+            if (!override_quirks)
+                rom.quirks = CHIP8::quirksForFile(argument);
+
+            MappedFile file;
+            if (!file.open(argument))
+            {
+                std::cerr << "Could not read " << argument << std::endl;
+                return 2;
+            }
+            rom.data.assign(file.data(), file.data() + file.size());
+            roms.push_back(rom);
+        }
+    }
+    if (output.empty() || roms.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    std::ostringstream source;
+    Recompiler::writeHeader(source);
+    for (std::size_t i = 0; i < roms.size(); ++i)
+    {
+        const Rom& rom = roms[i];
+        if (rom.data.empty() || rom.data.size() > CHIP8::programCapacity(rom.quirks))
+        {
+            std::cerr << rom.name << " is empty or larger than the " << CHIP8::programCapacity(rom.quirks)
+                      << " bytes of memory available to programs" << std::endl;
+            return 2;
+        }
+
+        Recompiler recompiler(rom.data.data(), rom.data.size(), rom.quirks);
+        std::ostringstream id;
+        id << "rom" << i;
+        recompiler.write(source, rom.name, id.str());
+        std::cout << rom.name << ": " << recompiler.compiled() << " of " << recompiler.reached()
+                  << " instructions compiled" << std::endl;
+    }
+
+    // Only opened once every ROM is recompiled, a ROM that can't be doesn't leave a partial source
+    // file behind for make to pick up.
+    std::ofstream file(output);
+    file << source.str();
+    if (!file.good())
+    {
+        std::cerr << "Could not write " << output << std::endl;
+        return 2;
+    }
+    return 0;
+}
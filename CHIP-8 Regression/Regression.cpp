@@ -0,0 +1,536 @@
+#include "CHIP8.h"
+#include "Programs.h"
+#include "RomPack.h"
+#include "Scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/* Headless regression runner for the CHIP8 core. Runs every ROM of the given directories, manifests
+and ROM packs (and with --builtin the benchmark's programs) for a fixed number of cycles, on a pool of
+threads with one machine each. At evenly spaced checkpoints it hashes the screen and the machine
+state (the save state: registers, stack, timers, memory and screen) and compares the hashes with
+the golden values stored for the ROM, reporting which ROMs pass. --update stores the hashes of
+this run as the new golden values instead.
+
+A manifest lists one ROM per line, relative to the manifest, optionally followed by the name of a
+quirk profile. Blank lines and lines starting with # are skipped. ROMs in directories get their
+quirk profile from the extension: .sc8 is schip, .xo8 xochip and anything else (.ch8, .c8)
+default. ROMs in packs (.c8pk, see RomPack.h) have their own profile and clock, and are named as
+in the pack, so a pack shares golden values with the directory it was made from.
+*/
+
+namespace
+{
+    const std::uint64_t SEED = 0xC8C8C8C8; // Same random numbers for every run.
+
+    struct Options
+    {
+        unsigned int clock;
+        unsigned long long cycles; // Budget per ROM.
+        unsigned int checkpoints;
+        unsigned int threads; // 0 for one per core.
+        CHIP8::Engine engine;
+        bool override_quirks; // Run everything with quirks rather than the ROM's own profile.
+        CHIP8::Quirks quirks;
+        bool builtin;
+        bool update;
+        std::string golden; // Golden values file.
+        std::string output; // File to write the report to, standard output if empty.
+    };
+
+    struct Rom
+    {
+        std::string name; // As reported and stored in the golden file.
+        std::string file_name; // Empty for ROMs already in memory.
+        const unsigned char* data; // Built-in programs and ROMs in packs.
+        std::size_t size;
+        CHIP8::Quirks quirks;
+        unsigned int clock; // 0 for --clock.
+        const RomPack* pack; // Pack the data is checked against before running, or nullptr.
+        std::size_t index; // In the pack.
+    };
+
+    struct Checkpoint
+    {
+        unsigned long long frame;
+        unsigned long long cycles;
+        std::uint64_t screen;
+        std::uint64_t state;
+    };
+
+    struct Run
+    {
+        std::string error; // Set when the ROM couldn't be run.
+        std::vector<Checkpoint> checkpoints;
+    };
+
+    // The visible pixels of both planes, row by row.
+    std::uint64_t hashScreen(const CHIP8& core)
+    {
+        CHIP8::FrameView frame = core.gfx();
+        std::uint64_t value = RomPack::hash(reinterpret_cast<const unsigned char*>(&frame.width), sizeof(frame.width));
+        unsigned int words = frame.width / 64;
+        for (unsigned int plane = 0; plane < 2; ++plane)
+        {
+            for (unsigned int y = 0; y < frame.height; ++y)
+            {
+                for (unsigned int word = 0; word < words; ++word)
+                {
+                    std::uint64_t pixels = frame.planes[plane][y * frame.stride + word];
+                    unsigned char bytes[8]; // Leftmost pixels first.
+                    for (int byte = 0; byte < 8; ++byte)
+                        bytes[byte] = static_cast<unsigned char>(pixels >> (56 - byte * 8));
+                    value = RomPack::hash(bytes, sizeof(bytes), value);
+                }
+            }
+        }
+        return value;
+    }
+
+    std::string directoryOf(const std::string& file_name)
+    {
+        std::string::size_type slash = file_name.find_last_of("/\\");
+        return slash == std::string::npos ? std::string() : file_name.substr(0, slash + 1);
+    }
+
+    bool endsWith(const std::string& text, const std::string& suffix)
+    {
+        if (text.size() < suffix.size())
+            return false;
+        for (std::size_t i = 0; i < suffix.size(); ++i)
+        {
+            char c = text[text.size() - suffix.size() + i];
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+            if (c != suffix[i])
+                return false;
+        }
+        return true;
+    }
+
+    bool isDirectory(const std::string& path)
+    {
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributesA(path.c_str());
+        return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+        struct stat status;
+        return stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode);
+#endif
+    }
+
+    // Names of the entries of a directory, without . and .., in no particular order.
+    bool listDirectory(const std::string& path, std::vector<std::string>& names)
+    {
+#ifdef _WIN32
+        WIN32_FIND_DATAA entry;
+        HANDLE find = FindFirstFileA((path + "\\*").c_str(), &entry);
+        if (find == INVALID_HANDLE_VALUE)
+            return false;
+        do
+        {
+            std::string name = entry.cFileName;
+            if (name != "." && name != "..")
+                names.push_back(name);
+        } while (FindNextFileA(find, &entry));
+        FindClose(find);
+        return true;
+#else
+        DIR* directory = opendir(path.c_str());
+        if (directory == nullptr)
+            return false;
+        while (dirent* entry = readdir(directory))
+        {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..")
+                names.push_back(name);
+        }
+        closedir(directory);
+        return true;
+#endif
+    }
+
+    // Adds the ROMs in path and its subdirectories, named relative to root.
+    void scanDirectory(const std::string& root, const std::string& relative, std::vector<Rom>& roms)
+    {
+        std::string path = relative.empty() ? root : root + "/" + relative;
+        std::vector<std::string> names;
+        listDirectory(path, names);
+        std::sort(names.begin(), names.end());
+        for (std::size_t i = 0; i < names.size(); ++i)
+        {
+            std::string name = relative.empty() ? names[i] : relative + "/" + names[i];
+            if (isDirectory(root + "/" + name))
+            {
+                scanDirectory(root, name, roms);
+                continue;
+            }
+            if (!endsWith(name, ".sc8") && !endsWith(name, ".xo8") && !endsWith(name, ".ch8") &&
+                !endsWith(name, ".c8"))
+                continue;
+            Rom rom = { name, root + "/" + name, nullptr, 0, CHIP8::quirksForFile(name), 0, nullptr, 0 };
+            roms.push_back(rom);
+        }
+    }
+
+    bool readManifest(const std::string& file_name, std::vector<Rom>& roms)
+    {
+        std::ifstream file(file_name);
+        if (!file.good())
+        {
+            std::cerr << "Could not read " << file_name << std::endl;
+            return false;
+        }
+        std::string directory = directoryOf(file_name);
+        std::string line;
+        for (unsigned int number = 1; std::getline(file, line); ++number)
+        {
+            std::istringstream fields(line);
+            std::string name, quirks;
+            if (!(fields >> name) || name[0] == '#')
+                continue;
+            Rom rom = { name, directory + name, nullptr, 0, CHIP8::QUIRKS_DEFAULT, 0, nullptr, 0 };
+            if (fields >> quirks && !CHIP8::parseQuirks(quirks, rom.quirks))
+            {
+                std::cerr << file_name << ":" << number << ": unknown quirk profile " << quirks << std::endl;
+                return false;
+            }
+            roms.push_back(rom);
+        }
+        return true;
+    }
+
+    bool readPack(const std::string& file_name, RomPack& pack, std::vector<Rom>& roms)
+    {
+        if (!pack.open(file_name))
+        {
+            std::cerr << "Could not read " << file_name << " as a ROM pack" << std::endl;
+            return false;
+        }
+        for (std::size_t i = 0; i < pack.size(); ++i)
+        {
+            RomPack::Rom entry = pack.rom(i);
+            Rom rom = { entry.name, "", entry.data, entry.size, entry.quirks, entry.clock, &pack, i };
+            roms.push_back(rom);
+        }
+        return true;
+    }
+
+    const char* loadError(CHIP8::LoadResult result)
+    {
+        switch (result)
+        {
+            case CHIP8::LOAD_OK:
+                break;
+            case CHIP8::LOAD_UNREADABLE:
+                return "could not read the ROM";
+            case CHIP8::LOAD_EMPTY:
+                return "the ROM is empty";
+            case CHIP8::LOAD_TOO_LARGE:
+                return "the ROM doesn't fit in memory";
+        }
+        return "";
+    }
+
+    // Golden values by ROM name, then by frame.
+    typedef std::map<std::string, std::map<unsigned long long, Checkpoint> > Golden;
+
+    // Lines of "name frame cycles screen-hash state-hash", hashes in hexadecimal.
+    bool readGolden(const std::string& file_name, Golden& golden)
+    {
+        std::ifstream file(file_name);
+        if (!file.good())
+            return false;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string name;
+            Checkpoint checkpoint;
+            if (!(fields >> name) || name[0] == '#')
+                continue;
+            if (fields >> checkpoint.frame >> checkpoint.cycles >> std::hex >> checkpoint.screen >> checkpoint.state)
+                golden[name][checkpoint.frame] = checkpoint;
+        }
+        return true;
+    }
+
+    bool writeGolden(const std::string& file_name, const Golden& golden)
+    {
+        std::ofstream file(file_name);
+        file << "# CHIP-8 regression golden values: name frame cycles screen-hash state-hash\n";
+        for (Golden::const_iterator rom = golden.begin(); rom != golden.end(); ++rom)
+        {
+            for (std::map<unsigned long long, Checkpoint>::const_iterator i = rom->second.begin();
+                 i != rom->second.end(); ++i)
+            {
+                const Checkpoint& checkpoint = i->second;
+                file << rom->first << ' ' << checkpoint.frame << ' ' << checkpoint.cycles << ' ' << std::hex
+                     << std::setfill('0') << std::setw(16) << checkpoint.screen << ' ' << std::setw(16)
+                     << checkpoint.state << std::dec << '\n';
+            }
+        }
+        return file.good();
+    }
+
+    // Runs a ROM through a Scheduler, the way the frontend does, for the frames covering the
+    // cycle budget and hashes the machine at the checkpoints.
+    void run(const Rom& rom, const Options& options, Run& result)
+    {
+        if (rom.pack != nullptr && !rom.pack->verify(rom.index))
+        {
+            result.error = "the ROM doesn't match its hash in the pack";
+            return;
+        }
+
+        CHIP8 core(SEED);
+        CHIP8::Quirks quirks = options.override_quirks ? options.quirks : rom.quirks;
+        CHIP8::LoadResult loaded = rom.data != nullptr ? core.loadGame(rom.data, rom.size, quirks) :
+                                                         core.loadGame(rom.file_name, quirks);
+        if (loaded != CHIP8::LOAD_OK)
+        {
+            result.error = loadError(loaded);
+            return;
+        }
+        core.engine(options.engine);
+        unsigned int clock = rom.clock != 0 ? rom.clock : options.clock;
+        Scheduler scheduler(core, clock);
+
+        unsigned long long frames = (options.cycles * Scheduler::FRAME_RATE + clock - 1) / clock;
+        std::vector<unsigned char> state;
+        unsigned long long frame = 0;
+        for (unsigned int i = 1; i <= options.checkpoints; ++i)
+        {
+            for (unsigned long long end = frames * i / options.checkpoints; frame < end; ++frame)
+                scheduler.runFrame();
+            core.saveState(state);
+            Checkpoint checkpoint = { frame, core.cycles(), hashScreen(core), RomPack::hash(state.data(), state.size()) };
+            result.checkpoints.push_back(checkpoint);
+        }
+    }
+
+    // Runs every ROM, each thread taking the next ROM nobody took yet.
+    void runAll(const std::vector<Rom>& roms, const Options& options, std::vector<Run>& runs)
+    {
+        runs.assign(roms.size(), Run());
+        std::atomic<std::size_t> next(0);
+        auto worker = [&]()
+        {
+            for (std::size_t i = next++; i < roms.size(); i = next++)
+                run(roms[i], options, runs[i]);
+        };
+
+        unsigned int threads = options.threads != 0 ? options.threads : std::thread::hardware_concurrency();
+        threads = std::max(1u, std::min<unsigned int>(threads, static_cast<unsigned int>(roms.size())));
+        std::vector<std::thread> pool;
+        for (unsigned int i = 1; i < threads; ++i)
+            pool.push_back(std::thread(worker));
+        worker();
+        for (std::size_t i = 0; i < pool.size(); ++i)
+            pool[i].join();
+    }
+
+    // Compares a run with the ROM's golden values, returns an empty string if they match.
+    std::string compare(const Run& run, const std::map<unsigned long long, Checkpoint>& golden)
+    {
+        for (std::size_t i = 0; i < run.checkpoints.size(); ++i)
+        {
+            const Checkpoint& checkpoint = run.checkpoints[i];
+            std::map<unsigned long long, Checkpoint>::const_iterator expected = golden.find(checkpoint.frame);
+            std::ostringstream where;
+            where << " at frame " << checkpoint.frame << " (cycle " << checkpoint.cycles << ")";
+            if (expected == golden.end())
+                return "no golden values" + where.str();
+            if (checkpoint.screen != expected->second.screen)
+                return "screen differs" + where.str();
+            if (checkpoint.cycles != expected->second.cycles || checkpoint.state != expected->second.state)
+                return "state differs" + where.str();
+        }
+        return std::string();
+    }
+
+    void usage()
+    {
+        std::cout << "Usage: chip8-regress [options] [directories, manifests or ROM packs]" << std::endl;
+        std::cout << "Options: --golden=FILE (golden values, default golden.txt)" << std::endl;
+        std::cout << "         --update (store this run's hashes as the golden values)" << std::endl;
+        std::cout << "         --builtin (also run the benchmark's built-in programs)" << std::endl;
+        std::cout << "         --cycles=N (instructions per ROM, default 100000)" << std::endl;
+        std::cout << "         --checkpoints=N (hashes per ROM, default 4)" << std::endl;
+        std::cout << "         --clock=N (instructions per second, default 700)" << std::endl;
+        std::cout << "         --threads=N (default one per core)" << std::endl;
+        std::cout << "         --engine=NAME (interpreter, predecoded, blocks, jit or native, default blocks)" << std::endl;
+        std::cout << "         --quirks=NAME (cosmac, schip, xochip or default, for all ROMs)" << std::endl;
+        std::cout << "         --output=FILE (write the report to FILE instead of standard output)" << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { 700, 100000, 4, 0, CHIP8::ENGINE_BLOCKS, false, CHIP8::QUIRKS_DEFAULT, false, false,
+                        "golden.txt", "" };
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 9, "--golden=") == 0)
+            options.golden = argument.substr(9);
+        else if (argument == "--update")
+            options.update = true;
+        else if (argument == "--builtin")
+            options.builtin = true;
+        else if (argument.compare(0, 9, "--cycles=") == 0)
+            options.cycles = std::strtoull(argument.c_str() + 9, nullptr, 10);
+        else if (argument.compare(0, 14, "--checkpoints=") == 0)
+            options.checkpoints = std::atoi(argument.c_str() + 14);
+        else if (argument.compare(0, 8, "--clock=") == 0)
+            options.clock = std::atoi(argument.c_str() + 8);
+        else if (argument.compare(0, 10, "--threads=") == 0)
+            options.threads = std::atoi(argument.c_str() + 10);
+        else if (argument.compare(0, 9, "--engine=") == 0)
+        {
+            if (!CHIP8::parseEngine(argument.substr(9), options.engine))
+            {
+                std::cerr << "Unknown engine " << argument.substr(9) << std::endl;
+                return 2;
+            }
+        }
+        else if (argument.compare(0, 9, "--quirks=") == 0)
+        {
+            if (!CHIP8::parseQuirks(argument.substr(9), options.quirks))
+            {
+                std::cerr << "Unknown quirk profile " << argument.substr(9) << std::endl;
+                return 2;
+            }
+            options.override_quirks = true;
+        }
+        else if (argument.compare(0, 9, "--output=") == 0)
+            options.output = argument.substr(9);
+        else if (argument == "--help" || argument.compare(0, 2, "--") == 0)
+        {
+            usage();
+            return argument == "--help" ? 0 : 2;
+        }
+        else
+            paths.push_back(argument);
+    }
+    if (options.clock < Scheduler::FRAME_RATE || options.checkpoints == 0)
+    {
+        std::cerr << "The clock has to be at least " << Scheduler::FRAME_RATE
+                  << " and there has to be a checkpoint" << std::endl;
+        return 2;
+    }
+
+    std::vector<Rom> roms;
+    if (options.builtin)
+    {
+        for (std::size_t i = 0; i < MICRO_PROGRAM_COUNT; ++i)
+        {
+            const Program& program = MICRO_PROGRAMS[i];
+            Rom rom = { std::string("builtin/") + program.name, "", program.data, program.size,
+                        CHIP8::QUIRKS_DEFAULT, 0, nullptr, 0 };
+            roms.push_back(rom);
+        }
+        for (std::size_t i = 0; i < ROM_PROGRAM_COUNT; ++i)
+        {
+            const Program& program = ROM_PROGRAMS[i];
+            Rom rom = { std::string("builtin/") + program.name, "", program.data, program.size,
+                        CHIP8::QUIRKS_DEFAULT, 0, nullptr, 0 };
+            roms.push_back(rom);
+        }
+    }
+    std::list<RomPack> packs; // Mapped until the end, the ROMs point into them.
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        if (isDirectory(paths[i]))
+            scanDirectory(paths[i], "", roms);
+        else if (endsWith(paths[i], ".c8pk"))
+        {
+            packs.emplace_back();
+            if (!readPack(paths[i], packs.back(), roms))
+                return 2;
+        }
+        else if (!readManifest(paths[i], roms))
+            return 2;
+    }
+    if (roms.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    Golden golden;
+    if (!readGolden(options.golden, golden) && !options.update)
+    {
+        std::cerr << "Could not read " << options.golden << ", run with --update to create it" << std::endl;
+        return 2;
+    }
+
+    std::vector<Run> runs;
+    runAll(roms, options, runs);
+
+    std::ofstream file;
+    if (!options.output.empty())
+        file.open(options.output);
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    unsigned int passed = 0;
+    unsigned int failed = 0;
+    for (std::size_t i = 0; i < roms.size(); ++i)
+    {
+        std::string failure = runs[i].error;
+        if (failure.empty() && options.update)
+        {
+            // Replaces whatever the ROM had, other ROMs' values stay.
+            std::map<unsigned long long, Checkpoint>& values = golden[roms[i].name];
+            values.clear();
+            for (std::size_t j = 0; j < runs[i].checkpoints.size(); ++j)
+                values[runs[i].checkpoints[j].frame] = runs[i].checkpoints[j];
+        }
+        else if (failure.empty())
+            failure = compare(runs[i], golden[roms[i].name]);
+
+        if (failure.empty())
+        {
+            out << "PASS " << roms[i].name << '\n';
+            ++passed;
+        }
+        else
+        {
+            out << "FAIL " << roms[i].name << ": " << failure << '\n';
+            ++failed;
+        }
+    }
+    out << passed << " passed, " << failed << " failed" << std::endl;
+
+    if (!options.output.empty() && !file.good())
+    {
+        std::cerr << "Could not write " << options.output << std::endl;
+        return 2;
+    }
+    if (options.update && !writeGolden(options.golden, golden))
+    {
+        std::cerr << "Could not write " << options.golden << std::endl;
+        return 2;
+    }
+    return failed == 0 ? 0 : 1;
+}